@@ -1,7 +1,7 @@
 @echo off
 setlocal
 
-set SRC=src\main.c src\game.c
+set SRC=src\main.c src\game.c src\sim.c src\pool.c src\snapshot.c src\jobs.c src\skills.c src\grid.c src\render.c src\demand.c src\commands.c src\ai.c src\terrain.c src\synergy.c src\edits.c src\voxel.c src\bvh.c src\cull.c src\text.c
 set OUTPUT=bin\game.exe
 
 set RAYLIB_INCLUDE=deps\RAYLIB\include
@@ -12,7 +12,7 @@ set RAYGUI_INCLUDE=deps\RAYGUI
 if not exist bin mkdir bin
 
 set CFLAGS=-Wall -g
-set LIBS=-lraylib -lopengl32 -lgdi32 -lwinmm
+set LIBS=-lraylib -lopengl32 -lgdi32 -lwinmm -lpthread
 
 echo.
 echo Building...
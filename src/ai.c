@@ -0,0 +1,364 @@
+#include "game.h"
+#include <string.h>
+
+static const char *rival_names[MAX_COMPANIES - 1] = {
+    "Red Planet Grill", "Olympus Eats", "Crater Burger", "Dusty Diner", "Valles Bistro", "Phobos Fries",
+    "Deimos Deli", "Tharsis Tacos", "Rover Ramen", "Hellas Hotpot", "Gale Grub", "Jezero Noodles"};
+
+static const Color rival_colors[MAX_COMPANIES - 1] = {
+    {230, 80, 80, 255}, {80, 160, 230, 255}, {240, 200, 60, 255}, {150, 90, 220, 255},
+    {70, 200, 120, 255}, {240, 130, 40, 255}, {200, 200, 200, 255}, {230, 90, 180, 255},
+    {60, 200, 200, 255}, {170, 120, 70, 255}, {120, 230, 60, 255}, {100, 100, 240, 255}};
+
+#define RIVAL_COUNT 6 // active rivals in a new game
+
+void init_companies(Game *game)
+{
+    Company *player = &game->data.companies[PLAYER_COMPANY_ID];
+    *player = (Company){0};
+    snprintf(player->name, sizeof(player->name), "You");
+    player->is_active = true;
+    player->color = WHITE;
+
+    game->data.company_count = 1 + RIVAL_COUNT;
+    for (uint32_t i = 1; i < MAX_COMPANIES; i++)
+    {
+        Company *company = &game->data.companies[i];
+        *company = (Company){0};
+        snprintf(company->name, sizeof(company->name), "%s", rival_names[i - 1]);
+        company->is_active = i < game->data.company_count;
+        company->is_ai = true;
+        company->color = rival_colors[i - 1];
+        company->net_worth = AI_STARTING_FUNDS;
+        company->rng_state = 0xDA3E39CB94B95BDBULL * i;
+        company->think_timer = AI_THINK_INTERVAL * i / game->data.company_count; // stagger decisions
+        company->planner.phase = AI_PLANNER_IDLE;
+        company->planner.aggression = sim_random_float(&company->rng_state) * 2.0f - 1.0f;
+    }
+
+    // Everyone starts out in the free city.
+    for (uint32_t i = 0; i < game->data.company_count; i++)
+        game->data.cities[0].company_mask |= 1u << i;
+}
+
+/* ========== SITE PLANNING (worker threads) ========== */
+
+static float score_site(const AiPlanner *planner, Vector3 center)
+{
+    const float falloff = 1.0f / (6.0f * 6.0f);
+    const float grid_half_span = planner->grid_size * (FLOOR_CUBE_SIZE + FLOOR_SPACING) / 2.0f;
+
+    // Customers come from all around, so central sites see more of them.
+    float score = 1.0f - Vector3Length(center) / grid_half_span;
+
+    for (uint32_t i = 0; i < planner->site_count; i++)
+    {
+        const AiPlanSite *site = &planner->sites[i];
+        float influence = expf(-Vector3DistanceSqr(site->position, center) * falloff);
+        if (site->owner_id == planner->company_id)
+            score -= influence; // don't cannibalize our own restaurants
+        else if (site->owner_id == PLAYER_COMPANY_ID)
+            score += planner->aggression * influence;
+        else
+            score -= 0.5f * influence;
+    }
+    return score;
+}
+
+// True if the snapshot has room for the building's footprint centered on
+// the cell at any rotation.
+static bool is_site_free(const AiPlanner *planner, uint32_t cell_x, uint32_t cell_z)
+{
+    for (int rotation = 0; rotation < GRID_ROTATION_COUNT; rotation++)
+    {
+        if (occupancy_can_place(&planner->occupancy, planner->building_type, (int)cell_x, (int)cell_z, 90.0f * rotation))
+            return true;
+    }
+    return false;
+}
+
+static bool is_failed_site(const AiPlanner *planner, uint32_t cell)
+{
+    for (uint32_t i = 0; i < planner->failed_site_count; i++)
+    {
+        if (planner->failed_sites[i].city_index == planner->city_index && planner->failed_sites[i].cell == (int32_t)cell)
+            return true;
+    }
+    return false;
+}
+
+// Scores cells until the slice runs out of time; the main thread resubmits
+// the job every frame until all cells have been seen.
+static void run_site_planning_slice(void *data)
+{
+    AiPlanner *planner = (AiPlanner *)data;
+    double deadline = jobs_time_now() + AI_PLAN_SLICE_SECONDS;
+
+    while (planner->next_cell < planner->cell_count)
+    {
+        uint32_t cell = planner->next_cell++;
+        uint32_t cell_x = cell % planner->grid_size, cell_z = cell / planner->grid_size;
+        if (is_site_free(planner, cell_x, cell_z))
+        {
+            float score = score_site(planner, get_grid_cell_position(planner->grid_size, cell_x, cell_z));
+            if (score > planner->best_score && !is_failed_site(planner, cell))
+            {
+                planner->best_score = score;
+                planner->best_cell = (int32_t)cell;
+            }
+        }
+
+        if (planner->next_cell % AI_PLAN_CHECK_INTERVAL == 0 && jobs_time_now() > deadline)
+            break;
+    }
+}
+
+/* ========== DECISIONS (main thread) ========== */
+
+static void start_site_planning(Game *game, Company *company, int32_t city_index, BuildingType type)
+{
+    AiPlanner *planner = &company->planner;
+    const City *city = &game->data.cities[city_index];
+    const OccupancyGrid *grid = &city->grid;
+    if (city->terrain_state != CITY_TERRAIN_READY)
+        return;
+
+    size_t occupied_size = sizeof(uint64_t) * grid->words_per_row * grid->size;
+    planner->sites = (AiPlanSite *)malloc(sizeof(AiPlanSite) * (city->current_building_count + 1));
+    uint64_t *occupied = (uint64_t *)malloc(occupied_size);
+    if (!planner->sites || !occupied)
+    {
+        free(planner->sites);
+        free(occupied);
+        planner->sites = NULL;
+        return;
+    }
+    memcpy(occupied, grid->occupied, occupied_size);
+    planner->occupancy = (OccupancyGrid){grid->size, grid->words_per_row, occupied, 0, NULL};
+
+    planner->site_count = 0;
+    for (uint32_t i = 0; i < city_building_slots(city); i++)
+    {
+        const Building *building = city_get_building(city, i);
+        if (building->id != -1 && planner->site_count <= city->current_building_count)
+            planner->sites[planner->site_count++] = (AiPlanSite){building->position, building->owner_id};
+    }
+
+    planner->company_id = (uint8_t)(company - game->data.companies);
+    planner->city_index = city_index;
+    planner->building_type = type;
+    planner->next_cell = 0;
+    planner->grid_size = city->size;
+    planner->cell_count = city->size * city->size;
+    planner->best_cell = -1;
+    planner->best_score = -INFINITY;
+    planner->phase = AI_PLANNER_RUNNING;
+    jobs_submit(&planner->job, run_site_planning_slice, planner);
+}
+
+// Remembers a cell the plan picked but nothing could be built on, so the
+// next plan doesn't pick it again.
+static void add_failed_site(AiPlanner *planner, int32_t cell)
+{
+    planner->failed_sites[planner->next_failed_site] = (AiFailedSite){planner->city_index, cell};
+    planner->next_failed_site = (planner->next_failed_site + 1) % AI_FAILED_SITE_COUNT;
+    if (planner->failed_site_count < AI_FAILED_SITE_COUNT)
+        planner->failed_site_count++;
+}
+
+static void finish_site_planning(Game *game, Company *company)
+{
+    AiPlanner *planner = &company->planner;
+
+    if (planner->best_cell >= 0)
+    {
+        Command command = {0};
+        command.type = CMD_PLACE_BUILDING;
+        command.company_id = planner->company_id;
+        command.city_index = planner->city_index;
+        command.building_type = planner->building_type;
+        command.position = get_grid_cell_position(planner->grid_size, planner->best_cell % planner->grid_size,
+                                                  planner->best_cell / planner->grid_size);
+
+        // A rotation fitted in the snapshot; try each until one still fits
+        // around whatever has been built since.
+        const City *city = &game->data.cities[planner->city_index];
+        uint32_t first = sim_random(&company->rng_state) % GRID_ROTATION_COUNT;
+        bool does_fit = false;
+        for (uint32_t r = 0; r < GRID_ROTATION_COUNT && !does_fit; r++)
+        {
+            command.rotation_angle = 90.0f * ((first + r) % GRID_ROTATION_COUNT);
+            does_fit = city_grid_can_place(city, command.building_type, command.position, command.rotation_angle);
+        }
+
+        if (does_fit)
+            execute_command(game, &command);
+        else
+            add_failed_site(planner, planner->best_cell);
+    }
+
+    free(planner->sites);
+    free(planner->occupancy.occupied);
+    planner->sites = NULL;
+    planner->occupancy.occupied = NULL;
+    planner->phase = AI_PLANNER_IDLE;
+}
+
+static int32_t pick_random_city(Game *game, Company *company, uint8_t company_id)
+{
+    int32_t candidates[MAX_CITIES];
+    int count = 0;
+    for (int i = 0; i < MAX_CITIES; i++)
+    {
+        if (game->data.cities[i].company_mask & (1u << company_id))
+            candidates[count++] = i;
+    }
+    return count ? candidates[sim_random(&company->rng_state) % count] : -1;
+}
+
+// Returns a building of ours that turns customers away for lack of staff, or -1.
+static int32_t find_understaffed_building(Game *game, uint8_t company_id, int32_t *city_index)
+{
+    for (int c = 0; c < MAX_CITIES; c++)
+    {
+        const City *city = &game->data.cities[c];
+        for (uint32_t i = 0; i < city_building_slots(city); i++)
+        {
+            const Building *building = city_get_building(city, i);
+            if (building->id != -1 && building->owner_id == company_id &&
+                building->current_staff_count < building->template.staff_capacity &&
+                city->flows[i].service_rate < city->flows[i].arrival_rate)
+            {
+                *city_index = c;
+                return (int32_t)i;
+            }
+        }
+    }
+    return -1;
+}
+
+// Hires (or poaches) someone for the building. Returns false if we couldn't pay.
+static bool try_staff_building(Game *game, uint8_t company_id, uint64_t *rng, int32_t city_index, int32_t building_id)
+{
+    Command command = {0};
+    command.company_id = company_id;
+
+    // Poach one of the player's better staff now and then, otherwise hire.
+    if (sim_random_float(rng) < 0.25f)
+    {
+        int32_t start = (int32_t)(sim_random(rng) % MAX_STAFF_OWNED);
+        for (int32_t n = 0; n < MAX_STAFF_OWNED; n++)
+        {
+            int32_t staff_id = (start + n) % MAX_STAFF_OWNED;
+            const Staff *staff = &game->data.staff_owned[staff_id];
+            if (staff->is_employed && staff->employer_id == PLAYER_COMPANY_ID && staff->rarity >= RARITY_RARE)
+            {
+                command.type = CMD_POACH_STAFF;
+                command.staff_id = staff_id;
+                if (!execute_command(game, &command))
+                    return false;
+
+                command.type = CMD_ASSIGN_STAFF;
+                command.city_index = city_index;
+                command.building_id = building_id;
+                return execute_command(game, &command);
+            }
+        }
+    }
+
+    command.type = CMD_HIRE_STAFF;
+    command.role = (StaffRole)(sim_random(rng) % ROLE_COUNT);
+    command.city_index = city_index;
+    command.building_id = building_id;
+    return execute_command(game, &command);
+}
+
+static void think(Game *game, Company *company, uint8_t company_id)
+{
+    uint64_t funds = company->net_worth;
+    uint64_t *rng = &company->rng_state;
+    Command command = {0};
+    command.company_id = company_id;
+
+    // Staff first: an understaffed restaurant loses money on upkeep.
+    int32_t city_index = -1;
+    int32_t building_id = find_understaffed_building(game, company_id, &city_index);
+    if (building_id >= 0 && try_staff_building(game, company_id, rng, city_index, building_id))
+        return;
+
+    // Expand to the cheapest city we're not in yet once we can comfortably afford it.
+    for (int i = 0; i < MAX_CITIES; i++)
+    {
+        const City *city = &game->data.cities[i];
+        if (!(city->company_mask & (1u << company_id)))
+        {
+            if (funds > city->price_to_unlock * 2 && sim_random_float(rng) < 0.5f)
+            {
+                command.type = CMD_UNLOCK_CITY;
+                command.city_index = i;
+                execute_command(game, &command);
+                return;
+            }
+            break;
+        }
+    }
+
+    // Build the biggest restaurant we can afford, keeping some cash for staff.
+    for (int type = TEMPLATE_COUNT - 1; type >= 0; type--)
+    {
+        if (funds >= game->data.building_templates[type].base_cost * 3 / 2)
+        {
+            city_index = pick_random_city(game, company, company_id);
+            if (city_index >= 0)
+            {
+                start_site_planning(game, company, city_index, (BuildingType)type);
+                return;
+            }
+        }
+    }
+}
+
+void update_companies(Game *game, float dt)
+{
+    for (uint32_t i = 1; i < game->data.company_count; i++)
+    {
+        Company *company = &game->data.companies[i];
+        if (!company->is_active)
+            continue;
+
+        AiPlanner *planner = &company->planner;
+        if (planner->phase == AI_PLANNER_RUNNING && job_is_done(&planner->job))
+        {
+            if (planner->next_cell < planner->cell_count)
+                jobs_submit(&planner->job, run_site_planning_slice, planner);
+            else
+                planner->phase = AI_PLANNER_DONE;
+        }
+
+        if (planner->phase == AI_PLANNER_DONE)
+            finish_site_planning(game, company);
+
+        company->think_timer -= dt;
+        if (company->think_timer > 0.0f || planner->phase != AI_PLANNER_IDLE)
+            continue;
+
+        company->think_timer = AI_THINK_INTERVAL;
+        think(game, company, (uint8_t)i);
+    }
+}
+
+void clean_up_companies(Game *game)
+{
+    for (uint32_t i = 1; i < MAX_COMPANIES; i++)
+    {
+        AiPlanner *planner = &game->data.companies[i].planner;
+        if (planner->phase == AI_PLANNER_RUNNING)
+            job_wait(&planner->job);
+
+        free(planner->sites);
+        free(planner->occupancy.occupied);
+        planner->sites = NULL;
+        planner->occupancy.occupied = NULL;
+        planner->phase = AI_PLANNER_IDLE;
+    }
+}
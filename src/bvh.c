@@ -0,0 +1,386 @@
+#include "game.h"
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* ========== BOUNDS ========== */
+
+// World box of a building as DrawModelEx draws it: the model's mesh bounds
+// scaled by BUILDING_MODEL_SCALE, turned about Y, then moved to its position.
+BoundingBox get_building_world_bounds(const Building *building)
+{
+    BoundingBox mesh = building->template.model_bounds;
+    float angle = building->rotation_angle * DEG2RAD;
+    float c = cosf(angle), s = sinf(angle);
+
+    BoundingBox box = {{INFINITY, 0, INFINITY}, {-INFINITY, 0, -INFINITY}};
+    for (int corner = 0; corner < 4; corner++)
+    {
+        float x = ((corner & 1) ? mesh.max.x : mesh.min.x) * BUILDING_MODEL_SCALE;
+        float z = ((corner & 2) ? mesh.max.z : mesh.min.z) * BUILDING_MODEL_SCALE;
+        float world_x = x * c + z * s;
+        float world_z = -x * s + z * c;
+        box.min.x = fminf(box.min.x, world_x);
+        box.max.x = fmaxf(box.max.x, world_x);
+        box.min.z = fminf(box.min.z, world_z);
+        box.max.z = fmaxf(box.max.z, world_z);
+    }
+    box.min.y = mesh.min.y * BUILDING_MODEL_SCALE;
+    box.max.y = mesh.max.y * BUILDING_MODEL_SCALE;
+
+    box.min = Vector3Add(box.min, building->position);
+    box.max = Vector3Add(box.max, building->position);
+    return box;
+}
+
+/* ========== PACKETS ========== */
+
+static void packet_clear_slot(BvhPacket *packet, int slot)
+{
+    packet->min_x[slot] = packet->min_y[slot] = packet->min_z[slot] = INFINITY;
+    packet->max_x[slot] = packet->max_y[slot] = packet->max_z[slot] = -INFINITY;
+    packet->items[slot] = -1;
+}
+
+static void packet_set_slot(BvhPacket *packet, int slot, BoundingBox box, int32_t item)
+{
+    packet->min_x[slot] = box.min.x;
+    packet->min_y[slot] = box.min.y;
+    packet->min_z[slot] = box.min.z;
+    packet->max_x[slot] = box.max.x;
+    packet->max_y[slot] = box.max.y;
+    packet->max_z[slot] = box.max.z;
+    packet->items[slot] = item;
+}
+
+static BoundingBox packet_get_slot(const BvhPacket *packet, int slot)
+{
+    return (BoundingBox){{packet->min_x[slot], packet->min_y[slot], packet->min_z[slot]},
+                         {packet->max_x[slot], packet->max_y[slot], packet->max_z[slot]}};
+}
+
+static BoundingBox merge_boxes(BoundingBox a, BoundingBox b)
+{
+    return (BoundingBox){Vector3Min(a.min, b.min), Vector3Max(a.max, b.max)};
+}
+
+static const BoundingBox empty_box = {{INFINITY, INFINITY, INFINITY}, {-INFINITY, -INFINITY, -INFINITY}};
+
+/* ========== SETUP ========== */
+
+BuildingBvh *building_bvh_create(MemoryArena *arena, uint32_t city_size)
+{
+    BuildingBvh *bvh = (BuildingBvh *)arena_alloc(arena, sizeof(BuildingBvh));
+    if (!bvh)
+        return NULL;
+
+    bvh->city_size = city_size;
+    bvh->chunks_per_side = (city_size + GRID_CHUNK_SIZE - 1) / GRID_CHUNK_SIZE;
+    bvh->leaves = (BvhLeaf *)arena_alloc(arena, sizeof(BvhLeaf) * bvh->chunks_per_side * bvh->chunks_per_side);
+    bvh->building_leaf = (int32_t *)arena_alloc(arena, sizeof(int32_t) * MAX_BUILDINGS_PER_CITY);
+    if (!bvh->leaves || !bvh->building_leaf)
+        return NULL;
+
+    for (uint32_t i = 0; i < MAX_BUILDINGS_PER_CITY; i++)
+        bvh->building_leaf[i] = -1;
+
+    // Halve the side until a single node covers everything.
+    uint32_t side = bvh->chunks_per_side;
+    do
+    {
+        side = (side + 1) / 2;
+        uint32_t level = bvh->level_count++;
+        bvh->level_sides[level] = side;
+        bvh->levels[level] = (BvhPacket *)arena_alloc(arena, sizeof(BvhPacket) * side * side);
+        if (!bvh->levels[level])
+            return NULL;
+
+        for (uint32_t i = 0; i < side * side; i++)
+        {
+            for (int slot = 0; slot < 4; slot++)
+                packet_clear_slot(&bvh->levels[level][i], slot);
+        }
+    } while (side > 1 && bvh->level_count < BVH_MAX_LEVELS);
+
+    return bvh;
+}
+
+void building_bvh_free(BuildingBvh *bvh)
+{
+    if (!bvh)
+        return;
+
+    for (uint32_t i = 0; i < bvh->chunks_per_side * bvh->chunks_per_side; i++)
+    {
+        free(bvh->leaves[i].packets);
+        bvh->leaves[i] = (BvhLeaf){0};
+    }
+}
+
+/* ========== REFIT ========== */
+
+static BoundingBox leaf_bounds(const BvhLeaf *leaf)
+{
+    BoundingBox box = empty_box;
+    for (uint32_t i = 0; i < leaf->count; i++)
+        box = merge_boxes(box, packet_get_slot(&leaf->packets[i / 4], (int)(i % 4)));
+    return box;
+}
+
+// Writes a leaf's new box into its parent and carries the change up to the
+// root, one 4-wide node per level.
+static void refit_from_leaf(BuildingBvh *bvh, uint32_t leaf_index)
+{
+    uint32_t x = leaf_index % bvh->chunks_per_side;
+    uint32_t z = leaf_index / bvh->chunks_per_side;
+    BoundingBox box = leaf_bounds(&bvh->leaves[leaf_index]);
+    int32_t child = (int32_t)leaf_index;
+
+    for (uint32_t level = 0; level < bvh->level_count; level++)
+    {
+        int slot = (int)((z & 1) * 2 + (x & 1));
+        x /= 2;
+        z /= 2;
+        BvhPacket *node = &bvh->levels[level][z * bvh->level_sides[level] + x];
+
+        if (box.min.x > box.max.x)
+            packet_clear_slot(node, slot);
+        else
+            packet_set_slot(node, slot, box, child);
+
+        box = empty_box;
+        for (int i = 0; i < 4; i++)
+        {
+            if (node->items[i] >= 0)
+                box = merge_boxes(box, packet_get_slot(node, i));
+        }
+        child = (int32_t)(z * bvh->level_sides[level] + x);
+    }
+}
+
+/* ========== EDITS ========== */
+
+// Files the building under the grid chunk its center is in. Its box may
+// reach into the next chunk; the refit takes care of that.
+void building_bvh_insert(BuildingBvh *bvh, const Building *building)
+{
+    int x, z;
+    if (!bvh || building->id >= MAX_BUILDINGS_PER_CITY || !get_grid_cell_from_position(bvh->city_size, building->position, &x, &z))
+        return;
+
+    uint32_t leaf_index = ((uint32_t)z / GRID_CHUNK_SIZE) * bvh->chunks_per_side + (uint32_t)x / GRID_CHUNK_SIZE;
+    BvhLeaf *leaf = &bvh->leaves[leaf_index];
+    if (leaf->count == leaf->capacity * 4)
+    {
+        uint32_t capacity = leaf->capacity ? leaf->capacity * 2 : 4;
+        BvhPacket *packets = (BvhPacket *)realloc(leaf->packets, sizeof(BvhPacket) * capacity);
+        if (!packets)
+            return;
+        leaf->packets = packets;
+        leaf->capacity = capacity;
+    }
+
+    BoundingBox box = get_building_world_bounds(building);
+    uint32_t i = leaf->count++;
+    if (i % 4 == 0)
+    {
+        for (int slot = 0; slot < 4; slot++)
+            packet_clear_slot(&leaf->packets[i / 4], slot);
+    }
+    packet_set_slot(&leaf->packets[i / 4], (int)(i % 4), box, (int32_t)building->id);
+
+    bvh->building_leaf[building->id] = (int32_t)leaf_index;
+    bvh->revision++;
+    refit_from_leaf(bvh, leaf_index);
+}
+
+void building_bvh_remove(BuildingBvh *bvh, int32_t building_id)
+{
+    if (!bvh || building_id < 0 || building_id >= MAX_BUILDINGS_PER_CITY || bvh->building_leaf[building_id] < 0)
+        return;
+
+    uint32_t leaf_index = (uint32_t)bvh->building_leaf[building_id];
+    BvhLeaf *leaf = &bvh->leaves[leaf_index];
+    for (uint32_t i = 0; i < leaf->count; i++)
+    {
+        BvhPacket *packet = &leaf->packets[i / 4];
+        if (packet->items[i % 4] != building_id)
+            continue;
+
+        // Swap the last entry into the hole.
+        uint32_t last = --leaf->count;
+        BvhPacket *last_packet = &leaf->packets[last / 4];
+        packet_set_slot(packet, (int)(i % 4), packet_get_slot(last_packet, (int)(last % 4)), last_packet->items[last % 4]);
+        packet_clear_slot(last_packet, (int)(last % 4));
+        break;
+    }
+
+    bvh->building_leaf[building_id] = -1;
+    bvh->revision++;
+    refit_from_leaf(bvh, leaf_index);
+}
+
+/* ========== RAY CASTS ========== */
+
+typedef struct
+{
+    Vector3 origin;
+    Vector3 inverse_direction;
+} BvhRay;
+
+// A node or leaf still to visit (level -1 for leaves), and the distance at
+// which the ray enters it.
+typedef struct
+{
+    int32_t level;
+    int32_t index;
+    float t;
+} BvhStackEntry;
+
+// Slab test of a ray against the four boxes of a packet. Returns a bit per
+// box the ray enters before max_t, with the entry distances in t_near.
+static int slab_test(const BvhPacket *packet, const BvhRay *ray, float max_t, float t_near[4])
+{
+#if defined(__SSE2__)
+    __m128 t0, t1, enter, leave;
+
+    t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(packet->min_x), _mm_set1_ps(ray->origin.x)), _mm_set1_ps(ray->inverse_direction.x));
+    t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(packet->max_x), _mm_set1_ps(ray->origin.x)), _mm_set1_ps(ray->inverse_direction.x));
+    enter = _mm_min_ps(t0, t1);
+    leave = _mm_max_ps(t0, t1);
+
+    t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(packet->min_y), _mm_set1_ps(ray->origin.y)), _mm_set1_ps(ray->inverse_direction.y));
+    t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(packet->max_y), _mm_set1_ps(ray->origin.y)), _mm_set1_ps(ray->inverse_direction.y));
+    enter = _mm_max_ps(enter, _mm_min_ps(t0, t1));
+    leave = _mm_min_ps(leave, _mm_max_ps(t0, t1));
+
+    t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(packet->min_z), _mm_set1_ps(ray->origin.z)), _mm_set1_ps(ray->inverse_direction.z));
+    t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(packet->max_z), _mm_set1_ps(ray->origin.z)), _mm_set1_ps(ray->inverse_direction.z));
+    enter = _mm_max_ps(enter, _mm_min_ps(t0, t1));
+    leave = _mm_min_ps(leave, _mm_max_ps(t0, t1));
+
+    enter = _mm_max_ps(enter, _mm_setzero_ps());
+    leave = _mm_min_ps(leave, _mm_set1_ps(max_t));
+    _mm_storeu_ps(t_near, enter);
+
+    // Empty slots have min > max and must not pass.
+    __m128 is_used = _mm_cmple_ps(_mm_loadu_ps(packet->min_x), _mm_loadu_ps(packet->max_x));
+    return _mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(enter, leave), is_used));
+#else
+    int mask = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (packet->min_x[i] > packet->max_x[i])
+            continue;
+
+        float tx0 = (packet->min_x[i] - ray->origin.x) * ray->inverse_direction.x;
+        float tx1 = (packet->max_x[i] - ray->origin.x) * ray->inverse_direction.x;
+        float ty0 = (packet->min_y[i] - ray->origin.y) * ray->inverse_direction.y;
+        float ty1 = (packet->max_y[i] - ray->origin.y) * ray->inverse_direction.y;
+        float tz0 = (packet->min_z[i] - ray->origin.z) * ray->inverse_direction.z;
+        float tz1 = (packet->max_z[i] - ray->origin.z) * ray->inverse_direction.z;
+        float enter = fmaxf(fmaxf(fminf(tx0, tx1), fminf(ty0, ty1)), fmaxf(fminf(tz0, tz1), 0.0f));
+        float leave = fminf(fminf(fmaxf(tx0, tx1), fmaxf(ty0, ty1)), fminf(fmaxf(tz0, tz1), max_t));
+        t_near[i] = enter;
+        if (enter <= leave)
+            mask |= 1 << i;
+    }
+    return mask;
+#endif
+}
+
+// Exact test against the building's voxels, in the model's own space. The
+// transform is rigid plus a uniform scale, so t carries over unchanged.
+static bool raycast_building(const Building *building, Ray ray, float box_t, float max_t, float *hit_t)
+{
+    const VoxelShape *shape = building->template.shape;
+    if (!shape)
+    {
+        *hit_t = box_t; // no voxels to go by; the box will do
+        return true;
+    }
+
+    float angle = building->rotation_angle * DEG2RAD;
+    float c = cosf(angle), s = sinf(angle);
+    Vector3 offset = Vector3Subtract(ray.position, building->position);
+    Vector3 origin = {(offset.x * c - offset.z * s) / BUILDING_MODEL_SCALE, offset.y / BUILDING_MODEL_SCALE,
+                      (offset.x * s + offset.z * c) / BUILDING_MODEL_SCALE};
+    Vector3 direction = {(ray.direction.x * c - ray.direction.z * s) / BUILDING_MODEL_SCALE, ray.direction.y / BUILDING_MODEL_SCALE,
+                         (ray.direction.x * s + ray.direction.z * c) / BUILDING_MODEL_SCALE};
+    return voxel_shape_raycast(shape, origin, direction, max_t, hit_t);
+}
+
+// Returns the building whose voxels the ray hits first, or -1. Nodes are
+// opened nearest box first, and anything farther than the best hit so far
+// is skipped, so usually only a few leaves get the exact voxel test.
+int32_t building_bvh_raycast(const BuildingBvh *bvh, const City *city, Ray ray, float *distance)
+{
+    if (!bvh)
+        return -1;
+
+    BvhRay bvh_ray = {ray.position, {1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z}};
+    float best_t = INFINITY;
+    int32_t best_id = -1;
+
+    BvhStackEntry stack[BVH_MAX_LEVELS * 3 + 4];
+    int depth = 0;
+    stack[depth++] = (BvhStackEntry){(int32_t)bvh->level_count - 1, 0, 0.0f};
+
+    while (depth > 0)
+    {
+        BvhStackEntry entry = stack[--depth];
+        if (entry.t > best_t)
+            continue;
+
+        float t_near[4];
+        if (entry.level < 0)
+        {
+            const BvhLeaf *leaf = &bvh->leaves[entry.index];
+            for (uint32_t p = 0; p * 4 < leaf->count; p++)
+            {
+                int mask = slab_test(&leaf->packets[p], &bvh_ray, best_t, t_near);
+                for (int i = 0; i < 4; i++)
+                {
+                    float hit_t;
+                    if (!(mask & (1 << i)))
+                        continue;
+
+                    const Building *building = city_get_building(city, (uint32_t)leaf->packets[p].items[i]);
+                    if (building && building->id != -1 && raycast_building(building, ray, t_near[i], best_t, &hit_t) &&
+                        hit_t < best_t)
+                    {
+                        best_t = hit_t;
+                        best_id = (int32_t)building->id;
+                    }
+                }
+            }
+            continue;
+        }
+
+        const BvhPacket *node = &bvh->levels[entry.level][entry.index];
+        int mask = slab_test(node, &bvh_ray, best_t, t_near);
+
+        // Push the farthest hit first so the nearest is opened next.
+        int order[4], count = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if (!(mask & (1 << i)))
+                continue;
+            int j = count++;
+            while (j > 0 && t_near[order[j - 1]] < t_near[i])
+            {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = i;
+        }
+        for (int k = 0; k < count; k++)
+            stack[depth++] = (BvhStackEntry){entry.level - 1, node->items[order[k]], t_near[order[k]]};
+    }
+
+    if (distance)
+        *distance = best_t;
+    return best_id;
+}
@@ -0,0 +1,592 @@
+#include "game.h"
+
+/* ========== COMPANIES ========== */
+
+uint64_t *get_company_funds(Game *game, uint8_t company_id)
+{
+    if (company_id == PLAYER_COMPANY_ID)
+        return &game->data.player.net_worth;
+    return &game->data.companies[company_id].net_worth;
+}
+
+static bool spend(Game *game, uint8_t company_id, uint64_t amount)
+{
+    uint64_t *funds = get_company_funds(game, company_id);
+    if (*funds < amount)
+        return false;
+
+    *funds -= amount;
+    return true;
+}
+
+/* ========== STAFF ========== */
+
+static const char *staff_first_names[] = {"Ada", "Bo", "Cyd", "Dee", "Eli", "Fox", "Gus", "Hal", "Ivy", "Jax", "Kai", "Lux"};
+static const char *staff_last_names[] = {"Crater", "Dust", "Olympus", "Rover", "Tharsis", "Valles", "Phobos", "Deimos"};
+
+uint32_t get_staff_hire_fee(const Staff *staff)
+{
+    return (uint32_t)(staff->salary * STAFF_HIRE_FEE_DAYS);
+}
+
+// Rolls a new candidate. Rarer staff are more efficient and cost more.
+static void roll_staff(Staff *staff, StaffRole role, uint64_t *rng)
+{
+    static const float rarity_efficiency[RARITY_COUNT] = {0.5f, 0.8f, 1.2f, 2.0f};
+    static const uint32_t rarity_salary[RARITY_COUNT] = {50, 100, 200, 400}; // per in-game day
+
+    float roll = sim_random_float(rng);
+    StaffRarity rarity = (roll < 0.70f)   ? RARITY_COMMON
+                         : (roll < 0.90f) ? RARITY_RARE
+                         : (roll < 0.98f) ? RARITY_VERY_RARE
+                                          : RARITY_UNIQUE;
+
+    const char *first = staff_first_names[sim_random(rng) % (sizeof(staff_first_names) / sizeof(staff_first_names[0]))];
+    const char *last = staff_last_names[sim_random(rng) % (sizeof(staff_last_names) / sizeof(staff_last_names[0]))];
+    snprintf(staff->name, sizeof(staff->name), "%s %s", first, last);
+
+    staff->role = role;
+    staff->rarity = rarity;
+    staff->base_efficiency = rarity_efficiency[rarity] * (0.9f + 0.2f * sim_random_float(rng));
+    staff->salary = rarity_salary[rarity] * ((role == ROLE_MANAGER) ? 3u : 2u) / 2u;
+    staff->assigned_building_id = -1;
+}
+
+static Building *get_assigned_building(Game *game, const Staff *staff)
+{
+    if (staff->assigned_building_id < 0)
+        return NULL;
+    return city_get_building_mut(&game->data.cities[staff->home_city_id], staff->assigned_building_id);
+}
+
+static void unassign_staff(Game *game, Staff *staff)
+{
+    Building *building = get_assigned_building(game, staff);
+    if (building)
+    {
+        for (uint32_t i = 0; i < building->current_staff_count; i++)
+        {
+            if (building->assigned_staff[i] == staff)
+            {
+                building->assigned_staff[i] = building->assigned_staff[--building->current_staff_count];
+                building->assigned_staff[building->current_staff_count] = NULL;
+                break;
+            }
+        }
+        if (building->is_operational != (building->current_staff_count > 0))
+            game->data.cities[staff->home_city_id].lights_revision++;
+        building->is_operational = building->current_staff_count > 0;
+        sim_refresh_building_staff(&game->data.sim, &game->data.cities[staff->home_city_id], staff->assigned_building_id);
+    }
+    staff->assigned_building_id = -1;
+}
+
+int32_t hire_staff(Game *game, uint8_t company_id, StaffRole role)
+{
+    for (int32_t i = 0; i < MAX_STAFF_OWNED; i++)
+    {
+        Staff *staff = &game->data.staff_owned[i];
+        if (staff->is_employed)
+            continue;
+
+        Staff candidate = {0};
+        roll_staff(&candidate, role, &game->data.sim.rng_state);
+        if (!spend(game, company_id, get_staff_hire_fee(&candidate)))
+            return -1;
+
+        *staff = candidate;
+        staff->id = (uint32_t)i;
+        staff->is_employed = true;
+        staff->employer_id = company_id;
+        return i;
+    }
+    return -1;
+}
+
+bool sell_staff(Game *game, int32_t staff_id)
+{
+    if (staff_id < 0 || staff_id >= MAX_STAFF_OWNED || !game->data.staff_owned[staff_id].is_employed)
+        return false;
+
+    Staff *staff = &game->data.staff_owned[staff_id];
+    unassign_staff(game, staff);
+    *staff = (Staff){0};
+    staff->assigned_building_id = -1;
+    return true;
+}
+
+// A building_id of -1 takes the staff off their building.
+bool assign_staff(Game *game, int32_t staff_id, int32_t city_index, int32_t building_id)
+{
+    if (staff_id < 0 || staff_id >= MAX_STAFF_OWNED || city_index < 0 || city_index >= MAX_CITIES)
+        return false;
+
+    Staff *staff = &game->data.staff_owned[staff_id];
+    if (!staff->is_employed)
+        return false;
+    if (building_id < 0)
+    {
+        unassign_staff(game, staff);
+        return true;
+    }
+
+    City *city = &game->data.cities[city_index];
+    const Building *target = city_get_building(city, building_id);
+    if (!target || target->id == -1 || target->owner_id != staff->employer_id)
+        return false;
+    if (target->current_staff_count >= target->template.staff_capacity)
+        return false;
+
+    unassign_staff(game, staff);
+
+    Building *building = city_get_building_mut(city, building_id);
+    building->assigned_staff[building->current_staff_count++] = staff;
+    if (!building->is_operational)
+        city->lights_revision++;
+    building->is_operational = true;
+    sim_refresh_building_staff(&game->data.sim, city, building_id);
+
+    staff->assigned_building_id = building_id;
+    staff->home_city_id = (CityId)city_index;
+    return true;
+}
+
+// Hires a rival's employee away, paying a fee and a raise.
+static bool poach_staff(Game *game, uint8_t company_id, int32_t staff_id)
+{
+    if (staff_id < 0 || staff_id >= MAX_STAFF_OWNED)
+        return false;
+
+    Staff *staff = &game->data.staff_owned[staff_id];
+    if (!staff->is_employed || staff->employer_id == company_id)
+        return false;
+
+    if (!spend(game, company_id, (uint64_t)(staff->salary * STAFF_POACH_FEE_DAYS)))
+        return false;
+
+    unassign_staff(game, staff);
+    staff->employer_id = company_id;
+    staff->salary = (uint32_t)(staff->salary * STAFF_POACH_RAISE);
+    return true;
+}
+
+/* ========== BUILDINGS ========== */
+
+// Puts a building on the grid with its footprint corner at (grid_x, grid_z),
+// in the given slot, or in any free one when building_id is -1. The caller
+// has checked the footprint fits and charged for it.
+int32_t city_add_building(Game *game, int32_t city_index, int32_t building_id, BuildingType type, int grid_x, int grid_z,
+                          float rotation_angle, uint8_t owner_id)
+{
+    City *city = &game->data.cities[city_index];
+    if (city->current_building_count >= MAX_BUILDINGS_PER_CITY)
+        return -1;
+    if (building_id >= 0 && !city_claim_building_slot(city, (uint32_t)building_id))
+        return -1;
+    if (building_id < 0)
+        building_id = city_alloc_building_slot(city);
+
+    Vector3 center = city_grid_footprint_center(city, type, grid_x, grid_z, rotation_angle);
+    building_id = place_building_in_slot(city, building_id, center, game->data.building_templates[type], rotation_angle);
+    if (building_id < 0)
+        return -1;
+
+    Building *building = city_get_building_mut(city, building_id);
+    building->owner_id = owner_id;
+    building->grid_x = grid_x;
+    building->grid_z = grid_z;
+    city->flows[building_id].demand = demand_field_sample(city->demand, center);
+    city_grid_set_building(city, building, true);
+    synergy_field_add_building(city->synergy, building, 1.0f);
+    building_bvh_insert(city->bvh, building);
+    city->current_building_count++;
+    return building_id;
+}
+
+// Takes a building off the map. Anyone still working there is left without
+// a building but keeps their job.
+void city_remove_building(Game *game, int32_t city_index, int32_t building_id)
+{
+    City *city = &game->data.cities[city_index];
+    const Building *building = city_get_building(city, building_id);
+    if (!building || building->id == -1)
+        return;
+
+    // Unassigning writes the building, which may move its chunk, so look it up each time.
+    while ((building = city_get_building(city, building_id))->current_staff_count > 0)
+        unassign_staff(game, building->assigned_staff[building->current_staff_count - 1]);
+
+    sim_forget_building(game, city_index, building_id);
+    city_grid_set_building(city, building, false);
+    synergy_field_add_building(city->synergy, building, -1.0f);
+    building_bvh_remove(city->bvh, building_id);
+
+    Building *writable = city_get_building_mut(city, building_id);
+    if (writable)
+        writable->id = -1;
+    city->current_building_count--;
+
+    if (game->state.current_city == city_index)
+    {
+        if (game->state.selected_building_id == building_id)
+            game->state.selected_building_id = -1;
+        if (game->state.hovered_building_id == building_id)
+            game->state.hovered_building_id = -1;
+    }
+}
+
+// Moves a building's footprint to a new corner and rotation if it fits
+// there once the building's own cells are freed. Otherwise nothing changes.
+bool city_rotate_building(Game *game, int32_t city_index, int32_t building_id, int grid_x, int grid_z, float rotation_angle)
+{
+    City *city = &game->data.cities[city_index];
+    const Building *building = city_get_building(city, building_id);
+    if (!building || building->id == -1)
+        return false;
+
+    BuildingType type = building->template.type;
+    city_grid_set_building(city, building, false);
+    synergy_field_add_building(city->synergy, building, -1.0f);
+
+    bool fits = city_grid_can_place_at(city, type, grid_x, grid_z, rotation_angle);
+    Building *writable = fits ? city_get_building_mut(city, building_id) : NULL;
+    if (writable)
+    {
+        writable->rotation_angle = rotation_angle;
+        writable->grid_x = grid_x;
+        writable->grid_z = grid_z;
+        writable->position = city_grid_footprint_center(city, type, grid_x, grid_z, rotation_angle);
+        city->flows[building_id].demand = demand_field_sample(city->demand, writable->position);
+        city->flows[building_id].rates_revision = 0;
+        building_bvh_remove(city->bvh, building_id);
+        building_bvh_insert(city->bvh, writable);
+        building = writable;
+    }
+
+    city_grid_set_building(city, building, true);
+    synergy_field_add_building(city->synergy, building, 1.0f);
+    return writable != NULL;
+}
+
+/* ========== COMMANDS ========== */
+
+static uint8_t get_quarter_turns(float rotation_angle)
+{
+    return (uint8_t)(((int)lroundf(rotation_angle / 90.0f) % GRID_ROTATION_COUNT + GRID_ROTATION_COUNT) % GRID_ROTATION_COUNT);
+}
+
+// The player's edits go into the undo journal; the rivals' don't.
+static void record_edit(Game *game, uint8_t company_id, EditDelta delta)
+{
+    if (company_id == PLAYER_COMPANY_ID)
+        edit_journal_record(game, &delta);
+}
+
+static bool unlock_city_for_company(Game *game, uint8_t company_id, int32_t city_index)
+{
+    if (city_index < 0 || city_index >= MAX_CITIES)
+        return false;
+
+    City *city = &game->data.cities[city_index];
+    uint32_t bit = 1u << company_id;
+    if (city->company_mask & bit)
+        return true;
+
+    if (!spend(game, company_id, city->price_to_unlock))
+        return false;
+
+    city->company_mask |= bit;
+    if (company_id == PLAYER_COMPANY_ID)
+        city->is_unlocked = true;
+    start_city_generation(game, city_index); // no-op once the city exists
+    return true;
+}
+
+// Charges the company for a building with its footprint corner at
+// (grid_x, grid_z) and puts it there, if it fits and they can pay.
+static bool place_building_at_corner(Game *game, uint8_t company_id, int32_t city_index, BuildingType type, int grid_x,
+                                     int grid_z, float rotation_angle, bool joins_previous)
+{
+    City *city = &game->data.cities[city_index];
+    uint64_t cost = game->data.building_templates[type].base_cost;
+
+    if (!(city->company_mask & (1u << company_id)))
+        return false;
+    if (!city_grid_can_place_at(city, type, grid_x, grid_z, rotation_angle))
+        return false;
+    if (*get_company_funds(game, company_id) < cost)
+        return false;
+
+    int32_t building_id = city_add_building(game, city_index, -1, type, grid_x, grid_z, rotation_angle, company_id);
+    if (building_id < 0)
+        return false;
+
+    spend(game, company_id, cost);
+
+    EditDelta delta = {0};
+    delta.type = EDIT_PLACE;
+    delta.city_index = (uint8_t)city_index;
+    delta.building_type = (uint8_t)type;
+    delta.joins_previous = joins_previous;
+    delta.rotation = get_quarter_turns(rotation_angle);
+    delta.grid_x = (int16_t)grid_x;
+    delta.grid_z = (int16_t)grid_z;
+    delta.building_id = building_id;
+    delta.money = -(int64_t)cost;
+    record_edit(game, company_id, delta);
+    return true;
+}
+
+// The command's position is the cell the footprint is centered on; the
+// building itself ends up at the middle of its footprint.
+static bool place_building_for_company(Game *game, const Command *command)
+{
+    if (command->city_index < 0 || command->city_index >= MAX_CITIES)
+        return false;
+
+    int grid_x, grid_z;
+    if (!city_grid_find_corner(&game->data.cities[command->city_index], command->building_type, command->position,
+                               command->rotation_angle, &grid_x, &grid_z))
+        return false;
+
+    return place_building_at_corner(game, command->company_id, command->city_index, command->building_type, grid_x, grid_z,
+                                    command->rotation_angle, false);
+}
+
+/* ========== BULK PLACEMENT ========== */
+
+// Lays a drag from one anchor cell to another out as a row along its longer
+// axis, or with is_rect as the whole rectangle, stepping by the footprint so
+// the buildings pack edge to edge. Then checks every entry against the grid
+// and against what the company can still pay for after the ones before it.
+// A few shifts and ANDs per entry, so it can run every frame of the drag.
+void plan_placement_batch(Game *game, PlacementBatch *batch, uint8_t company_id, int32_t city_index, BuildingType type,
+                          Vector3 from, Vector3 to, float rotation_angle, bool is_rect)
+{
+    const City *city = &game->data.cities[city_index];
+    const Footprint *footprint = get_footprint(type, rotation_angle);
+
+    batch->city_index = city_index;
+    batch->building_type = type;
+    batch->rotation_angle = rotation_angle;
+    batch->count = 0;
+    batch->valid_count = 0;
+    batch->total_cost = 0;
+
+    int from_x, from_z, to_x, to_z;
+    if (!get_grid_cell_from_position(city->size, from, &from_x, &from_z))
+        return;
+    if (!get_grid_cell_from_position(city->size, to, &to_x, &to_z))
+    {
+        to_x = from_x;
+        to_z = from_z;
+    }
+
+    if (!is_rect)
+    {
+        if (abs(to_x - from_x) >= abs(to_z - from_z))
+            to_z = from_z;
+        else
+            to_x = from_x;
+    }
+
+    int step_x = (to_x >= from_x) ? footprint->width : -footprint->width;
+    int step_z = (to_z >= from_z) ? footprint->height : -footprint->height;
+    int columns = abs(to_x - from_x) / footprint->width + 1;
+    int rows = abs(to_z - from_z) / footprint->height + 1;
+
+    for (int row = 0; row < rows && batch->count < MAX_PLACEMENT_BATCH; row++)
+    {
+        for (int column = 0; column < columns && batch->count < MAX_PLACEMENT_BATCH; column++)
+        {
+            batch->grid_x[batch->count] = (int16_t)(from_x + footprint->offset_x + column * step_x);
+            batch->grid_z[batch->count] = (int16_t)(from_z + footprint->offset_z + row * step_z);
+            batch->count++;
+        }
+    }
+
+    uint64_t funds = *get_company_funds(game, company_id);
+    uint64_t cost = game->data.building_templates[type].base_cost;
+    for (uint32_t i = 0; i < batch->count; i++)
+    {
+        batch->is_valid[i] = batch->total_cost + cost <= funds &&
+                             city_grid_can_place_at(city, type, batch->grid_x[i], batch->grid_z[i], rotation_angle);
+        if (batch->is_valid[i])
+        {
+            batch->valid_count++;
+            batch->total_cost += cost;
+        }
+    }
+}
+
+// Places every valid entry of a planned batch as one edit. Each entry is
+// checked again, so a batch planned a frame ago can't overlap what was built
+// since; the ones that no longer fit are skipped.
+static bool place_batch_for_company(Game *game, const Command *command)
+{
+    const PlacementBatch *batch = command->batch;
+    if (!batch || batch->city_index < 0 || batch->city_index >= MAX_CITIES)
+        return false;
+
+    uint32_t placed = 0;
+    for (uint32_t i = 0; i < batch->count; i++)
+    {
+        if (batch->is_valid[i] &&
+            place_building_at_corner(game, command->company_id, batch->city_index, batch->building_type, batch->grid_x[i],
+                                     batch->grid_z[i], batch->rotation_angle, placed > 0))
+            placed++;
+    }
+    return placed > 0;
+}
+
+/* ========== EDITS ========== */
+
+static const Building *get_owned_building(Game *game, const Command *command)
+{
+    if (command->city_index < 0 || command->city_index >= MAX_CITIES)
+        return NULL;
+
+    const Building *building = city_get_building(&game->data.cities[command->city_index], command->building_id);
+    if (!building || building->id == -1 || building->owner_id != command->company_id)
+        return NULL;
+    return building;
+}
+
+// Turns a building to command->rotation_angle in place.
+static bool rotate_building_for_company(Game *game, const Command *command)
+{
+    const Building *building = get_owned_building(game, command);
+    if (!building)
+        return false;
+
+    // Keep the cell the footprint turns around where it is.
+    const Footprint *from = get_footprint(building->template.type, building->rotation_angle);
+    const Footprint *to = get_footprint(building->template.type, command->rotation_angle);
+    int grid_x = building->grid_x - from->offset_x + to->offset_x;
+    int grid_z = building->grid_z - from->offset_z + to->offset_z;
+
+    EditDelta delta = {0};
+    delta.type = EDIT_ROTATE;
+    delta.city_index = (uint8_t)command->city_index;
+    delta.building_type = (uint8_t)building->template.type;
+    delta.rotation = get_quarter_turns(building->rotation_angle);
+    delta.new_rotation = get_quarter_turns(command->rotation_angle);
+    delta.grid_x = (int16_t)building->grid_x;
+    delta.grid_z = (int16_t)building->grid_z;
+    delta.new_grid_x = (int16_t)grid_x;
+    delta.new_grid_z = (int16_t)grid_z;
+    delta.building_id = command->building_id;
+
+    if (!city_rotate_building(game, command->city_index, command->building_id, grid_x, grid_z, command->rotation_angle))
+        return false;
+
+    record_edit(game, command->company_id, delta);
+    return true;
+}
+
+// Knocks a building down for part of its cost back. Its staff are taken off
+// it first, as edits of their own, so undo can put them back.
+static bool demolish_building_for_company(Game *game, const Command *command)
+{
+    const Building *building = get_owned_building(game, command);
+    if (!building)
+        return false;
+
+    const City *city = &game->data.cities[command->city_index];
+    bool joins_previous = false;
+    while (building->current_staff_count > 0)
+    {
+        int32_t staff_id = (int32_t)building->assigned_staff[building->current_staff_count - 1]->id;
+        EditDelta unassign = {0};
+        unassign.type = EDIT_ASSIGN_STAFF;
+        unassign.joins_previous = joins_previous;
+        unassign.staff_id = staff_id;
+        unassign.staff_city = unassign.new_staff_city = (uint8_t)command->city_index;
+        unassign.building_id = command->building_id;
+        unassign.new_building_id = -1;
+
+        assign_staff(game, staff_id, command->city_index, -1);
+        record_edit(game, command->company_id, unassign);
+        joins_previous = true;
+        building = city_get_building(city, command->building_id); // unassigning may have copied its chunk
+    }
+
+    uint64_t refund = (uint64_t)(building->template.base_cost * DEMOLISH_REFUND);
+    EditDelta delta = {0};
+    delta.type = EDIT_DEMOLISH;
+    delta.city_index = (uint8_t)command->city_index;
+    delta.building_type = (uint8_t)building->template.type;
+    delta.joins_previous = joins_previous;
+    delta.rotation = get_quarter_turns(building->rotation_angle);
+    delta.grid_x = (int16_t)building->grid_x;
+    delta.grid_z = (int16_t)building->grid_z;
+    delta.building_id = command->building_id;
+    delta.money = (int64_t)refund;
+
+    city_remove_building(game, command->city_index, command->building_id);
+    *get_company_funds(game, command->company_id) += refund;
+    record_edit(game, command->company_id, delta);
+    return true;
+}
+
+static bool assign_staff_for_company(Game *game, const Command *command)
+{
+    if (command->staff_id < 0 || command->staff_id >= MAX_STAFF_OWNED ||
+        game->data.staff_owned[command->staff_id].employer_id != command->company_id)
+        return false;
+
+    const Staff *staff = &game->data.staff_owned[command->staff_id];
+    EditDelta delta = {0};
+    delta.type = EDIT_ASSIGN_STAFF;
+    delta.staff_id = command->staff_id;
+    delta.staff_city = (uint8_t)staff->home_city_id;
+    delta.building_id = staff->assigned_building_id;
+    delta.new_staff_city = (uint8_t)((command->building_id >= 0) ? command->city_index : staff->home_city_id);
+    delta.new_building_id = command->building_id;
+
+    if (!assign_staff(game, command->staff_id, command->city_index, command->building_id))
+        return false;
+
+    record_edit(game, command->company_id, delta);
+    return true;
+}
+
+bool execute_command(Game *game, const Command *command)
+{
+    if (command->company_id >= MAX_COMPANIES)
+        return false;
+
+    switch (command->type)
+    {
+    case CMD_UNLOCK_CITY:
+        return unlock_city_for_company(game, command->company_id, command->city_index);
+    case CMD_PLACE_BUILDING:
+        return place_building_for_company(game, command);
+    case CMD_HIRE_STAFF:
+    {
+        int32_t staff_id = hire_staff(game, command->company_id, command->role);
+        if (staff_id < 0)
+            return false;
+        if (command->building_id >= 0)
+        {
+            // The assignment goes in the journal; the hire itself can't be undone.
+            Command assign = *command;
+            assign.staff_id = staff_id;
+            assign_staff_for_company(game, &assign);
+        }
+        return true;
+    }
+    case CMD_ASSIGN_STAFF:
+        return assign_staff_for_company(game, command);
+    case CMD_POACH_STAFF:
+        return poach_staff(game, command->company_id, command->staff_id);
+    case CMD_ROTATE_BUILDING:
+        return rotate_building_for_company(game, command);
+    case CMD_DEMOLISH_BUILDING:
+        return demolish_building_for_company(game, command);
+    case CMD_PLACE_BUILDINGS:
+        return place_batch_for_company(game, command);
+    default:
+        return false;
+    }
+}
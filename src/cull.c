@@ -0,0 +1,185 @@
+#include "game.h"
+#include "rlgl.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* ========== FRUSTUM ========== */
+
+// The six planes of the clip volume pulled out of the view-projection
+// matrix (Gribb & Hartmann). For the orthographic city camera they come in
+// parallel pairs, so testing a box against them is a slab test of its
+// projected bounds against the screen and the depth range; for a
+// perspective camera the same planes make the usual frustum.
+Frustum make_frustum(Matrix view_projection)
+{
+    const Matrix m = view_projection;
+    const float rows[4][4] = {{m.m0, m.m4, m.m8, m.m12}, {m.m1, m.m5, m.m9, m.m13}, {m.m2, m.m6, m.m10, m.m14}, {m.m3, m.m7, m.m11, m.m15}};
+
+    Frustum frustum = {0};
+    for (int plane = 0; plane < FRUSTUM_PLANE_COUNT; plane++)
+    {
+        // left, right, bottom, top, near, far
+        const float *row = rows[plane / 2];
+        float sign = (plane % 2) ? -1.0f : 1.0f;
+        float x = rows[3][0] + sign * row[0];
+        float y = rows[3][1] + sign * row[1];
+        float z = rows[3][2] + sign * row[2];
+        float w = rows[3][3] + sign * row[3];
+
+        float length = sqrtf(x * x + y * y + z * z);
+        length = (length > 0.0f) ? length : 1.0f;
+        frustum.normal_x[plane] = x / length;
+        frustum.normal_y[plane] = y / length;
+        frustum.normal_z[plane] = z / length;
+        frustum.distance[plane] = w / length;
+    }
+    return frustum;
+}
+
+// Frustum of whatever BeginMode3D set up.
+Frustum get_view_frustum(void)
+{
+    return make_frustum(MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection()));
+}
+
+// True unless the box lies wholly behind one of the planes. Boxes near a
+// corner of the frustum may pass without being seen; that only costs a draw.
+bool frustum_test_box(const Frustum *frustum, BoundingBox box)
+{
+    Vector3 center = Vector3Scale(Vector3Add(box.min, box.max), 0.5f);
+    Vector3 extent = Vector3Scale(Vector3Subtract(box.max, box.min), 0.5f);
+
+    for (int plane = 0; plane < FRUSTUM_PLANE_COUNT; plane++)
+    {
+        float distance = center.x * frustum->normal_x[plane] + center.y * frustum->normal_y[plane] +
+                         center.z * frustum->normal_z[plane] + frustum->distance[plane];
+        float radius = extent.x * fabsf(frustum->normal_x[plane]) + extent.y * fabsf(frustum->normal_y[plane]) +
+                       extent.z * fabsf(frustum->normal_z[plane]);
+        if (distance + radius < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+/* ========== PACKETS ========== */
+
+// Tests the four boxes of a BVH packet at once. Returns a bit per box that
+// may be visible, and sets the bits in *inside of boxes that are wholly
+// inside, whose contents need no more tests.
+int frustum_test_packet(const Frustum *frustum, const BvhPacket *packet, int *inside)
+{
+#if defined(__SSE2__)
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 sign_bit = _mm_set1_ps(-0.0f);
+    __m128 min_x = _mm_loadu_ps(packet->min_x), max_x = _mm_loadu_ps(packet->max_x);
+    __m128 min_y = _mm_loadu_ps(packet->min_y), max_y = _mm_loadu_ps(packet->max_y);
+    __m128 min_z = _mm_loadu_ps(packet->min_z), max_z = _mm_loadu_ps(packet->max_z);
+    __m128 center_x = _mm_mul_ps(_mm_add_ps(min_x, max_x), half), extent_x = _mm_mul_ps(_mm_sub_ps(max_x, min_x), half);
+    __m128 center_y = _mm_mul_ps(_mm_add_ps(min_y, max_y), half), extent_y = _mm_mul_ps(_mm_sub_ps(max_y, min_y), half);
+    __m128 center_z = _mm_mul_ps(_mm_add_ps(min_z, max_z), half), extent_z = _mm_mul_ps(_mm_sub_ps(max_z, min_z), half);
+    __m128 outside = _mm_setzero_ps(), crossing = _mm_setzero_ps();
+
+    for (int plane = 0; plane < FRUSTUM_PLANE_COUNT; plane++)
+    {
+        __m128 normal_x = _mm_set1_ps(frustum->normal_x[plane]);
+        __m128 normal_y = _mm_set1_ps(frustum->normal_y[plane]);
+        __m128 normal_z = _mm_set1_ps(frustum->normal_z[plane]);
+
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(center_x, normal_x), _mm_mul_ps(center_y, normal_y)),
+                                     _mm_add_ps(_mm_mul_ps(center_z, normal_z), _mm_set1_ps(frustum->distance[plane])));
+        __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(extent_x, _mm_andnot_ps(sign_bit, normal_x)),
+                                              _mm_mul_ps(extent_y, _mm_andnot_ps(sign_bit, normal_y))),
+                                   _mm_mul_ps(extent_z, _mm_andnot_ps(sign_bit, normal_z)));
+
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+        crossing = _mm_or_ps(crossing, _mm_cmplt_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps()));
+    }
+
+    // Empty slots have min > max and must not pass.
+    int used = _mm_movemask_ps(_mm_cmple_ps(min_x, max_x));
+    int visible = used & ~_mm_movemask_ps(outside);
+    *inside = visible & ~_mm_movemask_ps(crossing);
+    return visible;
+#else
+    int visible = 0;
+    *inside = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (packet->min_x[i] > packet->max_x[i])
+            continue;
+
+        Vector3 center = {(packet->min_x[i] + packet->max_x[i]) * 0.5f, (packet->min_y[i] + packet->max_y[i]) * 0.5f,
+                          (packet->min_z[i] + packet->max_z[i]) * 0.5f};
+        Vector3 extent = {(packet->max_x[i] - packet->min_x[i]) * 0.5f, (packet->max_y[i] - packet->min_y[i]) * 0.5f,
+                          (packet->max_z[i] - packet->min_z[i]) * 0.5f};
+        bool is_outside = false, is_crossing = false;
+        for (int plane = 0; plane < FRUSTUM_PLANE_COUNT; plane++)
+        {
+            float distance = center.x * frustum->normal_x[plane] + center.y * frustum->normal_y[plane] +
+                             center.z * frustum->normal_z[plane] + frustum->distance[plane];
+            float radius = extent.x * fabsf(frustum->normal_x[plane]) + extent.y * fabsf(frustum->normal_y[plane]) +
+                           extent.z * fabsf(frustum->normal_z[plane]);
+            is_outside |= distance + radius < 0.0f;
+            is_crossing |= distance - radius < 0.0f;
+        }
+
+        if (!is_outside)
+            visible |= 1 << i;
+        if (!is_outside && !is_crossing)
+            *inside |= 1 << i;
+    }
+    return visible;
+#endif
+}
+
+/* ========== BUILDINGS ========== */
+
+// A node or leaf still to visit (level -1 for leaves), and whether its box
+// is known to be wholly inside.
+typedef struct
+{
+    int32_t level;
+    int32_t index;
+    bool is_inside;
+} CullStackEntry;
+
+// Sorts the grid chunks into hidden, crossing the edge of the view and
+// wholly inside, walking the BVH down to its leaves; the buildings
+// themselves aren't tested. Needs the city's BVH. Returns how many chunks
+// may be on screen.
+uint32_t cull_city_chunks(const City *city, const Frustum *frustum, uint8_t visibility[MAX_GRID_CHUNKS])
+{
+    const BuildingBvh *bvh = city->bvh;
+    if (!bvh)
+        return 0;
+
+    CullStackEntry stack[BVH_MAX_LEVELS * 3 + 4];
+    uint32_t count = 0;
+    int depth = 0;
+    stack[depth++] = (CullStackEntry){(int32_t)bvh->level_count - 1, 0, false};
+
+    while (depth > 0)
+    {
+        CullStackEntry entry = stack[--depth];
+        if (entry.level < 0)
+        {
+            visibility[entry.index] = entry.is_inside ? CHUNK_INSIDE : CHUNK_CROSSING;
+            count++;
+            continue;
+        }
+
+        const BvhPacket *node = &bvh->levels[entry.level][entry.index];
+        int inside;
+        int visible = entry.is_inside ? 0 : frustum_test_packet(frustum, node, &inside);
+        for (int i = 0; i < 4; i++)
+        {
+            // Inside a box that is inside, so are all of its children.
+            if (node->items[i] < 0 || !(entry.is_inside || (visible & (1 << i))))
+                continue;
+            stack[depth++] = (CullStackEntry){entry.level - 1, node->items[i], entry.is_inside || (inside & (1 << i))};
+        }
+    }
+    return count;
+}
@@ -0,0 +1,445 @@
+#include "game.h"
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define DEMAND_ALPHA (DEMAND_DIFFUSION * DEMAND_DT) // share exchanged with each neighbor per step
+#define DEMAND_BASE_RETAIN (1.0f - 4.0f * DEMAND_ALPHA - DEMAND_DT * DEMAND_DECAY)
+
+/* ========== SETUP ========== */
+
+// Scatters a few neighborhoods over the map and scales them so the average
+// cell has a population of 1.
+static void generate_population(float *population, uint32_t size, uint64_t seed)
+{
+    uint64_t rng = seed;
+    uint32_t hub_count = size / 16 + 1;
+    float hub_x[MAP_SIZE_LARGE / 16 + 1], hub_z[MAP_SIZE_LARGE / 16 + 1];
+    float hub_radius[MAP_SIZE_LARGE / 16 + 1], hub_weight[MAP_SIZE_LARGE / 16 + 1];
+
+    for (uint32_t h = 0; h < hub_count; h++)
+    {
+        hub_x[h] = sim_random_float(&rng) * size;
+        hub_z[h] = sim_random_float(&rng) * size;
+        hub_radius[h] = 4.0f + sim_random_float(&rng) * 8.0f;
+        hub_weight[h] = 0.5f + sim_random_float(&rng);
+    }
+
+    double total = 0.0;
+    for (uint32_t z = 0; z < size; z++)
+    {
+        for (uint32_t x = 0; x < size; x++)
+        {
+            float value = 0.2f; // everyone eats somewhere
+            for (uint32_t h = 0; h < hub_count; h++)
+            {
+                float dx = x - hub_x[h], dz = z - hub_z[h];
+                value += hub_weight[h] * expf(-(dx * dx + dz * dz) / (2.0f * hub_radius[h] * hub_radius[h]));
+            }
+            population[z * size + x] = value;
+            total += value;
+        }
+    }
+
+    float scale = (float)(size * size / total);
+    for (uint32_t i = 0; i < size * size; i++)
+        population[i] *= scale;
+}
+
+DemandField *demand_field_create(MemoryArena *arena, uint32_t size, uint64_t seed)
+{
+    DemandField *field = (DemandField *)arena_alloc(arena, sizeof(DemandField));
+    if (!field)
+        return NULL;
+
+    uint32_t stride = size + 2;
+    uint64_t cells = (uint64_t)stride * stride;
+    field->size = size;
+    field->stride = stride;
+    field->tiles_per_side = (size + DEMAND_TILE_SIZE - 1) / DEMAND_TILE_SIZE;
+    field->front = (float *)arena_alloc(arena, cells * sizeof(float));
+    field->back = (float *)arena_alloc(arena, cells * sizeof(float));
+    field->retain = (float *)arena_alloc(arena, cells * sizeof(float));
+    field->inject = (float *)arena_alloc(arena, cells * sizeof(float));
+    field->tile_state = (uint8_t *)arena_alloc(arena, field->tiles_per_side * field->tiles_per_side);
+    float *population = (float *)malloc(sizeof(float) * size * size);
+
+    if (!field->front || !field->back || !field->retain || !field->inject || !field->tile_state || !population)
+    {
+        free(population);
+        return NULL;
+    }
+
+    generate_population(population, size, seed);
+
+    // Without restaurants the field settles where decay balances population,
+    // so start it there instead of at zero.
+    for (uint32_t z = 0; z < size; z++)
+    {
+        for (uint32_t x = 0; x < size; x++)
+        {
+            uint32_t cell = (z + 1) * stride + (x + 1);
+            float people = population[z * size + x];
+            field->retain[cell] = DEMAND_BASE_RETAIN;
+            field->inject[cell] = DEMAND_DT * DEMAND_DECAY * people;
+            field->front[cell] = people;
+            field->back[cell] = people;
+        }
+    }
+    free(population);
+
+    memset(field->tile_state, DEMAND_TILE_ACTIVE, field->tiles_per_side * field->tiles_per_side);
+    field->active_tiles = field->tiles_per_side * field->tiles_per_side;
+    return field;
+}
+
+// Share of a cell's demand a restaurant on it eats per step. Its draw is
+// spread evenly over its footprint.
+static float get_building_draw(const Building *building)
+{
+    const Footprint *footprint = get_footprint(building->template.type, building->rotation_angle);
+    return DEMAND_DT * DEMAND_CAPTURE * building->template.customer_rate / footprint->cell_count;
+}
+
+/* ========== STEP ========== */
+
+// out = retain * c + alpha * (up + down + left + right) + inject, over one
+// row segment. Returns the largest change in the segment.
+static float stencil_row(const float *center, const float *up, const float *down, const float *retain,
+                         const float *inject, float *out, uint32_t count)
+{
+    uint32_t x = 0;
+    float max_change = 0.0f;
+
+#if defined(__SSE2__)
+    const __m128 alpha = _mm_set1_ps(DEMAND_ALPHA);
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    __m128 max_vec = _mm_setzero_ps();
+
+    for (; x + 4 <= count; x += 4)
+    {
+        __m128 c = _mm_loadu_ps(center + x);
+        __m128 neighbors = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(up + x), _mm_loadu_ps(down + x)),
+                                      _mm_add_ps(_mm_loadu_ps(center + x - 1), _mm_loadu_ps(center + x + 1)));
+        __m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(retain + x)), _mm_mul_ps(neighbors, alpha)),
+                                  _mm_loadu_ps(inject + x));
+        _mm_storeu_ps(out + x, value);
+        max_vec = _mm_max_ps(max_vec, _mm_andnot_ps(sign_mask, _mm_sub_ps(value, c)));
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, max_vec);
+    max_change = fmaxf(fmaxf(lanes[0], lanes[1]), fmaxf(lanes[2], lanes[3]));
+#endif
+
+    for (; x < count; x++)
+    {
+        float value = center[x] * retain[x] + DEMAND_ALPHA * (up[x] + down[x] + center[x - 1] + center[x + 1]) + inject[x];
+        max_change = fmaxf(max_change, fabsf(value - center[x]));
+        out[x] = value;
+    }
+    return max_change;
+}
+
+// Advances the field by DEMAND_DT. Only awake tiles are recomputed; a tile
+// falls asleep once it stops changing and wakes when a neighbor or one of its
+// own restaurants changes.
+void demand_field_step(DemandField *field)
+{
+    const uint32_t size = field->size;
+    const uint32_t stride = field->stride;
+    const uint32_t tiles = field->tiles_per_side;
+    float *front = field->front;
+    float *back = field->back;
+    bool changed[DEMAND_MAX_TILES] = {0};
+
+    // Zero-flux edges: mirror the outermost cells into the border.
+    for (uint32_t i = 1; i <= size; i++)
+    {
+        front[i] = front[stride + i];
+        front[(size + 1) * stride + i] = front[size * stride + i];
+        front[i * stride] = front[i * stride + 1];
+        front[i * stride + size + 1] = front[i * stride + size];
+    }
+
+    field->active_tiles = 0;
+    for (uint32_t ty = 0; ty < tiles; ty++)
+    {
+        for (uint32_t tx = 0; tx < tiles; tx++)
+        {
+            uint8_t *state = &field->tile_state[ty * tiles + tx];
+            if (*state == DEMAND_TILE_ASLEEP)
+                continue;
+
+            uint32_t x0 = 1 + tx * DEMAND_TILE_SIZE;
+            uint32_t y0 = 1 + ty * DEMAND_TILE_SIZE;
+            uint32_t width = (size + 1 - x0 < DEMAND_TILE_SIZE) ? size + 1 - x0 : DEMAND_TILE_SIZE;
+            uint32_t height = (size + 1 - y0 < DEMAND_TILE_SIZE) ? size + 1 - y0 : DEMAND_TILE_SIZE;
+
+            if (*state == DEMAND_TILE_SETTLING)
+            {
+                // The back buffer still holds the step before last.
+                for (uint32_t y = y0; y < y0 + height; y++)
+                    memcpy(back + y * stride + x0, front + y * stride + x0, width * sizeof(float));
+                *state = DEMAND_TILE_ASLEEP;
+                continue;
+            }
+
+            float max_change = 0.0f;
+            for (uint32_t y = y0; y < y0 + height; y++)
+            {
+                uint32_t row = y * stride + x0;
+                max_change = fmaxf(max_change, stencil_row(front + row, front + row - stride, front + row + stride,
+                                                           field->retain + row, field->inject + row, back + row, width));
+            }
+            changed[ty * tiles + tx] = max_change > DEMAND_SLEEP_EPSILON;
+            field->active_tiles++;
+        }
+    }
+
+    for (uint32_t ty = 0; ty < tiles; ty++)
+    {
+        for (uint32_t tx = 0; tx < tiles; tx++)
+        {
+            uint32_t t = ty * tiles + tx;
+            bool wake = changed[t] ||
+                        (tx > 0 && changed[t - 1]) || (tx + 1 < tiles && changed[t + 1]) ||
+                        (ty > 0 && changed[t - tiles]) || (ty + 1 < tiles && changed[t + tiles]);
+
+            if (wake)
+                field->tile_state[t] = DEMAND_TILE_ACTIVE;
+            else if (field->tile_state[t] == DEMAND_TILE_ACTIVE)
+                field->tile_state[t] = DEMAND_TILE_SETTLING;
+        }
+    }
+
+    field->front = back;
+    field->back = front;
+}
+
+/* ========== QUERIES ========== */
+
+// Demand at the cell under position, 1 being the city average.
+float demand_field_sample(const DemandField *field, Vector3 position)
+{
+    int x, z;
+    if (!field)
+        return 1.0f;
+    if (!get_grid_cell_from_position(field->size, position, &x, &z))
+        return 0.0f;
+
+    return field->front[(z + 1) * field->stride + (x + 1)];
+}
+
+/* ========== PREVIEW WINDOWS ========== */
+
+// Copies the cells within radius of the cell under center, and a border
+// around them, out of the field. Runs on the main thread, which owns the field.
+bool demand_window_copy(DemandWindow *window, const DemandField *field, Vector3 center, int radius)
+{
+    int x, z;
+    *window = (DemandWindow){0};
+    if (!field || !get_grid_cell_from_position(field->size, center, &x, &z))
+        return false;
+
+    int x0 = (x - radius < 0) ? 0 : x - radius;
+    int z0 = (z - radius < 0) ? 0 : z - radius;
+    int x1 = (x + radius >= (int)field->size) ? (int)field->size - 1 : x + radius;
+    int z1 = (z + radius >= (int)field->size) ? (int)field->size - 1 : z + radius;
+    uint32_t stride = (uint32_t)(x1 - x0 + 3);
+    uint32_t rows = (uint32_t)(z1 - z0 + 3);
+    float *cells = (float *)malloc(sizeof(float) * 4 * stride * rows);
+    if (!cells)
+        return false;
+
+    window->field_size = field->size;
+    window->x0 = x0;
+    window->z0 = z0;
+    window->width = stride - 2;
+    window->height = rows - 2;
+    window->stride = stride;
+    window->cells = cells;
+    window->front = cells;
+    window->back = cells + stride * rows;
+    window->retain = cells + 2 * stride * rows;
+    window->inject = cells + 3 * stride * rows;
+
+    // Window row r is field row z0 + r with the borders of both included.
+    for (uint32_t r = 0; r < rows; r++)
+    {
+        uint32_t from = (uint32_t)(z0 + r) * field->stride + (uint32_t)x0;
+        memcpy(window->front + r * stride, field->front + from, sizeof(float) * stride);
+        memcpy(window->back + r * stride, field->front + from, sizeof(float) * stride);
+        memcpy(window->retain + r * stride, field->retain + from, sizeof(float) * stride);
+        memcpy(window->inject + r * stride, field->inject + from, sizeof(float) * stride);
+    }
+    return true;
+}
+
+// Adds a restaurant's draw to the cells of its footprint inside the window.
+void demand_window_add_building(DemandWindow *window, const Building *building)
+{
+    if (!window->front)
+        return;
+
+    const Footprint *footprint = get_footprint(building->template.type, building->rotation_angle);
+    for (int row = 0; row < footprint->height; row++)
+    {
+        for (int column = 0; column < footprint->width; column++)
+        {
+            int x = building->grid_x + column - window->x0;
+            int z = building->grid_z + row - window->z0;
+            if (!((footprint->rows[row] >> column) & 1u) || x < 0 || z < 0 || x >= (int)window->width ||
+                z >= (int)window->height)
+                continue;
+
+            window->retain[(z + 1) * window->stride + (x + 1)] -= get_building_draw(building);
+        }
+    }
+}
+
+// Steps the window the way demand_field_step() steps the field, until it
+// stops changing or max_steps have gone by. Safe on a worker.
+void demand_window_settle(DemandWindow *window, uint32_t max_steps)
+{
+    const uint32_t stride = window->stride;
+    if (!window->front)
+        return;
+
+    for (uint32_t step = 0; step < max_steps; step++)
+    {
+        float max_change = 0.0f;
+        for (uint32_t y = 1; y <= window->height; y++)
+        {
+            uint32_t row = y * stride + 1;
+            max_change = fmaxf(max_change, stencil_row(window->front + row, window->front + row - stride,
+                                                       window->front + row + stride, window->retain + row,
+                                                       window->inject + row, window->back + row, window->width));
+        }
+
+        float *front = window->front;
+        window->front = window->back;
+        window->back = front;
+        if (max_change < DEMAND_SLEEP_EPSILON)
+            break;
+    }
+}
+
+// Demand at the cell under position, or fallback outside the window.
+float demand_window_sample(const DemandWindow *window, Vector3 position, float fallback)
+{
+    int x, z;
+    if (!window->front || !get_grid_cell_from_position(window->field_size, position, &x, &z))
+        return fallback;
+
+    x -= window->x0;
+    z -= window->z0;
+    if (x < 0 || z < 0 || x >= (int)window->width || z >= (int)window->height)
+        return fallback;
+    return window->front[(z + 1) * window->stride + (x + 1)];
+}
+
+void demand_window_free(DemandWindow *window)
+{
+    free(window->cells);
+    *window = (DemandWindow){0};
+}
+
+/* ========== UPDATE ========== */
+
+// Recomputes the restaurant sinks of every grid chunk that changed since the
+// last call and wakes the tiles under it.
+void demand_field_rebuild_sinks(DemandField *field, City *city)
+{
+    const uint32_t chunks = city->grid.chunks_per_side;
+    if (field->size != city->grid.size)
+        return;
+
+    for (uint32_t c = 0; c < chunks * chunks; c++)
+    {
+        if (!city_grid_take_dirty(city, c, GRID_DIRTY_DEMAND))
+            continue;
+
+        const GridChunk *chunk = city_grid_get_chunk(city, c);
+        uint32_t x0 = (c % chunks) * GRID_CHUNK_SIZE;
+        uint32_t z0 = (c / chunks) * GRID_CHUNK_SIZE;
+
+        for (uint32_t z = 0; z < GRID_CHUNK_SIZE; z++)
+        {
+            for (uint32_t x = 0; x < GRID_CHUNK_SIZE; x++)
+            {
+                const GridCell *cell = &chunk->cells[z * GRID_CHUNK_SIZE + x];
+                float retain = DEMAND_BASE_RETAIN;
+
+                const Building *building = (cell->type == GRID_CELL_BUILDING) ? city_get_building(city, cell->building_id) : NULL;
+                if (building && building->id != -1)
+                    retain -= get_building_draw(building);
+                field->retain[(z0 + z + 1) * field->stride + (x0 + x + 1)] = retain;
+            }
+        }
+
+        for (uint32_t tz = z0 / DEMAND_TILE_SIZE; tz < (z0 + GRID_CHUNK_SIZE) / DEMAND_TILE_SIZE; tz++)
+            for (uint32_t tx = x0 / DEMAND_TILE_SIZE; tx < (x0 + GRID_CHUNK_SIZE) / DEMAND_TILE_SIZE; tx++)
+                field->tile_state[tz * field->tiles_per_side + tx] = DEMAND_TILE_ACTIVE;
+    }
+}
+
+// Tells the floor to recolor wherever the field moved, while it is showing demand.
+static void mark_changed_floor(DemandField *field, City *city)
+{
+    for (uint32_t tz = 0; tz < field->tiles_per_side; tz++)
+    {
+        for (uint32_t tx = 0; tx < field->tiles_per_side; tx++)
+        {
+            if (field->tile_state[tz * field->tiles_per_side + tx] != DEMAND_TILE_ASLEEP)
+                city_grid_mark_dirty(city, tx * DEMAND_TILE_SIZE, tz * DEMAND_TILE_SIZE, GRID_DIRTY_OVERLAY);
+        }
+    }
+}
+
+// Pushes the new field values into the buildings that sit on them. Only
+// buildings whose demand moved noticeably get their rates redone, so the
+// field's last small ripples don't keep every building refreshing.
+static void sync_building_demand(City *city)
+{
+    for (uint32_t i = 0; i < city_building_slots(city); i++)
+    {
+        const Building *building = city_get_building(city, i);
+        if (building->id == -1)
+            continue;
+
+        BuildingFlow *flow = &city->flows[i];
+        float demand = demand_field_sample(city->demand, building->position);
+        if (fabsf(demand - flow->demand) < DEMAND_BUILDING_EPSILON)
+            continue;
+
+        flow->demand = demand;
+        flow->rates_revision = 0;
+    }
+}
+
+// Steps every city's field at DEMAND_UPDATE_RATE, independent of the sim tick.
+void update_demand(Game *game, float dt)
+{
+    Simulation *sim = &game->data.sim;
+    sim->demand_accumulator = fminf(sim->demand_accumulator + dt, 2.0f * DEMAND_DT);
+    if (sim->demand_accumulator < DEMAND_DT)
+        return;
+
+    sim->demand_accumulator -= DEMAND_DT;
+    for (int i = 0; i < MAX_CITIES; i++)
+    {
+        City *city = &game->data.cities[i];
+        if (city->company_mask == 0 || !city->demand)
+            continue;
+
+        demand_field_rebuild_sinks(city->demand, city);
+        demand_field_step(city->demand);
+        sync_building_demand(city);
+
+        if (game->state.is_demand_map_visible && game->state.current_scene == CITY_SCENE && i == (int)game->state.current_city)
+            mark_changed_floor(city->demand, city);
+    }
+}
@@ -0,0 +1,206 @@
+#include "game.h"
+
+/* ========== JOURNAL ========== */
+
+static EditDelta *journal_entry(EditJournal *journal, uint32_t index)
+{
+    return &journal->entries[(journal->head + index) % EDIT_JOURNAL_CAPACITY];
+}
+
+// Placements and demolitions put a building back in its old slot when they
+// are undone or redone, so while one is in the journal the slot is held:
+// city_alloc_building_slot() won't hand it to anyone else once it is free.
+static void hold_building_slot(Game *game, const EditDelta *delta, int change)
+{
+    if (delta->type != EDIT_PLACE && delta->type != EDIT_DEMOLISH)
+        return;
+
+    Building *building = city_get_building_mut(&game->data.cities[delta->city_index], (uint32_t)delta->building_id);
+    if (building)
+        building->edit_holds = (uint16_t)(building->edit_holds + change);
+}
+
+void edit_journal_clear(Game *game)
+{
+    EditJournal *journal = &game->state.edit_journal;
+    for (uint32_t i = 0; i < journal->count; i++)
+        hold_building_slot(game, journal_entry(journal, i), -1);
+
+    journal->head = 0;
+    journal->count = 0;
+    journal->undo_count = 0;
+}
+
+// Appends an edit the player just made. Anything that was undone can't be
+// redone anymore, and once the ring is full the oldest edit goes, together
+// with the rest of its group.
+void edit_journal_record(Game *game, const EditDelta *delta)
+{
+    EditJournal *journal = &game->state.edit_journal;
+    while (journal->count > journal->undo_count)
+        hold_building_slot(game, journal_entry(journal, --journal->count), -1);
+
+    if (journal->count == EDIT_JOURNAL_CAPACITY)
+    {
+        do
+        {
+            hold_building_slot(game, journal_entry(journal, 0), -1);
+            journal->head = (journal->head + 1) % EDIT_JOURNAL_CAPACITY;
+            journal->count--;
+        } while (journal->count > 0 && journal_entry(journal, 0)->joins_previous);
+    }
+
+    *journal_entry(journal, journal->count++) = *delta;
+    journal->undo_count = journal->count;
+    hold_building_slot(game, delta, 1);
+}
+
+bool can_undo_edit(const Game *game)
+{
+    return game->state.edit_journal.undo_count > 0;
+}
+
+bool can_redo_edit(const Game *game)
+{
+    return game->state.edit_journal.undo_count < game->state.edit_journal.count;
+}
+
+/* ========== APPLYING EDITS ========== */
+
+static bool is_player_building(const City *city, const EditDelta *delta, int grid_x, int grid_z)
+{
+    const Building *building = city_get_building(city, delta->building_id);
+    return building && building->id != -1 && building->owner_id == PLAYER_COMPANY_ID &&
+           building->template.type == delta->building_type && building->grid_x == grid_x && building->grid_z == grid_z;
+}
+
+// Plays one edit forwards or backwards. Returns false, touching nothing, if
+// the world no longer looks the way the edit left it (a rival built on the
+// spot, a worker was poached) or the player can't pay.
+static bool apply_edit(Game *game, const EditDelta *delta, bool is_undo)
+{
+    City *city = &game->data.cities[delta->city_index];
+    uint64_t *funds = get_company_funds(game, PLAYER_COMPANY_ID);
+    int64_t money = is_undo ? -delta->money : delta->money;
+    if (is_undo && delta->type == EDIT_PLACE)
+        money = (int64_t)(-delta->money * DEMOLISH_REFUND); // taking it back is a demolition, and refunds like one
+    if (money < 0 && *funds < (uint64_t)-money)
+        return false;
+
+    switch (delta->type)
+    {
+    case EDIT_PLACE:
+    case EDIT_DEMOLISH:
+    {
+        // Undoing a placement and redoing a demolition both take the building away.
+        float rotation_angle = 90.0f * delta->rotation;
+        if ((delta->type == EDIT_PLACE) == is_undo)
+        {
+            if (!is_player_building(city, delta, delta->grid_x, delta->grid_z))
+                return false;
+            city_remove_building(game, delta->city_index, delta->building_id);
+        }
+        else
+        {
+            if (!city_grid_can_place_at(city, (BuildingType)delta->building_type, delta->grid_x, delta->grid_z, rotation_angle) ||
+                city_add_building(game, delta->city_index, delta->building_id, (BuildingType)delta->building_type,
+                                  delta->grid_x, delta->grid_z, rotation_angle, PLAYER_COMPANY_ID) < 0)
+                return false;
+        }
+        break;
+    }
+    case EDIT_ROTATE:
+    {
+        int from_x = is_undo ? delta->new_grid_x : delta->grid_x;
+        int from_z = is_undo ? delta->new_grid_z : delta->grid_z;
+        int to_x = is_undo ? delta->grid_x : delta->new_grid_x;
+        int to_z = is_undo ? delta->grid_z : delta->new_grid_z;
+        uint8_t rotation = is_undo ? delta->rotation : delta->new_rotation;
+        if (!is_player_building(city, delta, from_x, from_z) ||
+            !city_rotate_building(game, delta->city_index, delta->building_id, to_x, to_z, 90.0f * rotation))
+            return false;
+        break;
+    }
+    case EDIT_ASSIGN_STAFF:
+    {
+        const Staff *staff = &game->data.staff_owned[delta->staff_id];
+        int32_t from = is_undo ? delta->new_building_id : delta->building_id;
+        int32_t to = is_undo ? delta->building_id : delta->new_building_id;
+        uint8_t to_city = is_undo ? delta->staff_city : delta->new_staff_city;
+        if (!staff->is_employed || staff->employer_id != PLAYER_COMPANY_ID || staff->assigned_building_id != from ||
+            !assign_staff(game, delta->staff_id, to_city, to))
+            return false;
+        break;
+    }
+    default:
+        return false;
+    }
+
+    *funds = (uint64_t)((int64_t)*funds + money);
+    return true;
+}
+
+/* ========== UNDO / REDO ========== */
+
+// Plays the group of entries [first, first + count) backwards for undo,
+// last entry first, or forwards for redo. If one of them fails, the ones
+// already played are played back, so a group is applied whole or not at all.
+// Playing back what was just played can only fail if the journal doesn't
+// match the world anymore, which is worth a warning.
+static bool apply_edit_group(Game *game, EditJournal *journal, uint32_t first, uint32_t count, bool is_undo)
+{
+    for (uint32_t n = 0; n < count; n++)
+    {
+        if (apply_edit(game, journal_entry(journal, is_undo ? first + count - 1 - n : first + n), is_undo))
+            continue;
+
+        while (n-- > 0)
+        {
+            if (!apply_edit(game, journal_entry(journal, is_undo ? first + count - 1 - n : first + n), !is_undo))
+                TraceLog(LOG_WARNING, "EDITS: Failed to roll back a partly applied edit group");
+        }
+        return false;
+    }
+    return true;
+}
+
+// Takes back the player's last edit, or the whole group it belongs to. If
+// the world moved on in a way the journal can't follow, the history is
+// dropped rather than left half applied.
+bool undo_edit(Game *game)
+{
+    EditJournal *journal = &game->state.edit_journal;
+    if (journal->undo_count == 0)
+        return false;
+
+    uint32_t first = journal->undo_count - 1;
+    while (first > 0 && journal_entry(journal, first)->joins_previous)
+        first--;
+
+    if (!apply_edit_group(game, journal, first, journal->undo_count - first, true))
+    {
+        edit_journal_clear(game);
+        return false;
+    }
+    journal->undo_count = first;
+    return true;
+}
+
+bool redo_edit(Game *game)
+{
+    EditJournal *journal = &game->state.edit_journal;
+    if (journal->undo_count == journal->count)
+        return false;
+
+    uint32_t end = journal->undo_count + 1;
+    while (end < journal->count && journal_entry(journal, end)->joins_previous)
+        end++;
+
+    if (!apply_edit_group(game, journal, journal->undo_count, end - journal->undo_count, false))
+    {
+        edit_journal_clear(game);
+        return false;
+    }
+    journal->undo_count = end;
+    return true;
+}
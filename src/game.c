@@ -1,9 +1,24 @@
 #include "game.h"
 #include "raymath.h"
+#include <string.h>
 
 #define RAYGUI_IMPLEMENTATION
 #include "raygui.h"
 
+// Our own greedy-meshed model and its levels of detail where the file
+// allows, raylib's otherwise, with the voxels for picking laid over
+// whichever it is.
+static void load_building_model(Game *game, Model *model, int template_index, const char *path)
+{
+    Assets *assets = &game->data.assets;
+    VoxelShape *shape = &assets->building_shapes[template_index];
+    if (load_voxel_model(model, assets->building_lods[template_index], &assets->building_lod_counts[template_index], shape, path))
+        return;
+
+    *model = LoadModel(path);
+    load_voxel_shape(shape, path, GetModelBoundingBox(*model));
+}
+
 void init_game(Game *game)
 {
     // init window
@@ -29,38 +44,58 @@ void init_game(Game *game)
     /* ======================================== */
 
     // load assets
-    game->data.assets.cities_model[0] = LoadModel("assets/city_0.vox");
-    game->data.assets.cities_model[1] = LoadModel("assets/city_1.vox");
-    game->data.assets.cities_model[2] = LoadModel("assets/city_2.vox");
-    game->data.assets.cities_model[3] = LoadModel("assets/city_3.vox");
-
     game->data.assets.intro_texture = LoadTexture("assets/intro_texture.png");
 
-    game->data.assets.large_restaurant_model = LoadModel("assets/large_rest.vox");
-    game->data.assets.medium_restaurant_model = LoadModel("assets/meduim_rest.vox");
-    game->data.assets.small_restaurant_model = LoadModel("assets/small_rest.obj");
+    load_building_model(game, &game->data.assets.small_restaurant_model, 0, "assets/small_rest.vox");
+    load_building_model(game, &game->data.assets.medium_restaurant_model, 1, "assets/meduim_rest.vox");
+    load_building_model(game, &game->data.assets.large_restaurant_model, 2, "assets/large_rest.vox");
 
     game->data.assets.planet = LoadModel("assets/planet.vox");
     /* ======================================== */
 
     // init templates
+    init_footprints();
     game->data.building_templates[0].base_cost = 1000;
     game->data.building_templates[0].maintenance_cost = 100;
     game->data.building_templates[0].staff_capacity = 5;
+    game->data.building_templates[0].meal_price = 12;
+    game->data.building_templates[0].customer_rate = 0.25f;
+    game->data.building_templates[0].service_rate = 0.1f; // staff raise this
+    game->data.building_templates[0].crowding = 0.25f;
+    game->data.building_templates[0].appeal = 0.0f;
     game->data.building_templates[0].type = BUILDING_RESTAURANT_SMALL;
     game->data.building_templates[0].model = game->data.assets.small_restaurant_model;
 
     game->data.building_templates[1].base_cost = 5000;
     game->data.building_templates[1].maintenance_cost = 1000;
     game->data.building_templates[1].staff_capacity = 10;
+    game->data.building_templates[1].meal_price = 30;
+    game->data.building_templates[1].customer_rate = 0.5f;
+    game->data.building_templates[1].service_rate = 0.2f; // staff raise this
+    game->data.building_templates[1].crowding = 0.5f;
+    game->data.building_templates[1].appeal = 0.1f;
     game->data.building_templates[1].type = BUILDING_RESTAURANT_MEDIUM;
     game->data.building_templates[1].model = game->data.assets.medium_restaurant_model;
 
     game->data.building_templates[2].base_cost = 10000;
     game->data.building_templates[2].maintenance_cost = 5000;
     game->data.building_templates[2].staff_capacity = 15;
+    game->data.building_templates[2].meal_price = 60;
+    game->data.building_templates[2].customer_rate = 1.0f;
+    game->data.building_templates[2].service_rate = 0.4f; // staff raise this
+    game->data.building_templates[2].crowding = 1.0f;
+    game->data.building_templates[2].appeal = 0.3f; // an anchor draws foot traffic to its neighbors
     game->data.building_templates[2].type = BUILDING_RESTAURANT_LARGE;
     game->data.building_templates[2].model = game->data.assets.large_restaurant_model;
+
+    for (int i = 0; i < TEMPLATE_COUNT; i++)
+    {
+        BuildingTemplate *template = &game->data.building_templates[i];
+        template->model_bounds = GetModelBoundingBox(template->model);
+        template->shape = game->data.assets.building_shapes[i].cells ? &game->data.assets.building_shapes[i] : NULL;
+        template->lods = game->data.assets.building_lods[i];
+        template->lod_count = game->data.assets.building_lod_counts[i];
+    }
     /* ======================================== */
 
     // init player
@@ -80,20 +115,24 @@ void init_game(Game *game)
     /* ======================================== */
 
     // init cities
+    arena_init(&game->arena, ARENA_SIZE);
     CityPrices city_prices[4] = {CITY_0, CITY_1, CITY_2, CITY_3};
+    CitySizes city_sizes[4] = {MAP_SIZE_TINY, MAP_SIZE_SMALL, MAP_SIZE_MEDIUM, MAP_SIZE_LARGE};
     for (size_t i = 0; i < MAX_CITIES; i++)
     {
-        game->data.cities[i].city_model = game->data.assets.cities_model[i];
         game->data.cities[i].current_building_count = 0;
         game->data.cities[i].is_unlocked = (i == 0) ? true : false;
         game->data.cities[i].name_id = (CityId)i;
         game->data.cities[i].price_to_unlock = city_prices[i];
-        for (size_t j = 0; j < MAX_BUILDINGS_PER_CITY; j++)
-        {
-            game->data.cities[i].buildings[j] = (Building){0};
-            game->data.cities[i].buildings[j].id = -1;
-            game->data.cities[i].buildings[j].rotation_angle = 0.0f; // Initialize rotation
-        }
+        game->data.cities[i].building_chunk_count = 0; // building pool grows on demand
+        game->data.cities[i].size = city_sizes[i];
+        game->data.cities[i].seed = 0x2545F4914F6CDD1DULL * (i + 1);
+        game->data.cities[i].terrain_state = CITY_TERRAIN_NONE; // generated when someone buys in
+        city_grid_init(&game->data.cities[i], &game->arena);
+        city_generator_init(&game->data.city_generators[i], &game->arena, city_sizes[i], game->data.cities[i].seed);
+        game->data.cities[i].demand = demand_field_create(&game->arena, city_sizes[i], game->data.cities[i].seed);
+        game->data.cities[i].synergy = synergy_field_create(&game->arena, city_sizes[i]);
+        game->data.cities[i].bvh = building_bvh_create(&game->arena, city_sizes[i]);
     }
     /* ======================================== */
 
@@ -104,94 +143,205 @@ void init_game(Game *game)
     game->state.is_paused = false;
     game->state.is_victory = false;
     game->state.selected_building_id = -1;
+    game->state.hovered_building_id = -1;
     game->state.selected_staff_id = -1;
     game->state.is_building_placement_mode = false;
+    game->state.is_skill_menu_open = false;
+    game->state.is_demand_map_visible = false;
+    game->state.is_render_stats_visible = false;
     game->state.building_placement_position = (Vector3){0, 0, 0};
     game->state.selected_building_type_to_place = -1;
     game->state.building_placement_rotation_angle = 0.0f; // Initialize placement rotation
+    edit_journal_clear(game);
     /* ======================================== */
+
+    // init companies
+    init_companies(game);
+    /* ======================================== */
+
+    // init simulation
+    init_simulation(game);
+    jobs_init(JOB_WORKER_COUNT);
+    start_city_generation(game, 0); // everyone starts in the free city
+    game->state.placement_preview.city_index = -1;
+    game->state.placement_preview_result.is_valid = false;
+    /* ======================================== */
+}
+
+/* ========== PICKING ========== */
+
+// Same projection raylib's BeginMode3D sets up for the camera.
+static Matrix get_inverse_view_projection(Camera3D camera, int screen_width, int screen_height)
+{
+    Matrix view = MatrixLookAt(camera.position, camera.target, camera.up);
+    double aspect = (double)screen_width / (double)screen_height;
+    Matrix projection;
+    if (camera.projection == CAMERA_ORTHOGRAPHIC)
+    {
+        double top = camera.fovy / 2.0;
+        projection = MatrixOrtho(-top * aspect, top * aspect, -top, top, 0.01, 1000.0);
+    }
+    else
+    {
+        projection = MatrixPerspective(camera.fovy * DEG2RAD, aspect, 0.01, 1000.0);
+    }
+    return MatrixInvert(MatrixMultiply(view, projection));
 }
 
-Vector3 get_grid_position_from_mouse(Game *game)
+static Vector3 unproject(Matrix inverse_view_projection, float x, float y, float z)
 {
-    Vector2 mousePosition = GetMousePosition();
-    Ray ray = GetMouseRay(mousePosition, game->camera);
-    Vector3 planeNormal = {0.0f, 1.0f, 0.0f}; // Normal vector of the ground plane (pointing straight up along Y).
-    Vector3 planePoint = {0.0f, 0.0f, 0.0f};  // A point on the ground plane (the origin).
+    Quaternion point = QuaternionTransform((Quaternion){x, y, z, 1.0f}, inverse_view_projection);
+    return (Vector3){point.x / point.w, point.y / point.w, point.z / point.w};
+}
 
-    // --- Ray-Plane Intersection Calculation ---
-    // Formula: t = dot(planePoint - ray.position, planeNormal) / dot(ray.direction, planeNormal)
-    // where 't' is the distance along the ray direction where the intersection occurs.
+// Casts the mouse ray at the buildings and the ground (y = 0) of the current
+// city. Off-grid and missed rays come back with is_hit false instead of
+// being clamped to an edge cell. Cached, so hover and click code can both
+// call it freely.
+const PickResult *pick_mouse(Game *game)
+{
+    Picker *picker = &game->state.picker;
+    Vector2 mouse = GetMousePosition();
+    int screen_width = GetScreenWidth();
+    int screen_height = GetScreenHeight();
+
+    bool is_same_view = picker->is_valid && memcmp(&picker->camera, &game->camera, sizeof(Camera3D)) == 0 &&
+                        picker->screen_width == screen_width && picker->screen_height == screen_height;
+    const City *city = &game->data.cities[game->state.current_city];
+    uint32_t bvh_revision = city->bvh ? city->bvh->revision : 0;
+    if (is_same_view && picker->mouse.x == mouse.x && picker->mouse.y == mouse.y &&
+        picker->city_index == game->state.current_city && picker->bvh_revision == bvh_revision)
+        return &picker->result;
+
+    if (!is_same_view)
+    {
+        picker->camera = game->camera;
+        picker->screen_width = screen_width;
+        picker->screen_height = screen_height;
+        picker->inverse_view_projection = get_inverse_view_projection(game->camera, screen_width, screen_height);
+        picker->is_valid = true;
+    }
+    picker->mouse = mouse;
+    picker->city_index = game->state.current_city;
+    picker->bvh_revision = bvh_revision;
+
+    PickResult *result = &picker->result;
+    *result = (PickResult){0};
+    result->building_id = -1;
+
+    float ndc_x = 2.0f * mouse.x / screen_width - 1.0f;
+    float ndc_y = 1.0f - 2.0f * mouse.y / screen_height;
+    Vector3 near_point = unproject(picker->inverse_view_projection, ndc_x, ndc_y, 0.0f);
+    Vector3 far_point = unproject(picker->inverse_view_projection, ndc_x, ndc_y, 1.0f);
+    Vector3 direction = Vector3Subtract(far_point, near_point);
+    result->ray = (Ray){near_point, Vector3Normalize(direction)};
+    result->building_id = building_bvh_raycast(city->bvh, city, result->ray, NULL);
+
+    // Parallel to the ground, or pointing away from it.
+    if (fabsf(direction.y) < 0.0001f)
+        return result;
+    float t = -near_point.y / direction.y;
+    if (t < 0.0f)
+        return result;
 
-    // Calculate the denominator of the intersection formula.
-    float denominator = Vector3DotProduct(ray.direction, planeNormal);
+    result->is_on_ground = true;
+    result->ground_position = Vector3Add(near_point, Vector3Scale(direction, t));
 
-    // Check if the ray is parallel to the plane (denominator is close to zero).
-    // If so, no intersection or infinite intersections (ray lies in the plane).
-    if (fabsf(denominator) < 0.0001f)
-        return (Vector3){0, 0, 0}; // Return a default position (e.g., origin)
+    uint32_t grid_size = city->size;
+    result->is_hit = get_grid_cell_from_position(grid_size, result->ground_position, &result->grid_x, &result->grid_z);
+    if (result->is_hit)
+        result->cell_position = get_grid_cell_position(grid_size, result->grid_x, result->grid_z);
+    return result;
+}
 
-    // Calculate the numerator: dot product of the vector from ray origin to a point on the plane and the plane normal.
-    float t = Vector3DotProduct(Vector3Subtract(planePoint, ray.position), planeNormal) / denominator;
+// Converts grid indices back to world coordinates for the center of the grid cell.
+// 1. Multiply the index by the cell size to get the position of the cell's corner.
+// 2. Subtract gridHalfSpan to shift the coordinate system back so the grid is centered at the world origin.
+// 3. Add half the cube size (FLOOR_CUBE_SIZE / 2.0f) to get the center point of the cell.
+// Every grid is centered on the origin and the sizes are all even, so cells
+// of grids with different sizes line up.
+Vector3 get_grid_cell_position(uint32_t grid_size, int grid_x, int grid_z)
+{
+    const float cellSize = FLOOR_CUBE_SIZE + FLOOR_SPACING;
+    const float gridHalfSpan = grid_size * cellSize / 2.0f;
 
-    // If t is negative, the intersection point is behind the ray's origin.
-    if (t < 0.0f)
-        return (Vector3){0, 0, 0}; // Return a default position
-
-    // Calculate the actual intersection point in world coordinates:
-    // Intersection = ray.position + ray.direction * t
-    Vector3 intersection = Vector3Add(ray.position, Vector3Scale(ray.direction, t));
-
-    // --- Grid Snapping Logic ---
-    // Define grid properties (ideally as constants elsewhere).
-    const float spacing = 0.1f;                           // Gap between grid cells.
-    const float floorCubeSize = 2.0f;                     // Size of the cube representing a cell.
-    const int floorGridSize = 20;                         // Number of cells along X and Z axes.
-    const float cellSize = floorCubeSize + spacing;       // Total size of a cell including spacing.
-    const float gridTotalSpan = floorGridSize * cellSize; // Total width/depth of the grid.
-    const float gridHalfSpan = gridTotalSpan / 2.0f;      // Half the span, used to center the grid at the origin.
-
-    // Convert world intersection coordinates (X, Z) to grid indices.
-    // 1. Shift the coordinate system origin from the center of the grid (-gridHalfSpan)
-    //    to the corner (0) by adding gridHalfSpan.
-    // 2. Divide by the total size of a cell (cube + spacing) to get the index.
-    // 3. Use floorf() to get the integer index of the cell the point falls into.
-    float gridX = floorf((intersection.x + gridHalfSpan) / cellSize);
-    float gridZ = floorf((intersection.z + gridHalfSpan) / cellSize);
-
-    // Clamp grid indices to ensure they stay within the valid range [0, floorGridSize - 1].
-    gridX = fmaxf(0, fminf(gridX, floorGridSize - 1));
-    gridZ = fmaxf(0, fminf(gridZ, floorGridSize - 1));
-
-    // Convert the clamped grid indices back to world coordinates for the center of the target grid cell.
-    // 1. Multiply the index by the cell size to get the position of the cell's corner.
-    // 2. Subtract gridHalfSpan to shift the coordinate system back so the grid is centered at the world origin.
-    // 3. Add half the cube size (floorCubeSize / 2.0f) to get the center point of the cell.
     Vector3 gridPosition = {
-        gridX * cellSize - gridHalfSpan + (floorCubeSize / 2.0f),
+        grid_x * cellSize - gridHalfSpan + (FLOOR_CUBE_SIZE / 2.0f),
         0.0f, // Place the object on the ground plane (Y=0).
-        gridZ * cellSize - gridHalfSpan + (floorCubeSize / 2.0f)};
+        grid_z * cellSize - gridHalfSpan + (FLOOR_CUBE_SIZE / 2.0f)};
 
     return gridPosition;
 }
 
-bool unlock_city(Game *game, int city_index)
+// The inverse of get_grid_cell_position. Returns false outside the grid.
+bool get_grid_cell_from_position(uint32_t grid_size, Vector3 position, int *grid_x, int *grid_z)
 {
-    if (city_index < 0 || city_index >= MAX_CITIES)
+    const float cellSize = FLOOR_CUBE_SIZE + FLOOR_SPACING;
+    const float gridHalfSpan = grid_size * cellSize / 2.0f;
+
+    int x = (int)floorf((position.x + gridHalfSpan) / cellSize);
+    int z = (int)floorf((position.z + gridHalfSpan) / cellSize);
+    if (x < 0 || z < 0 || x >= (int)grid_size || z >= (int)grid_size)
         return false;
-    if (game->data.cities[city_index].is_unlocked)
-        return true;
 
-    CityPrices price = game->data.cities[city_index].price_to_unlock;
+    *grid_x = x;
+    *grid_z = z;
+    return true;
+}
 
-    if (game->data.player.net_worth >= price)
-    {
-        game->data.player.net_worth -= price;
-        game->data.cities[city_index].is_unlocked = true;
-        return true;
-    }
+bool unlock_city(Game *game, int city_index)
+{
+    Command command = {0};
+    command.type = CMD_UNLOCK_CITY;
+    command.company_id = PLAYER_COMPANY_ID;
+    command.city_index = city_index;
+    return execute_command(game, &command);
+}
 
-    return false;
+// Moves the camera to look at target, keeping its isometric angle and distance.
+static void set_camera_target(Game *game, Vector3 target)
+{
+    Vector3 offset = Vector3Subtract(game->camera.position, game->camera.target);
+    game->camera.target = target;
+    game->camera.position = Vector3Add(target, offset);
+}
+
+// Zooms with the mouse wheel by changing the orthographic view height.
+static void zoom_city_camera(Game *game)
+{
+    float wheel = GetMouseWheelMove();
+    if (wheel == 0.0f)
+        return;
+
+    game->camera.fovy = Clamp(game->camera.fovy * (1.0f - wheel * CAMERA_ZOOM_STEP), CAMERA_MIN_FOVY, CAMERA_MAX_FOVY);
+}
+
+// Pans along the ground with WASD or the arrow keys, relative to the view.
+static void pan_city_camera(Game *game)
+{
+    Vector3 forward = Vector3Subtract(game->camera.target, game->camera.position);
+    forward.y = 0.0f;
+    forward = Vector3Normalize(forward);
+    Vector3 right = {-forward.z, 0.0f, forward.x};
+
+    Vector3 move = {0};
+    if (IsKeyDown(KEY_W) || IsKeyDown(KEY_UP))
+        move = Vector3Add(move, forward);
+    if (IsKeyDown(KEY_S) || IsKeyDown(KEY_DOWN))
+        move = Vector3Subtract(move, forward);
+    if (IsKeyDown(KEY_D) || IsKeyDown(KEY_RIGHT))
+        move = Vector3Add(move, right);
+    if (IsKeyDown(KEY_A) || IsKeyDown(KEY_LEFT))
+        move = Vector3Subtract(move, right);
+
+    if (Vector3LengthSqr(move) == 0.0f)
+        return;
+
+    const float halfSpan = game->data.cities[game->state.current_city].size * (FLOOR_CUBE_SIZE + FLOOR_SPACING) / 2.0f;
+    Vector3 target = Vector3Add(game->camera.target, Vector3Scale(Vector3Normalize(move), CAMERA_PAN_SPEED * GetFrameTime()));
+    target.x = Clamp(target.x, -halfSpan, halfSpan);
+    target.z = Clamp(target.z, -halfSpan, halfSpan);
+    set_camera_target(game, target);
 }
 
 const char *get_city_name(CityId id)
@@ -211,127 +361,511 @@ const char *get_city_name(CityId id)
     }
 }
 
-void handle_input(Game *game)
+static void format_perk_label(const Game *game, PerkId id, char *buffer)
+{
+    static const char *stat_names[MODIFIER_STAT_COUNT] = {"revenue", "customers", "upkeep", "efficiency", "salary"};
+    const PerkDefinition *perk = get_perk_definition(id);
+    int percent = (int)roundf((perk->multiplier - 1.0f) * 100.0f);
+
+    char *end = append_text(append_text(buffer, perk->name), ": ");
+    if (percent >= 0)
+        *end++ = '+';
+    end = append_text(append_text(append_i64(end, percent), "% "), stat_names[perk->stat]);
+    if (is_perk_unlocked(&game->data.skill_tree, id))
+        end = append_text(end, " (owned)");
+    else
+        end = append_text(append_u64(append_text(end, " ($"), perk->cost), ")");
+    *end = '\0';
+}
+
+// The player's building in the current city with the fewest staff and room for more.
+static int32_t find_player_building_needing_staff(Game *game)
 {
-    if (game->state.current_scene == MAIN_MENU_SCENE)
+    const City *city = &game->data.cities[game->state.current_city];
+    int32_t best = -1;
+    uint32_t best_staff = MAX_STAFF_PER_BUILDING;
+
+    for (uint32_t i = 0; i < city_building_slots(city); i++)
     {
-        float buttonWidth = 200;
-        float buttonHeight = 50;
-        float buttonX = (SCREEN_WIDTH - buttonWidth) / 2.0f;
-        float buttonY = SCREEN_HEIGHT * 0.75f - (buttonHeight / 2.0f);
-        Rectangle startButtonRect = {buttonX, buttonY, buttonWidth, buttonHeight};
+        const Building *building = city_get_building(city, i);
+        if (building->id == -1 || building->owner_id != PLAYER_COMPANY_ID)
+            continue;
 
-        if (GuiButton(startButtonRect, "Start Game"))
+        if (building->current_staff_count < building->template.staff_capacity && building->current_staff_count < best_staff)
         {
-            game->state.current_scene = PLANET_SCENE;
+            best = (int32_t)i;
+            best_staff = building->current_staff_count;
         }
     }
-    else if (game->state.current_scene == PLANET_SCENE)
+    return best;
+}
+
+/* ========== UI ========== */
+
+// Places every widget for a screen of width x height. Labels that sit at a
+// widget are dropped so they're laid out again where it went.
+static void layout_ui(UIData *ui, int width, int height)
+{
+    MainMenu *menu = &ui->main_menu_ui;
+    menu->start_button = (Rectangle){(width - 200) / 2.0f, height * 0.75f - 25, 200, 50};
+    Vector2 title_position = {(float)(width / 2 - MeasureText("Project Red", 40) / 2), (float)(height / 3)};
+    text_label_set(&menu->title_label, "Project Red", title_position, 40);
+
+    PlanetMenu *planet = &ui->planet_ui;
+    planet->back_button = (Rectangle){width - 220, 20, 200, 50};
+    for (int i = 0; i < MAX_CITIES; i++)
+        planet->city_buttons[i] = (Rectangle){50, 100 + (50 + 20) * i, 200, 50};
+    text_label_set(&planet->title_label, "Select a City", (Vector2){50, 60}, 30);
+
+    BuildingMenu *buildings = &ui->building_ui;
+    buildings->button_padding = 10;
+    buildings->button_height = 30;
+    buildings->panel_rect = (Rectangle){20, 80, 250, 3 * buildings->button_height + 2 * buildings->button_padding};
+    buildings->small_restaurant_btn = (Rectangle){20, 80, 250, buildings->button_height};
+    buildings->medium_restaurant_btn = (Rectangle){20, 120, 250, buildings->button_height};
+    buildings->large_restaurant_btn = (Rectangle){20, 160, 250, buildings->button_height};
+
+    HUDUi *hud = &ui->hud_ui;
+    hud->net_worth_display_area = (Rectangle){20, 20, 250, 20};
+    hud->current_city_display_area = (Rectangle){20, 50, 250, 20};
+    hud->render_stats_area = (Rectangle){290, height - 45, width - 310, 20};
+    hud->projection_area = (Rectangle){20, 340, 600, 45};
+    hud->batch_area = (Rectangle){20, 390, 600, 20};
+    hud->planet_button = (Rectangle){width - 220, 20, 200, 50};
+    hud->skill_tree_button = (Rectangle){width - 220, 80, 200, 30};
+    hud->hire_staff_button = (Rectangle){20, 200, 250, 30};
+    hud->demand_map_button = (Rectangle){20, 240, 250, 30};
+    hud->undo_button = (Rectangle){20, height - 50, 120, 30};
+    hud->redo_button = (Rectangle){150, height - 50, 120, 30};
+    for (int i = 0; i < PERK_COUNT; i++)
+        hud->perk_buttons[i] = (Rectangle){width - 420, 130 + 40 * i, 400, 30};
+    text_label_set(&hud->hover_hint_label, "R to rotate, Delete to demolish (half refund).", (Vector2){20, (float)(height - 80)}, 20);
+    text_label_set(&hud->placement_hint_labels[0], "Click to place building. Right-click to cancel.", (Vector2){20, 280}, 20);
+    text_label_set(&hud->placement_hint_labels[1], "Press R to rotate. Drag for a row, Shift-drag for a block.", (Vector2){20, 305}, 20);
+    text_label_set(&hud->no_fit_label, "Doesn't fit here.", (Vector2){hud->projection_area.x, hud->projection_area.y}, 20);
+    text_label_set(&hud->projecting_label, "Projecting...", (Vector2){hud->projection_area.x, hud->projection_area.y}, 20);
+    hud->net_worth_label.is_valid = false;
+    hud->city_label.is_valid = false;
+    hud->render_stats_label.is_valid = false;
+    hud->projection_label.is_valid = false;
+    hud->neighbors_label.is_valid = false;
+    hud->batch_label.is_valid = false;
+
+    ui->layout_width = width;
+    ui->layout_height = height;
+}
+
+// A raygui button with its text in text_color for this one call.
+static bool ui_button(Rectangle bounds, const char *text, unsigned int text_color)
+{
+    if (text_color == UI_TEXT_COLOR)
+        return GuiButton(bounds, text);
+
+    GuiSetStyle(BUTTON, TEXT_COLOR_NORMAL, (int)text_color);
+    bool is_pressed = GuiButton(bounds, text);
+    GuiSetStyle(BUTTON, TEXT_COLOR_NORMAL, (int)UI_TEXT_COLOR);
+    return is_pressed;
+}
+
+// The HUD's changing text is kept in labels, formatted and laid out again
+// only on the frames its value changes.
+static void draw_net_worth_label(Game *game)
+{
+    const HUDUi *hud = &game->data.ui_data.hud_ui;
+    TextLabel *label = &game->data.ui_data.hud_ui.net_worth_label;
+    uint64_t net_worth = game->data.player.net_worth;
+    if (text_label_update(label, &net_worth, sizeof(net_worth)))
+    {
+        char text[MAX_LABEL_LENGTH];
+        *append_u64(append_text(text, "Net Worth: $"), net_worth) = '\0';
+        text_label_set(label, text, (Vector2){hud->net_worth_display_area.x, hud->net_worth_display_area.y}, 20);
+    }
+    draw_text_label(label, GREEN);
+}
+
+static void draw_city_label(Game *game)
+{
+    const HUDUi *hud = &game->data.ui_data.hud_ui;
+    TextLabel *label = &game->data.ui_data.hud_ui.city_label;
+    CityId city_index = game->state.current_city;
+    if (text_label_update(label, &city_index, sizeof(city_index)))
+    {
+        char text[MAX_LABEL_LENGTH];
+        *append_text(append_text(text, "Current City: "), get_city_name(game->data.cities[city_index].name_id)) = '\0';
+        text_label_set(label, text, (Vector2){hud->current_city_display_area.x, hud->current_city_display_area.y}, 20);
+    }
+    draw_text_label(label, WHITE);
+}
+
+static void draw_render_stats_label(Game *game)
+{
+    const HUDUi *hud = &game->data.ui_data.hud_ui;
+    TextLabel *label = &game->data.ui_data.hud_ui.render_stats_label;
+    const RenderStats *stats = &game->data.render_queue.stats;
+    if (text_label_update(label, stats, sizeof(*stats)))
+    {
+        char text[MAX_LABEL_LENGTH];
+        char *end = append_text(append_u64(text, stats->item_count), " items, ");
+        end = append_text(append_u64(end, stats->shader_binds), " shader binds, ");
+        end = append_text(append_u64(end, stats->texture_binds), " texture binds, ");
+        end = append_text(append_u64(end, stats->batch_flushes), " flushes, ");
+        *append_text(append_u64(end, stats->dropped_count), " dropped") = '\0';
+        text_label_set(label, text, (Vector2){hud->render_stats_area.x, hud->render_stats_area.y}, 20);
+    }
+    draw_text_label(label, LIGHTGRAY);
+}
+
+// What the placement preview projects for the hovered spot.
+static void draw_projection_labels(Game *game, const PreviewResult *preview)
+{
+    const HUDUi *hud = &game->data.ui_data.hud_ui;
+    TextLabel *label = &game->data.ui_data.hud_ui.projection_label;
+    struct
+    {
+        int64_t profit_per_day;
+        float payback_days;
+    } projection = {0}; // zeroed padding and all, it's compared byte for byte
+    projection.profit_per_day = preview->profit_per_day;
+    projection.payback_days = preview->payback_days;
+    if (text_label_update(label, &projection, sizeof(projection)))
+    {
+        char text[MAX_LABEL_LENGTH];
+        char *end = append_text(append_i64(append_text(text, "Projected: $"), projection.profit_per_day), "/day, ");
+        if (isinf(projection.payback_days))
+            end = append_text(end, "never pays back");
+        else
+            end = append_text(append_tenths(append_text(end, "pays back in "), projection.payback_days), " days");
+        *end = '\0';
+        text_label_set(label, text, (Vector2){hud->projection_area.x, hud->projection_area.y}, 20);
+    }
+    draw_text_label(label, YELLOW);
+
+    label = &game->data.ui_data.hud_ui.neighbors_label;
+    int64_t neighbors[2] = {preview->neighbor_count, llroundf(preview->neighbor_customers_delta)};
+    if (text_label_update(label, neighbors, sizeof(neighbors)))
+    {
+        char text[MAX_LABEL_LENGTH];
+        char *end = append_text(append_u64(append_text(text, "Nearby restaurants ("), (uint64_t)neighbors[0]), "): ");
+        if (neighbors[1] >= 0)
+            *end++ = '+';
+        *append_text(append_i64(end, neighbors[1]), " customers/day") = '\0';
+        text_label_set(label, text, (Vector2){hud->projection_area.x, hud->projection_area.y + 25}, 20);
+    }
+    draw_text_label(label, YELLOW);
+}
+
+// Size and cost of the row or block being dragged out.
+static void draw_batch_label(Game *game, const PlacementBatch *batch)
+{
+    const HUDUi *hud = &game->data.ui_data.hud_ui;
+    TextLabel *label = &game->data.ui_data.hud_ui.batch_label;
+    uint64_t totals[3] = {batch->valid_count, batch->count, batch->total_cost};
+    if (text_label_update(label, totals, sizeof(totals)))
+    {
+        char text[MAX_LABEL_LENGTH];
+        char *end = append_u64(append_text(text, "Placing "), batch->valid_count);
+        end = append_u64(append_text(end, " for $"), batch->total_cost);
+        if (batch->valid_count < batch->count)
+            end = append_text(append_u64(append_text(end, " ("), batch->count - batch->valid_count), " don't fit or can't be paid for)");
+        *end = '\0';
+        text_label_set(label, text, (Vector2){hud->batch_area.x, hud->batch_area.y}, 20);
+    }
+    draw_text_label(label, (batch->valid_count < batch->count) ? ORANGE : GREEN);
+}
+
+// Button text for placing a template, redone only when its price changes.
+// raygui lays buttons out itself, so only the string is kept.
+static const char *get_building_button_text(Game *game, int template_index)
+{
+    static const char *names[TEMPLATE_COUNT] = {"Small Restaurant ($", "Medium Restaurant ($", "Large Restaurant ($"};
+    TextLabel *label = &game->data.ui_data.building_ui.button_labels[template_index];
+    uint32_t cost = game->data.building_templates[template_index].base_cost;
+    if (text_label_update(label, &cost, sizeof(cost)))
     {
-        char netWorthText[50];
-        sprintf(netWorthText, "Net Worth: $%llu", game->data.player.net_worth);
-        DrawText(netWorthText, 20, 20, 20, GREEN);
+        char *end = append_u64(append_text(label->text, names[template_index]), cost);
+        end[0] = ')';
+        end[1] = '\0';
+    }
+    return label->text;
+}
 
-        // Back to main menu button
-        Rectangle backButtonRect = {SCREEN_WIDTH - 220, 20, 200, 50};
-        if (GuiButton(backButtonRect, "Back to Main Menu"))
+static const char *get_city_button_text(Game *game, int city_index)
+{
+    const City *city = &game->data.cities[city_index];
+    TextLabel *label = &game->data.ui_data.planet_ui.city_labels[city_index];
+    bool is_unlocked = city->is_unlocked;
+    if (text_label_update(label, &is_unlocked, sizeof(is_unlocked)))
+    {
+        char *end = label->text;
+        if (is_unlocked)
         {
-            game->state.current_scene = MAIN_MENU_SCENE;
+            end = append_text(append_text(end, "Go to "), get_city_name(city->name_id));
         }
+        else
+        {
+            end = append_text(append_text(append_text(end, "Unlock "), get_city_name(city->name_id)), " ($");
+            end = append_text(append_u64(end, city->price_to_unlock), ")");
+        }
+        *end = '\0';
+    }
+    return label->text;
+}
 
-        float buttonWidth = 200;
-        float buttonHeight = 50;
-        float buttonSpacing = 20;
-        float startY = 100;
+static const char *get_perk_button_text(Game *game, PerkId id)
+{
+    TextLabel *label = &game->data.ui_data.hud_ui.perk_labels[id];
+    bool is_unlocked = is_perk_unlocked(&game->data.skill_tree, id);
+    if (text_label_update(label, &is_unlocked, sizeof(is_unlocked)))
+        format_perk_label(game, id, label->text);
+    return label->text;
+}
+
+static void enter_city(Game *game, int city_index)
+{
+    game->state.current_city = city_index;
+    game->state.selected_building_id = -1;
+    game->state.current_scene = CITY_SCENE;
+    set_camera_target(game, (Vector3){0, 0, 0});
+}
+
+static void start_building_placement(Game *game, BuildingType type)
+{
+    if (game->data.player.net_worth < game->data.building_templates[type].base_cost)
+        return;
+    game->state.is_building_placement_mode = true;
+    game->state.selected_building_type_to_place = type;
+}
+
+// Each screen's widgets are drawn and acted on in one go, from draw_game.
+// What a click changes shows from the next frame on.
+static void run_main_menu_ui(Game *game)
+{
+    MainMenu *menu = &game->data.ui_data.main_menu_ui;
+    draw_text_label(&menu->title_label, RED);
+
+    if (GuiButton(menu->start_button, "Start Game"))
+    {
+        game->state.current_scene = PLANET_SCENE;
+    }
+}
+
+static void run_planet_ui(Game *game)
+{
+    const PlanetMenu *planet = &game->data.ui_data.planet_ui;
+    draw_net_worth_label(game);
+    draw_text_label(&planet->title_label, WHITE);
 
-        for (int i = 0; i < MAX_CITIES; i++)
+    if (GuiButton(planet->back_button, "Back to Main Menu"))
+    {
+        game->state.current_scene = MAIN_MENU_SCENE;
+    }
+
+    for (int i = 0; i < MAX_CITIES; i++)
+    {
+        const City *city = &game->data.cities[i];
+        const char *text = get_city_button_text(game, i);
+        if (city->is_unlocked)
         {
-            City *city = &game->data.cities[i];
-            Rectangle cityBtnRect = {50, startY + (buttonHeight + buttonSpacing) * i, buttonWidth, buttonHeight};
+            if (GuiButton(planet->city_buttons[i], text))
+                enter_city(game, i);
+        }
+        else
+        {
+            unsigned int color = (game->data.player.net_worth < city->price_to_unlock) ? UI_WARNING_TEXT_COLOR : UI_TEXT_COLOR;
+            if (ui_button(planet->city_buttons[i], text, color) && unlock_city(game, i))
+                enter_city(game, i);
+        }
+    }
+}
 
-            char buttonText[100];
-            if (city->is_unlocked)
-            {
-                sprintf(buttonText, "Go to %s", get_city_name(city->name_id));
-                if (GuiButton(cityBtnRect, buttonText))
-                {
-                    game->state.current_city = i;
-                    game->state.current_scene = CITY_SCENE;
-                }
-            }
-            else
-            {
-                sprintf(buttonText, "Unlock %s ($%llu)", get_city_name(city->name_id), city->price_to_unlock);
-                if (GuiButton(cityBtnRect, buttonText))
-                {
-                    if (unlock_city(game, i))
-                    {
-                        game->state.current_city = i;
-                        game->state.current_scene = CITY_SCENE;
-                    }
-                }
-            }
+static void run_city_ui(Game *game)
+{
+    const HUDUi *hud = &game->data.ui_data.hud_ui;
+    const BuildingMenu *buildings = &game->data.ui_data.building_ui;
+
+    draw_net_worth_label(game);
+    draw_city_label(game);
+    if (game->state.is_render_stats_visible)
+        draw_render_stats_label(game);
+
+    if (GuiButton(hud->planet_button, "Return to Planet"))
+    {
+        game->state.current_scene = PLANET_SCENE;
+        set_camera_target(game, (Vector3){0, 0, 0}); // the planet sits at the origin
+    }
+
+    if (GuiButton(hud->skill_tree_button, "Skill Tree"))
+    {
+        game->state.is_skill_menu_open = !game->state.is_skill_menu_open;
+    }
+
+    int32_t staffless_id = find_player_building_needing_staff(game);
+    if (ui_button(hud->hire_staff_button, "Hire Staff", (staffless_id < 0) ? UI_WARNING_TEXT_COLOR : UI_TEXT_COLOR) && staffless_id >= 0)
+    {
+        Command command = {0};
+        command.type = CMD_HIRE_STAFF;
+        command.company_id = PLAYER_COMPANY_ID;
+        command.role = (StaffRole)GetRandomValue(0, ROLE_COUNT - 1);
+        command.city_index = game->state.current_city;
+        command.building_id = staffless_id;
+        execute_command(game, &command);
+    }
+
+    if (GuiButton(hud->demand_map_button, game->state.is_demand_map_visible ? "Hide Demand Map" : "Show Demand Map"))
+    {
+        game->state.is_demand_map_visible = !game->state.is_demand_map_visible;
+    }
+
+    if (game->state.is_skill_menu_open)
+    {
+        for (int i = 0; i < PERK_COUNT; i++)
+        {
+            bool is_out_of_reach = !is_perk_unlocked(&game->data.skill_tree, (PerkId)i) && !can_unlock_perk(game, (PerkId)i);
+            if (ui_button(hud->perk_buttons[i], get_perk_button_text(game, (PerkId)i), is_out_of_reach ? UI_WARNING_TEXT_COLOR : UI_TEXT_COLOR))
+                unlock_perk(game, (PerkId)i);
         }
     }
-    else if (game->state.current_scene == CITY_SCENE)
+
+    const Rectangle building_buttons[TEMPLATE_COUNT] = {buildings->small_restaurant_btn, buildings->medium_restaurant_btn,
+                                                        buildings->large_restaurant_btn};
+    for (int i = 0; i < TEMPLATE_COUNT; i++)
+    {
+        bool is_affordable = game->data.player.net_worth >= game->data.building_templates[i].base_cost;
+        if (ui_button(building_buttons[i], get_building_button_text(game, i), is_affordable ? UI_TEXT_COLOR : UI_WARNING_TEXT_COLOR))
+            start_building_placement(game, (BuildingType)i);
+    }
+
+    if (ui_button(hud->undo_button, "Undo", can_undo_edit(game) ? UI_TEXT_COLOR : UI_DISABLED_TEXT_COLOR))
+    {
+        undo_edit(game);
+    }
+    if (ui_button(hud->redo_button, "Redo", can_redo_edit(game) ? UI_TEXT_COLOR : UI_DISABLED_TEXT_COLOR))
+    {
+        redo_edit(game);
+    }
+
+    const Building *hovered = city_get_building(&game->data.cities[game->state.current_city], game->state.hovered_building_id);
+    if (!game->state.is_building_placement_mode && hovered && hovered->id != -1 && hovered->owner_id == PLAYER_COMPANY_ID)
     {
-        char netWorthText[50];
-        sprintf(netWorthText, "Net Worth: $%llu", game->data.player.net_worth);
-        DrawText(netWorthText, 20, 20, 20, GREEN);
+        draw_text_label(&hud->hover_hint_label, WHITE);
+    }
 
-        char cityText[50];
-        sprintf(cityText, "Current City: %s", get_city_name(game->data.cities[game->state.current_city].name_id));
-        DrawText(cityText, 20, 50, 20, WHITE);
+    if (game->state.is_building_placement_mode)
+    {
+        draw_text_label(&hud->placement_hint_labels[0], WHITE);
+        draw_text_label(&hud->placement_hint_labels[1], WHITE);
 
-        float buttonWidth = 200;
-        float buttonHeight = 50;
-        float buttonX = SCREEN_WIDTH - buttonWidth - 20;
-        float buttonY = 20;
-        Rectangle goToPlanetButtonRect = {buttonX, buttonY, buttonWidth, buttonHeight};
+        const PlacementBatch *batch = &game->state.placement_batch;
+        if (game->state.is_dragging_placement && batch->count > 1)
+            draw_batch_label(game, batch);
 
-        if (GuiButton(goToPlanetButtonRect, "Return to Planet"))
+        const PreviewResult *preview = &game->state.placement_preview_result;
+        if (preview->is_valid)
+        {
+            draw_projection_labels(game, preview);
+        }
+        else if (!city_grid_can_place(&game->data.cities[game->state.current_city], game->state.selected_building_type_to_place,
+                                      game->state.building_placement_position, game->state.building_placement_rotation_angle))
         {
-            game->state.current_scene = PLANET_SCENE;
+            draw_text_label(&hud->no_fit_label, RED);
         }
+        else
+        {
+            draw_text_label(&hud->projecting_label, GRAY);
+        }
+    }
+}
+
+// True if the mouse is over one of the city screen's widgets, so a click
+// there is the widget's and not the world's.
+static bool is_mouse_over_city_ui(const Game *game)
+{
+    const HUDUi *hud = &game->data.ui_data.hud_ui;
+    const Vector2 mouse = GetMousePosition();
+    const Rectangle widgets[] = {game->data.ui_data.building_ui.panel_rect,
+                                 hud->planet_button,
+                                 hud->skill_tree_button,
+                                 hud->hire_staff_button,
+                                 hud->demand_map_button,
+                                 hud->undo_button,
+                                 hud->redo_button};
+
+    for (size_t i = 0; i < sizeof(widgets) / sizeof(widgets[0]); i++)
+    {
+        if (CheckCollisionPointRec(mouse, widgets[i]))
+            return true;
+    }
+    for (int i = 0; game->state.is_skill_menu_open && i < PERK_COUNT; i++)
+    {
+        if (CheckCollisionPointRec(mouse, hud->perk_buttons[i]))
+            return true;
+    }
+    return false;
+}
 
-        char smallRestText[50], mediumRestText[50], largeRestText[50];
-        sprintf(smallRestText, "Small Restaurant ($%u)", game->data.building_templates[0].base_cost);
-        sprintf(mediumRestText, "Medium Restaurant ($%u)", game->data.building_templates[1].base_cost);
-        sprintf(largeRestText, "Large Restaurant ($%u)", game->data.building_templates[2].base_cost);
+// Keyboard, camera and world input. Widgets are evaluated where they are
+// drawn, in draw_game.
+void handle_input(Game *game)
+{
+    if (game->state.current_scene == CITY_SCENE)
+    {
+        pan_city_camera(game);
+        zoom_city_camera(game);
 
-        Rectangle buildingModeRect = {20, 80, 250, 30};
-        if (GuiButton(buildingModeRect, smallRestText))
+        bool isControlDown = IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL);
+        bool isShiftDown = IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT);
+        if (isControlDown && !isShiftDown && IsKeyPressed(KEY_Z))
         {
-            if (game->data.player.net_worth >= game->data.building_templates[0].base_cost)
-            {
-                game->state.is_building_placement_mode = true;
-                game->state.selected_building_type_to_place = BUILDING_RESTAURANT_SMALL;
-            }
+            undo_edit(game);
+        }
+        if (isControlDown && (IsKeyPressed(KEY_Y) || (isShiftDown && IsKeyPressed(KEY_Z))))
+        {
+            redo_edit(game);
+        }
+        if (IsKeyPressed(KEY_F3))
+        {
+            game->state.is_render_stats_visible = !game->state.is_render_stats_visible;
         }
 
-        Rectangle buildingModeRect2 = {20, 120, 250, 30};
-        if (GuiButton(buildingModeRect2, mediumRestText))
+        City *city = &game->data.cities[game->state.current_city];
+        const PickResult *pick = pick_mouse(game);
+        // The building drawn under the mouse, or failing that the one whose footprint is.
+        game->state.hovered_building_id = pick->building_id;
+        if (game->state.hovered_building_id < 0 && pick->is_hit)
+            game->state.hovered_building_id = city_grid_get_building(city, pick->grid_x, pick->grid_z);
+
+        bool is_world_click = IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && !is_mouse_over_city_ui(game);
+        if (!game->state.is_building_placement_mode && is_world_click)
         {
-            if (game->data.player.net_worth >= game->data.building_templates[1].base_cost)
-            {
-                game->state.is_building_placement_mode = true;
-                game->state.selected_building_type_to_place = BUILDING_RESTAURANT_MEDIUM;
-            }
+            game->state.selected_building_id = game->state.hovered_building_id;
         }
 
-        Rectangle buildingModeRect3 = {20, 160, 250, 30};
-        if (GuiButton(buildingModeRect3, largeRestText))
+        const Building *hovered = city_get_building(city, game->state.hovered_building_id);
+        if (!game->state.is_building_placement_mode && hovered && hovered->id != -1 && hovered->owner_id == PLAYER_COMPANY_ID)
         {
-            if (game->data.player.net_worth >= game->data.building_templates[2].base_cost)
+            Command command = {0};
+            command.company_id = PLAYER_COMPANY_ID;
+            command.city_index = game->state.current_city;
+            command.building_id = game->state.hovered_building_id;
+
+            if (IsKeyPressed(KEY_R))
             {
-                game->state.is_building_placement_mode = true;
-                game->state.selected_building_type_to_place = BUILDING_RESTAURANT_LARGE;
+                command.type = CMD_ROTATE_BUILDING;
+                command.rotation_angle = fmodf(hovered->rotation_angle + 90.0f, 360.0f);
+                execute_command(game, &command);
+            }
+            else if (IsKeyPressed(KEY_DELETE) || IsKeyPressed(KEY_BACKSPACE))
+            {
+                command.type = CMD_DEMOLISH_BUILDING;
+                execute_command(game, &command);
             }
         }
 
         if (game->state.is_building_placement_mode)
         {
-            game->state.building_placement_position = get_grid_position_from_mouse(game);
+            // Off the grid the preview shows red rather than sticking to the edge.
+            if (pick->is_on_ground)
+                game->state.building_placement_position = pick->is_hit ? pick->cell_position : pick->ground_position;
 
             // Handle rotation input
             if (IsKeyPressed(KEY_R))
@@ -339,25 +873,30 @@ void handle_input(Game *game)
                 game->state.building_placement_rotation_angle = fmodf(game->state.building_placement_rotation_angle + 90.0f, 360.0f);
             }
 
-            if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON))
+            // Dragging lays out a row of buildings, or a rectangle with Shift held.
+            // A click is a drag that places just one.
+            if (is_world_click)
             {
-                City *current_city = &game->data.cities[game->state.current_city];
-
-                if (current_city->current_building_count < MAX_BUILDINGS_PER_CITY)
-                {
-                    BuildingTemplate template = game->data.building_templates[game->state.selected_building_type_to_place];
-
-                    if (game->data.player.net_worth >= template.base_cost)
-                    {
-                        game->data.player.net_worth -= template.base_cost;
+                game->state.is_dragging_placement = true;
+                game->state.placement_drag_start = game->state.building_placement_position;
+            }
 
-                        place_building(current_city, game->state.selected_building_type_to_place,
-                                       game->state.building_placement_position, template,
-                                       game->state.building_placement_rotation_angle);
+            if (game->state.is_dragging_placement)
+            {
+                plan_placement_batch(game, &game->state.placement_batch, PLAYER_COMPANY_ID, game->state.current_city,
+                                     game->state.selected_building_type_to_place, game->state.placement_drag_start,
+                                     game->state.building_placement_position, game->state.building_placement_rotation_angle,
+                                     isShiftDown);
 
-                        current_city->current_building_count++;
-                    }
+                if (IsMouseButtonReleased(MOUSE_LEFT_BUTTON))
+                {
+                    Command command = {0};
+                    command.type = CMD_PLACE_BUILDINGS;
+                    command.company_id = PLAYER_COMPANY_ID;
+                    command.batch = &game->state.placement_batch;
+                    execute_command(game, &command);
 
+                    game->state.is_dragging_placement = false;
                     game->state.is_building_placement_mode = false;
                     game->state.building_placement_rotation_angle = 0.0f; // Reset rotation
                 }
@@ -365,6 +904,7 @@ void handle_input(Game *game)
 
             if (IsMouseButtonPressed(MOUSE_RIGHT_BUTTON))
             {
+                game->state.is_dragging_placement = false;
                 game->state.is_building_placement_mode = false;
                 game->state.building_placement_rotation_angle = 0.0f; // Reset rotation
             }
@@ -374,11 +914,23 @@ void handle_input(Game *game)
 
 void update_game(Game *game, float dt)
 {
-    ///////
+    if (game->state.current_scene == MAIN_MENU_SCENE || game->state.is_paused)
+        return;
+
+    update_city_generation(game);
+    update_synergy(game);
+    update_simulation(game, dt);
+    update_demand(game, dt);
+    update_companies(game, dt);
+    update_placement_preview(game);
 }
 
 void draw_game(Game *game)
 {
+    UIData *ui = &game->data.ui_data;
+    if (ui->layout_width != GetScreenWidth() || ui->layout_height != GetScreenHeight())
+        layout_ui(ui, GetScreenWidth(), GetScreenHeight());
+
     BeginDrawing();
     ClearBackground(BLACK);
 
@@ -386,173 +938,118 @@ void draw_game(Game *game)
     {
     case MAIN_MENU_SCENE:
     {
-        DrawText("Project Red", SCREEN_WIDTH / 2 - MeasureText("Project Red", 40) / 2, SCREEN_HEIGHT / 3, 40, RED);
-
-        float buttonWidth = 200;
-        float buttonHeight = 50;
-        float buttonX = (SCREEN_WIDTH - buttonWidth) / 2.0f;
-        float buttonY = SCREEN_HEIGHT * 0.75f - (buttonHeight / 2.0f);
-        Rectangle startButtonRect = {buttonX, buttonY, buttonWidth, buttonHeight};
-
-        GuiButton(startButtonRect, "Start Game");
+        run_main_menu_ui(game);
     }
     break;
     case PLANET_SCENE:
     {
-        char netWorthText[50];
-        sprintf(netWorthText, "Net Worth: $%llu", game->data.player.net_worth);
-        DrawText(netWorthText, 20, 20, 20, GREEN);
-
-        DrawText("Select a City", 50, 60, 30, WHITE);
-
-        // Back to main menu button
-        Rectangle backButtonRect = {SCREEN_WIDTH - 220, 20, 200, 50};
-        GuiButton(backButtonRect, "Back to Main Menu");
-
         BeginMode3D(game->camera);
         DrawModel(game->data.assets.planet, (Vector3){0, 0, 0}, 1.0f, WHITE);
         EndMode3D();
 
-        float buttonWidth = 200;
-        float buttonHeight = 50;
-        float buttonSpacing = 20;
-        float startY = 100;
-
-        for (int i = 0; i < MAX_CITIES; i++)
-        {
-            City *city = &game->data.cities[i];
-            Rectangle cityBtnRect = {50, startY + (buttonHeight + buttonSpacing) * i, buttonWidth, buttonHeight};
-
-            char buttonText[100];
-            if (city->is_unlocked)
-            {
-                sprintf(buttonText, "Go to %s", get_city_name(city->name_id));
-                GuiButton(cityBtnRect, buttonText);
-            }
-            else
-            {
-                sprintf(buttonText, "Unlock %s ($%llu)", get_city_name(city->name_id), city->price_to_unlock);
-
-                if (game->data.player.net_worth < city->price_to_unlock)
-                {
-                    GuiSetStyle(BUTTON, TEXT_COLOR_NORMAL, 0xE74C3CFF);
-                    GuiButton(cityBtnRect, buttonText);
-                    GuiSetStyle(BUTTON, TEXT_COLOR_NORMAL, 0xFFFFFFFF);
-                }
-                else
-                {
-                    GuiButton(cityBtnRect, buttonText);
-                }
-            }
-        }
+        run_planet_ui(game);
     }
     break;
     case CITY_SCENE:
     {
-        const float spacing = 0.1f;
-        const int floorGridSize = 20;
-        const float floorCubeSize = 2.0f;
-        const float gridSpan = (floorGridSize * (floorCubeSize + spacing)) / 2.0f;
+        const float spacing = FLOOR_SPACING;
+        const float floorCubeSize = FLOOR_CUBE_SIZE;
+
+        City *city = &game->data.cities[game->state.current_city];
+        update_city_floor(game, game->state.current_city);
 
         BeginMode3D(game->camera);
 
-        City *city = &game->data.cities[game->state.current_city];
-        for (int j = 0; j < city->current_building_count; j++)
+        RenderQueue *queue = &game->data.render_queue;
+        render_queue_begin(queue, game->camera);
+        Frustum frustum = get_view_frustum();
+        queue_city_floor(game, game->state.current_city, &frustum, queue);
+        queue_city_buildings(game, game->state.current_city, &frustum, queue);
+
+        const float cellSize = floorCubeSize + spacing;
+        const Building *selected = city_get_building(city, game->state.selected_building_id);
+        if (selected && selected->id != -1)
         {
-            Building *building = &city->buildings[j];
-            if (building->id >= 0)
-            {
-                DrawModelEx(building->template.model, Vector3Add(building->position, (Vector3){0, 0, 0}),
-                            (Vector3){0, 1, 0}, building->rotation_angle,
-                            (Vector3){0.2f, 0.2f, 0.2f}, WHITE);
-            }
+            const Footprint *footprint = get_footprint(selected->template.type, selected->rotation_angle);
+            queue_cube_wires(queue, Vector3Add(selected->position, (Vector3){0, floorCubeSize / 2.0f, 0}),
+                             (Vector3){footprint->width * cellSize + 0.1f, floorCubeSize + 0.1f, footprint->height * cellSize + 0.1f}, SKYBLUE);
         }
 
-        if (game->state.is_building_placement_mode)
+        const Building *hovered = city_get_building(city, game->state.hovered_building_id);
+        if (hovered && hovered->id != -1)
         {
-            Model previewModel = game->data.building_templates[game->state.selected_building_type_to_place].model;
-            Color previewColor = {255, 255, 255, 128};
-            DrawModelEx(previewModel, Vector3Add(game->state.building_placement_position, (Vector3){0, 0, 0}),
-                        (Vector3){0, 1, 0}, game->state.building_placement_rotation_angle,
-                        (Vector3){0.2f, 0.2f, 0.2f}, previewColor);
+            const Footprint *footprint = get_footprint(hovered->template.type, hovered->rotation_angle);
+            queue_cube_wires(queue, Vector3Add(hovered->position, (Vector3){0, floorCubeSize / 2.0f, 0}),
+                             (Vector3){footprint->width * cellSize, floorCubeSize, footprint->height * cellSize}, YELLOW);
         }
 
-        for (int x = 0; x < floorGridSize; x++)
+        if (game->state.is_building_placement_mode && game->state.is_dragging_placement)
         {
-            for (int z = 0; z < floorGridSize; z++)
+            const PlacementBatch *batch = &game->state.placement_batch;
+            const Footprint *footprint = get_footprint(batch->building_type, batch->rotation_angle);
+            const Model *previewModel = &game->data.building_templates[batch->building_type].model;
+            for (uint32_t i = 0; i < batch->count; i++)
             {
-                Vector3 cubePos = {
-                    x * (floorCubeSize + spacing) - gridSpan,
-                    -floorCubeSize / 2.0f, // Center the cube so its top is at Y=0
-                    z * (floorCubeSize + spacing) - gridSpan};
-                DrawCube(cubePos, floorCubeSize, floorCubeSize, floorCubeSize, DARKGRAY);
-                DrawCubeWires(cubePos, floorCubeSize, floorCubeSize, floorCubeSize, BLACK);
+                Vector3 previewPosition = city_grid_footprint_center(city, batch->building_type, batch->grid_x[i], batch->grid_z[i],
+                                                                     batch->rotation_angle);
+                queue_cube_wires(queue, Vector3Add(previewPosition, (Vector3){0, 0.05f, 0}),
+                                 (Vector3){footprint->width * cellSize, 0.1f, footprint->height * cellSize}, batch->is_valid[i] ? GREEN : RED);
+                if (batch->is_valid[i])
+                {
+                    queue_model(queue, RENDER_LAYER_TRANSPARENT, previewModel, previewPosition, batch->rotation_angle,
+                                BUILDING_MODEL_SCALE, (Color){255, 255, 255, 128});
+                }
             }
         }
-
-        EndMode3D();
-
-        char netWorthText[50];
-        sprintf(netWorthText, "Net Worth: $%llu", game->data.player.net_worth);
-        DrawText(netWorthText, 20, 20, 20, GREEN);
-
-        char cityText[50];
-        sprintf(cityText, "Current City: %s", get_city_name(game->data.cities[game->state.current_city].name_id));
-        DrawText(cityText, 20, 50, 20, WHITE);
-
-        float buttonWidth = 200;
-        float buttonHeight = 50;
-        float buttonX = SCREEN_WIDTH - buttonWidth - 20;
-        float buttonY = 20;
-        Rectangle goToPlanetButtonRect = {buttonX, buttonY, buttonWidth, buttonHeight};
-        GuiButton(goToPlanetButtonRect, "Return to Planet");
-
-        char smallRestText[50], mediumRestText[50], largeRestText[50];
-        sprintf(smallRestText, "Small Restaurant ($%u)", game->data.building_templates[0].base_cost);
-        sprintf(mediumRestText, "Medium Restaurant ($%u)", game->data.building_templates[1].base_cost);
-        sprintf(largeRestText, "Large Restaurant ($%u)", game->data.building_templates[2].base_cost);
-
-        Rectangle buildingModeRect = {20, 80, 250, 30};
-        if (game->data.player.net_worth < game->data.building_templates[0].base_cost)
-        {
-            GuiSetStyle(BUTTON, TEXT_COLOR_NORMAL, 0xE74C3CFF);
-            GuiButton(buildingModeRect, smallRestText);
-            GuiSetStyle(BUTTON, TEXT_COLOR_NORMAL, 0xFFFFFFFF);
-        }
-        else
+        else if (game->state.is_building_placement_mode)
         {
-            GuiButton(buildingModeRect, smallRestText);
-        }
+            BuildingType placeType = game->state.selected_building_type_to_place;
+            float placeAngle = game->state.building_placement_rotation_angle;
+            const Model *previewModel = &game->data.building_templates[placeType].model;
+            Color previewColor = {255, 255, 255, 128};
+            Vector3 previewPosition = game->state.building_placement_position;
 
-        Rectangle buildingModeRect2 = {20, 120, 250, 30};
-        if (game->data.player.net_worth < game->data.building_templates[1].base_cost)
-        {
-            GuiSetStyle(BUTTON, TEXT_COLOR_NORMAL, 0xE74C3CFF);
-            GuiButton(buildingModeRect2, mediumRestText);
-            GuiSetStyle(BUTTON, TEXT_COLOR_NORMAL, 0xFFFFFFFF);
-        }
-        else
-        {
-            GuiButton(buildingModeRect2, mediumRestText);
+            int cornerX, cornerZ;
+            if (city_grid_find_corner(city, placeType, game->state.building_placement_position, placeAngle, &cornerX, &cornerZ))
+            {
+                const Footprint *footprint = get_footprint(placeType, placeAngle);
+                bool canPlace = city_grid_can_place(city, placeType, game->state.building_placement_position, placeAngle);
+                previewPosition = city_grid_footprint_center(city, placeType, cornerX, cornerZ, placeAngle);
+                if (!canPlace)
+                    previewColor = (Color){230, 41, 55, 128}; // footprint overlaps a building
+
+                queue_cube_wires(queue, Vector3Add(previewPosition, (Vector3){0, 0.05f, 0}),
+                                 (Vector3){footprint->width * cellSize, 0.1f, footprint->height * cellSize}, canPlace ? GREEN : RED);
+            }
+            else
+            {
+                previewColor = (Color){230, 41, 55, 128}; // off the edge of the map
+            }
+            queue_model(queue, RENDER_LAYER_TRANSPARENT, previewModel, previewPosition, game->state.building_placement_rotation_angle,
+                        BUILDING_MODEL_SCALE, previewColor);
         }
 
-        Rectangle buildingModeRect3 = {20, 160, 250, 30};
-        if (game->data.player.net_worth < game->data.building_templates[2].base_cost)
+        CustomerPool *customers = &game->data.sim.customers;
+        for (uint32_t c = 0; c < customers->chunk_count; c++)
         {
-            GuiSetStyle(BUTTON, TEXT_COLOR_NORMAL, 0xE74C3CFF);
-            GuiButton(buildingModeRect3, largeRestText);
-            GuiSetStyle(BUTTON, TEXT_COLOR_NORMAL, 0xFFFFFFFF);
-        }
-        else
-        {
-            GuiButton(buildingModeRect3, largeRestText);
+            CustomerChunk *chunk = customers->chunks[c];
+            for (uint32_t k = 0; k < chunk->count; k++)
+            {
+                Customer *customer = &chunk->customers[k];
+                BoundingBox box = {Vector3Add(customer->position, (Vector3){-0.15f, 0, -0.15f}),
+                                   Vector3Add(customer->position, (Vector3){0.15f, 0.6f, 0.15f})};
+                if (!frustum_test_box(&frustum, box))
+                    continue;
+
+                Color color = (customer->state == CUSTOMER_STATE_EATING) ? ORANGE : SKYBLUE;
+                queue_cube(queue, Vector3Add(customer->position, (Vector3){0, 0.3f, 0}), (Vector3){0.3f, 0.6f, 0.3f}, color);
+            }
         }
 
-        if (game->state.is_building_placement_mode)
-        {
-            DrawText("Click to place building. Right-click to cancel.", 20, 200, 20, WHITE);
-            DrawText("Press R to rotate.", 20, 225, 20, WHITE);
-        }
+        render_queue_submit(game, queue);
+        EndMode3D();
+
+        run_city_ui(game);
     }
     break;
     case GAME_OVER_SCENE:
@@ -572,14 +1069,28 @@ void draw_game(Game *game)
 
 void clean_up(Game *game)
 {
+    cancel_placement_preview(game);
+    clean_up_companies(game);
+    clean_up_city_generation(game);
+    jobs_shutdown();
+    clean_up_simulation(game);
+    unload_city_floors(game);
+    unload_building_renderer(game);
     for (int i = 0; i < MAX_CITIES; i++)
-    {
-        UnloadModel(game->data.assets.cities_model[i]);
-    }
+        building_bvh_free(game->data.cities[i].bvh);
+    arena_free(&game->arena);
+
+    for (int i = 0; i < TEMPLATE_COUNT; i++)
+        unload_voxel_shape(&game->data.assets.building_shapes[i]);
 
     UnloadModel(game->data.assets.small_restaurant_model);
     UnloadModel(game->data.assets.medium_restaurant_model);
     UnloadModel(game->data.assets.large_restaurant_model);
+    for (int i = 0; i < TEMPLATE_COUNT; i++)
+    {
+        for (int lod = 0; lod < game->data.assets.building_lod_counts[i]; lod++)
+            UnloadModel(game->data.assets.building_lods[i][lod]);
+    }
     UnloadModel(game->data.assets.planet);
 
     UnloadTexture(game->data.assets.intro_texture);
@@ -587,35 +1098,41 @@ void clean_up(Game *game)
     CloseWindow();
 }
 
-void place_building(City *city, BuildingType type, Vector3 position, BuildingTemplate template, float rotation_angle)
+int32_t place_building(City *city, Vector3 position, BuildingTemplate template, float rotation_angle)
 {
-    int building_index = -1;
-    for (int i = 0; i < MAX_BUILDINGS_PER_CITY; i++)
-    {
-        if (city->buildings[i].id == -1)
-        {
-            building_index = i;
-            break;
-        }
-    }
+    return place_building_in_slot(city, city_alloc_building_slot(city), position, template, rotation_angle);
+}
 
+int32_t place_building_in_slot(City *city, int32_t building_index, Vector3 position, BuildingTemplate template, float rotation_angle)
+{
     if (building_index == -1)
-        return;
-
-    city->buildings[building_index].current_staff_count = 0;
-    city->buildings[building_index].id = building_index;
-    city->buildings[building_index].is_operational = false;
-    city->buildings[building_index].position = position;
-    city->buildings[building_index].template = template;
-    city->buildings[building_index].rotation_angle = rotation_angle;
+        return -1;
+
+    Building *building = city_get_building_mut(city, building_index);
+    if (!building)
+        return -1;
+
+    building->current_staff_count = 0;
+    building->id = building_index;
+    building->is_operational = false;
+    building->position = position;
+    building->template = template;
+    building->rotation_angle = rotation_angle;
+
+    BuildingFlow *flow = &city->flows[building_index];
+    *flow = (BuildingFlow){0};
+    flow->demand = 1.0f;  // until the demand field has been sampled
+    flow->synergy = 1.0f; // until the synergy field catches up
+    flow->rng_state = 0x9E3779B97F4A7C15ULL * (uint64_t)(building_index + 1) ^
+                      (uint64_t)(int64_t)(position.x * 31.0f + position.z * 17.0f);
 
     for (size_t i = 0; i < MAX_STAFF_PER_BUILDING; i++)
     {
-        city->buildings[building_index].assigned_staff[i] = NULL;
+        building->assigned_staff[i] = NULL;
     }
+
+    flow->rates_revision = 0; // rates are filled in by the next sim tick
+    return building_index;
 }
 
-void hire_staff() {}
-void sell_staff() {}
-void assign_staff() {}
 void collect_money() {}
@@ -3,6 +3,7 @@
 
 #include "raylib.h"
 #include "raymath.h"
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,15 +13,106 @@
 /* ========== GAME CONSTANTS ========== */
 
 #define MAX_STAFF_PER_BUILDING 15
-#define MAX_BUILDINGS_PER_CITY 20
+#define BUILDING_CHUNK_CAPACITY 64
+#define MAX_BUILDING_CHUNKS 64
+#define MAX_BUILDINGS_PER_CITY (BUILDING_CHUNK_CAPACITY * MAX_BUILDING_CHUNKS)
 #define MAX_CITIES 4
-#define MAX_STAFF_OWNED 1000
+#define MAX_STAFF_OWNED 1000 // staff employed by every company
+#define MAX_COMPANIES 13     // the player plus up to 12 rival chains
+#define PLAYER_COMPANY_ID 0
 
 #define SCREEN_WIDTH 1920
 #define SCREEN_HEIGHT 1080
 
 #define ARENA_SIZE (10 * 1024 * 1024) // 10 MB
 
+#define SIM_TICK_RATE 20                      // fixed simulation ticks per second
+#define SIM_TICK_DT (1.0f / SIM_TICK_RATE)    // seconds per simulation tick
+#define SIM_MAX_TICKS_PER_FRAME 8             // catch-up limit after a long frame
+#define SIM_DAY_LENGTH 120.0f                 // real seconds per in-game day
+#define SIM_DAY_START 0.3f                    // time of day at tick 0, shortly after sunrise
+#define SIM_QUEUE_SMOOTHING 5.0f              // seconds for avg_queue to converge
+
+#define CUSTOMER_CHUNK_CAPACITY 256
+#define MAX_CUSTOMER_CHUNKS 64 // 16k live agents for the visible city
+#define CUSTOMER_MAX_QUEUE 12  // customers balk when the queue is longer
+#define CUSTOMER_WALK_SPEED 3.0f
+#define CUSTOMER_SPAWN_RADIUS 15.0f
+#define CUSTOMER_EAT_TIME 6.0f
+#define CUSTOMER_TRAVEL_TIME (CUSTOMER_SPAWN_RADIUS / CUSTOMER_WALK_SPEED)
+
+#define JOB_WORKER_COUNT 3
+#define JOB_QUEUE_CAPACITY 64
+
+#define DEMAND_UPDATE_RATE 5                       // field steps per second (the sim ticks at 20)
+#define DEMAND_DT (1.0f / DEMAND_UPDATE_RATE)
+#define DEMAND_TILE_SIZE 16                        // cells per side of a dirty-tracking tile
+#define DEMAND_DIFFUSION 0.5f                      // cells^2 per second
+#define DEMAND_DECAY 0.02f                         // share of demand that fades per second
+#define DEMAND_CAPTURE 0.1f                        // demand a restaurant eats per unit of customer_rate
+#define DEMAND_SLEEP_EPSILON 1e-4f                 // tiles changing less than this stop updating
+#define DEMAND_BUILDING_EPSILON 0.01f              // demand change that makes a building refresh its rates
+#define DEMAND_MAX_TILES ((MAP_SIZE_LARGE / DEMAND_TILE_SIZE) * (MAP_SIZE_LARGE / DEMAND_TILE_SIZE))
+
+#define SYNERGY_RADIUS 6                // cells on each side of a building that count as its neighborhood
+#define SYNERGY_CROWDING_WEIGHT 0.15f   // customers lost per unit of neighboring crowding
+#define SYNERGY_APPEAL_WEIGHT 1.0f      // customers gained per unit of neighboring appeal
+#define SYNERGY_MIN 0.5f
+#define SYNERGY_MAX 1.5f
+
+#define FOOTPRINT_MAX_SIZE 4 // cells per side of the largest building footprint
+#define GRID_ROTATION_COUNT 4
+
+#define GRID_CHUNK_SIZE 32 // cells per side of a grid chunk
+#define MAX_GRID_CHUNKS ((MAP_SIZE_LARGE / GRID_CHUNK_SIZE) * (MAP_SIZE_LARGE / GRID_CHUNK_SIZE))
+
+#define TERRAIN_OCTAVES 4          // noise octaves, each at half the period of the last
+#define TERRAIN_BASE_PERIOD 64     // cells per noise lattice cell in the coarsest octave
+#define TERRAIN_BLOCK_HEIGHT 0.45f // ground above this is too rough to build on
+#define TERRAIN_CLEAR_RADIUS 0.15f // share of the city size around the middle that stays buildable
+#define TERRAIN_HEIGHT_SCALE 4.0f  // world units of rock per unit of noise above TERRAIN_BLOCK_HEIGHT
+#define TERRAIN_HEIGHT_STEP 0.5f   // rock heights snap to this so neighbors merge into one quad
+
+#define CAMERA_PAN_SPEED 30.0f // world units per second
+#define CAMERA_ZOOM_STEP 0.1f  // share of the view height one wheel notch zooms
+#define CAMERA_MIN_FOVY 10.0f  // view height in world units (orthographic)
+#define CAMERA_MAX_FOVY 120.0f
+
+#define FLOOR_CUBE_SIZE 2.0f
+#define FLOOR_SPACING 0.1f
+
+#define STAFF_HIRE_FEE_DAYS 1.0f // signing fee, in days of salary
+#define STAFF_POACH_FEE_DAYS 3.0f
+#define STAFF_POACH_RAISE 1.2f   // poached staff get a salary bump
+
+#define AI_STARTING_FUNDS 20000
+#define AI_THINK_INTERVAL 10.0f       // seconds between rival decisions
+#define AI_PLAN_SLICE_SECONDS 0.0005  // worker time per planner per frame
+#define AI_PLAN_CHECK_INTERVAL 16     // cells scored between clock checks
+#define AI_FAILED_SITE_COUNT 16       // cells a rival remembers it couldn't build on
+
+#define EDIT_JOURNAL_CAPACITY 4096 // edits kept for undo; the oldest fall off
+#define DEMOLISH_REFUND 0.5f       // share of base_cost paid back on demolition
+#define MAX_PLACEMENT_BATCH 1024   // buildings one drag can place
+
+#define BUILDING_MODEL_SCALE 0.2f // DrawModelEx scale of every building model
+#define BVH_MAX_LEVELS 8          // node levels above the leaves of a building BVH
+#define FRUSTUM_PLANE_COUNT 6
+#define MAX_RENDER_ITEMS (MAX_CUSTOMER_CHUNKS * CUSTOMER_CHUNK_CAPACITY + 4096) // every agent and then some
+#define RENDER_MAX_DEPTH 1000.0f // far plane of the city camera
+#define MAX_VOXEL_LODS 3           // coarser levels per voxel model
+#define LOD_VOXEL_PIXELS 4.0f      // on-screen voxel size a coarser level may reach
+#define LOD_HYSTERESIS 0.25f       // share of a level the view must pass a switch point by
+#define MAX_LABEL_LENGTH 128       // bytes of a cached HUD label, terminator included
+#define TEXT_LABEL_KEY_SIZE 32     // bytes of the value a label is made from
+#define UI_TEXT_COLOR 0xFFFFFFFF         // raygui button text
+#define UI_WARNING_TEXT_COLOR 0xE74C3CFF // can't afford it
+#define UI_DISABLED_TEXT_COLOR 0x808080FF
+
+#define PREVIEW_DAYS 3              // in-game days a placement preview simulates
+#define PREVIEW_NEIGHBOR_RADIUS 12.0f // buildings closer than this count as neighbors
+#define PREVIEW_DEMAND_MARGIN 10      // cells of demand copied around the neighborhood
+
 #define CAMERA_DISTANCE 50.0f                 // only for clipping
 #define CAMERA_ANGLE 35.264f * DEG2RAD        // 35.264° = arctan(1/sqrt(2))
 #define CAMERA_ROTATION_ANGLE 45.0f * DEG2RAD // 45° rotation around vertical axis
@@ -79,14 +171,46 @@ typedef enum
     RARITY_COUNT
 } StaffRarity;
 
+typedef enum
+{
+    PERK_SECRET_SAUCE,
+    PERK_FLAGSHIP_KITCHENS,
+    PERK_DRIVE_THRU_TUBES,
+    PERK_BULK_BUYING,
+    PERK_COOK_ACADEMY,
+    PERK_SERVER_TRAINING,
+    PERK_TALENT_SCOUTS,
+    PERK_UNION_DEAL,
+    PERK_COUNT
+} PerkId;
+
+typedef enum
+{
+    MODIFIER_REVENUE,    // money per customer
+    MODIFIER_CUSTOMERS,  // customer arrival rate
+    MODIFIER_UPKEEP,     // building maintenance
+    MODIFIER_EFFICIENCY, // staff efficiency
+    MODIFIER_SALARY,     // staff salary
+    MODIFIER_STAT_COUNT
+} ModifierStat;
+
 typedef enum
 {
     CUSTOMER_STATE_IDLE,
-    CUSTOMER_STATE_MOVING,
+    CUSTOMER_STATE_MOVING,  // walking to the restaurant
+    CUSTOMER_STATE_QUEUED,  // waiting to be served
     CUSTOMER_STATE_EATING,
+    CUSTOMER_STATE_LEAVING, // walking back out of the city
 
 } CustomerState;
 
+typedef enum
+{
+    SIM_LOD_AGGREGATE, // flow rates and average queues, O(buildings) per tick
+    SIM_LOD_FULL       // individual customer agents, O(agents) per tick
+
+} SimLod;
+
 typedef enum
 {
     MAIN_MENU_SCENE,
@@ -106,15 +230,86 @@ typedef enum
 
 } GridCellType;
 
+// Systems that keep derived data per grid chunk. Changing a cell sets every
+// flag on its chunk; each system clears its own flag once it has caught up.
+typedef enum
+{
+    GRID_DIRTY_RENDER = 1 << 0,  // terrain mesh
+    GRID_DIRTY_DEMAND = 1 << 1,  // restaurant sinks in the demand field
+    GRID_DIRTY_OVERLAY = 1 << 2, // demand map colors, also set by the demand field itself
+    GRID_DIRTY_ALL = GRID_DIRTY_RENDER | GRID_DIRTY_DEMAND | GRID_DIRTY_OVERLAY
+
+} GridDirtyFlags;
+
+typedef enum
+{
+    CITY_TERRAIN_NONE,       // nobody has bought into the city yet
+    CITY_TERRAIN_GENERATING, // a worker is building it; nothing can be placed
+    CITY_TERRAIN_READY
+
+} CityTerrainState;
+
+typedef enum
+{
+    CMD_UNLOCK_CITY,
+    CMD_PLACE_BUILDING,
+    CMD_HIRE_STAFF,
+    CMD_ASSIGN_STAFF,
+    CMD_POACH_STAFF,
+    CMD_ROTATE_BUILDING,
+    CMD_DEMOLISH_BUILDING,
+    CMD_PLACE_BUILDINGS
+
+} CommandType;
+
+typedef enum
+{
+    EDIT_PLACE,
+    EDIT_DEMOLISH,
+    EDIT_ROTATE,
+    EDIT_ASSIGN_STAFF // also unassignment, as an assignment to building -1
+
+} EditType;
+
+typedef enum
+{
+    AI_PLANNER_IDLE,
+    AI_PLANNER_RUNNING, // scoring cells in slices on a worker
+    AI_PLANNER_DONE     // best cell ready to be turned into a command
+
+} AiPlannerPhase;
+
 /* ========== GAME DATA ========== */
 
+// Solid cells of a MagicaVoxel model in the axes of the mesh built from it
+// (y up), stretched over that mesh's bounds.
+typedef struct
+{
+    int32_t size_x, size_y, size_z;
+    uint8_t *cells; // palette index, 0 where empty
+    Vector3 mesh_min;  // mesh-space corner of cell (0, 0, 0)
+    Vector3 cell_size; // mesh-space size of one cell
+    Color palette[256]; // by palette index
+    bool has_palette;
+
+} VoxelShape;
+
 typedef struct
 {
     BuildingType type;
     uint8_t staff_capacity;
     uint32_t base_cost;
-    uint32_t maintenance_cost;
+    uint32_t maintenance_cost; // per in-game day
+    uint32_t meal_price;
+    float customer_rate; // customers per second drawn to the building
+    float service_rate;  // customers per second served without staff
+    float crowding;      // competition felt by restaurants in the neighborhood
+    float appeal;        // land value added to the neighborhood
     Model model;
+    BoundingBox model_bounds;  // mesh space, before BUILDING_MODEL_SCALE
+    const VoxelShape *shape;   // solid voxels of the model, for exact picking (NULL if unknown)
+    const Model *lods;         // coarser versions of the model, each with half the voxels of the last
+    int32_t lod_count;
 
 } BuildingTemplate;
 
@@ -128,30 +323,253 @@ typedef struct
     CityId home_city_id;
     StaffRarity rarity;
     float base_efficiency;
+    bool is_employed;
+    uint8_t employer_id; // company paying the salary
 
 } Staff;
 
+// Statistical state of a building's customer flow. Both LOD levels read and
+// write it, so a city can switch between agents and the aggregate model
+// without losing its queues or its income. The tick writes every building's
+// flow, so flows live in an array per city next to the building chunks
+// rather than in them, and snapshots copy them instead of sharing them.
+typedef struct
+{
+    float arrival_rate;   // customers per second heading to the building
+    float service_rate;   // customers per second the building can serve
+    float avg_queue;      // smoothed queue length
+    float next_arrival;   // seconds until the next agent spawns (full LOD)
+    float service_credit; // fractional customers served (full LOD)
+    float revenue_carry;  // fractional dollars not yet paid out
+    float upkeep_carry;   // fractional maintenance not yet paid
+    float served_total;   // customers served since placement
+    float staff_efficiency; // summed efficiency of the assigned staff, with perks
+    float payroll;        // staff salaries per in-game day
+    uint32_t rates_revision; // ModifierTables revision the rates were computed with (0 = stale)
+    float demand;         // demand field sample at the building's cell (1 = average)
+    float synergy;        // neighborhood bonus from the synergy field (1 = none)
+    uint64_t rng_state;   // per-building stream, so forks only diverge where they differ
+    uint16_t queue_count;  // live agents waiting (full LOD)
+    uint16_t eating_count; // live agents eating (full LOD)
+
+} BuildingFlow;
+
 typedef struct
 {
     BuildingTemplate template;
     uint32_t id;
-    Vector3 position;
+    uint8_t owner_id; // company that placed the building
+    int32_t grid_x;   // footprint corner on the city grid
+    int32_t grid_z;
+    Vector3 position; // center of the footprint
     float rotation_angle;
     bool is_operational;
     Staff *assigned_staff[MAX_STAFF_PER_BUILDING];
     uint32_t current_staff_count;
+    uint16_t edit_holds; // undo journal entries that may put a building back in this slot
 
 } Building;
 
+// The building pool is split into refcounted chunks so a snapshot can share
+// it with the live game. Whoever writes to a chunk with refcount > 1 clones
+// it first (see cow_chunk_make_writable), so shared chunks are never modified.
+typedef struct
+{
+    atomic_int refcount;
+
+} ChunkHeader;
+
+typedef struct
+{
+    ChunkHeader header;
+    Building buildings[BUILDING_CHUNK_CAPACITY];
+
+} BuildingChunk;
+
+typedef struct
+{
+    uint8_t type;        // GridCellType
+    int32_t building_id; // building covering the cell (-1 if none)
+
+} GridCell;
+
+typedef struct
+{
+    GridCell cells[GRID_CHUNK_SIZE * GRID_CHUNK_SIZE];
+    uint8_t dirty; // GridDirtyFlags
+
+} GridChunk;
+
+// What stands on each cell of a city. Owned by the main thread: commands keep
+// it in sync with the building pool, snapshots share it but never read it.
+// Placement tests only touch the bit-packed copy; the chunks hold the handles
+// and tell other systems which parts of the city changed.
+typedef struct
+{
+    uint32_t size; // cells per side
+    uint32_t words_per_row;
+    uint64_t *occupied; // bit x of row z set when the cell isn't GRID_CELL_EMPTY
+    uint32_t chunks_per_side;
+    GridChunk *chunks;
+
+} OccupancyGrid;
+
+// The cells a building covers at one rotation, one bitmask per row of its
+// bounding box (bit x = cell x of the box).
+typedef struct
+{
+    uint8_t width;
+    uint8_t height;
+    int8_t offset_x; // box corner relative to the cell under the cursor
+    int8_t offset_z;
+    uint8_t cell_count;
+    uint64_t rows[FOOTPRINT_MAX_SIZE];
+
+} Footprint;
+
+typedef enum
+{
+    DEMAND_TILE_ASLEEP,   // settled, identical in both buffers
+    DEMAND_TILE_SETTLING, // settled this step, back buffer still needs a copy
+    DEMAND_TILE_ACTIVE
+
+} DemandTileState;
+
+// Hunger for food across a city's grid. Population injects demand,
+// restaurants eat it and it diffuses between cells. Cells are stored with a
+// one cell border so the stencil never branches on the edges.
+typedef struct
+{
+    uint32_t size;   // cells per side
+    uint32_t stride; // size + 2
+    float *front;    // last finished step, read by everyone
+    float *back;     // written by the next step
+    float *retain;   // per-cell share of demand kept each step (decay, diffusion and restaurant sinks)
+    float *inject;   // per-cell demand added each step by population
+    uint8_t *tile_state; // DemandTileState per DEMAND_TILE_SIZE tile
+    uint32_t tiles_per_side;
+    uint32_t active_tiles; // tiles recomputed by the last step
+
+} DemandField;
+
+// A square of a demand field copied out for a placement preview, so a
+// worker can step it with the candidate's draw added. The border cells keep
+// the values they were copied with.
+typedef struct
+{
+    uint32_t field_size; // cells per side of the field it came from
+    int32_t x0, z0;      // field cell under the first cell inside the border
+    uint32_t width;      // cells inside the border
+    uint32_t height;
+    uint32_t stride;     // width + 2
+    float *cells;        // malloc'd block the four arrays below live in
+    float *front;
+    float *back;
+    float *retain;
+    float *inject;
+
+} DemandWindow;
+
+typedef enum
+{
+    SYNERGY_CROWDING,
+    SYNERGY_APPEAL,
+    SYNERGY_CHANNEL_COUNT
+
+} SynergyChannel;
+
+// Neighborhood effects as box sums over the grid. Each building spreads its
+// template's crowding and appeal over its footprint cells; a cell's sum is
+// the total within SYNERGY_RADIUS of it. Adding or removing a building only
+// invalidates the sums in a rectangle around it, and only that rectangle is
+// recomputed.
+typedef struct
+{
+    uint32_t size; // cells per side
+    float *sources[SYNERGY_CHANNEL_COUNT];
+    float *sums[SYNERGY_CHANNEL_COUNT];
+    float *row_sums; // horizontal pass, size * size
+    int32_t dirty_x0, dirty_z0, dirty_x1, dirty_z1; // stale cells, inclusive (empty when x1 < x0)
+
+} SynergyField;
+
+// Four boxes side by side, so one SSE slab test checks them all. Unused
+// slots have min > max.
+typedef struct
+{
+    float min_x[4], min_y[4], min_z[4];
+    float max_x[4], max_y[4], max_z[4];
+    int32_t items[4]; // child node or leaf; building id in a leaf (-1 if unused)
+
+} BvhPacket;
+
+typedef struct
+{
+    BvhPacket *packets; // malloc'd, grows as buildings arrive
+    uint32_t count;     // buildings
+    uint32_t capacity;  // packets
+
+} BvhLeaf;
+
+// Bounding-volume hierarchy over a city's buildings for picking with the
+// mouse ray. Its shape is fixed by the grid: a leaf per grid chunk holding
+// the buildings centered in it, and a quadtree of 4-wide nodes above that.
+// Placing or removing a building only changes its leaf and refits the boxes
+// on the way up.
+typedef struct
+{
+    uint32_t city_size;
+    uint32_t chunks_per_side;
+    uint32_t level_count;
+    uint32_t level_sides[BVH_MAX_LEVELS];
+    BvhPacket *levels[BVH_MAX_LEVELS]; // levels[0] sits right above the leaves
+    BvhLeaf *leaves;                   // one per grid chunk
+    int32_t *building_leaf;            // leaf per building slot (-1 if none)
+    uint32_t revision;                 // bumped on every change
+
+} BuildingBvh;
+
+// Planes of the view volume, normals pointing in, laid out plane by plane
+// so a test can load one plane for four boxes.
+typedef struct
+{
+    float normal_x[FRUSTUM_PLANE_COUNT];
+    float normal_y[FRUSTUM_PLANE_COUNT];
+    float normal_z[FRUSTUM_PLANE_COUNT];
+    float distance[FRUSTUM_PLANE_COUNT];
+
+} Frustum;
+
+// How much of a grid chunk's buildings the view takes in.
+typedef enum
+{
+    CHUNK_HIDDEN,
+    CHUNK_CROSSING, // on the edge of the view: its buildings need testing one by one
+    CHUNK_INSIDE
+
+} ChunkVisibility;
+
 typedef struct
 {
     CityId name_id;
     bool is_unlocked;
     uint64_t price_to_unlock;
     uint32_t current_building_count;
-    Model city_model;
-
-    Building buildings[MAX_BUILDINGS_PER_CITY];
+    uint32_t company_mask; // bit per company that has bought into the city
+    SimLod lod;
+    uint32_t size; // cells per side (CitySizes)
+    uint64_t seed; // same seed, same city
+    uint8_t terrain_state; // CityTerrainState
+    float *terrain_height; // per cell, NULL until the terrain is generated
+    OccupancyGrid grid;
+    DemandField *demand;
+    SynergyField *synergy;
+    BuildingBvh *bvh;
+    uint32_t lights_revision; // bumped when a building opens or closes
+
+    BuildingChunk *building_chunks[MAX_BUILDING_CHUNKS];
+    uint32_t building_chunk_count;
+    BuildingFlow *flows; // one per building slot, malloc'd; never shared
 } City;
 
 typedef struct
@@ -160,6 +578,263 @@ typedef struct
 
 } Planet;
 
+// A perk scales one stat for every (role, rarity, building type) matched by
+// its masks. A mask of 0 matches everything.
+typedef struct
+{
+    const char *name;
+    uint32_t cost;
+    int32_t requires; // prerequisite PerkId (-1 if none)
+    ModifierStat stat;
+    uint8_t role_mask;   // bit per StaffRole
+    uint8_t rarity_mask; // bit per StaffRarity
+    uint8_t type_mask;   // bit per BuildingType
+    float multiplier;
+
+} PerkDefinition;
+
+typedef struct
+{
+    uint32_t unlocked_mask; // bit per PerkId
+
+} SkillTree;
+
+typedef struct
+{
+    float revenue_per_customer;
+    float customer_multiplier;
+    float upkeep_per_second;
+
+} BuildingEconomy;
+
+// Perks compiled into flat lookup tables. Rebuilt only when the skill tree
+// changes; the sim reads one BuildingEconomy per building per tick and uses
+// the staff tables only when a building's rates are refreshed.
+typedef struct
+{
+    uint32_t revision;
+    BuildingEconomy economy[TEMPLATE_COUNT];
+    float efficiency[ROLE_COUNT][RARITY_COUNT][TEMPLATE_COUNT];
+    float salary[ROLE_COUNT][RARITY_COUNT][TEMPLATE_COUNT];
+
+} ModifierTables;
+
+typedef struct
+{
+    Vector3 position;
+    Vector3 destination;
+    int32_t building_id;
+    CustomerState state;
+    float timer;
+
+} Customer;
+
+typedef struct
+{
+    uint32_t count;
+    Customer customers[CUSTOMER_CHUNK_CAPACITY];
+
+} CustomerChunk;
+
+// Agents only exist for the visible city, so a single pool is shared by all
+// cities and refilled whenever the player enters one.
+typedef struct
+{
+    CustomerChunk *chunks[MAX_CUSTOMER_CHUNKS];
+    uint32_t chunk_count;
+    uint32_t total;
+
+} CustomerPool;
+
+typedef struct
+{
+    uint64_t tick;
+    uint64_t rng_state;
+    float accumulator;
+    float demand_accumulator;
+    int32_t visible_city; // city simulated with live agents (-1 if none)
+    ModifierTables modifiers;       // the player's perks
+    ModifierTables rival_modifiers; // rival chains have no skill tree
+    CustomerPool customers;
+
+} Simulation;
+
+// A what-if copy of the simulation. City headers and building flows are
+// copied, the building chunks behind them are shared until either side
+// writes. Forks run every city on the aggregate model, so they have no agents.
+typedef struct
+{
+    uint64_t funds[MAX_COMPANIES];
+    Simulation sim;
+    City cities[MAX_CITIES];
+
+} SimFork;
+
+typedef void (*JobFunction)(void *data);
+
+typedef struct
+{
+    JobFunction function;
+    void *data;
+    atomic_bool done;
+
+} Job;
+
+typedef struct
+{
+    bool is_valid;
+    int64_t profit_per_day;     // projected income minus upkeep of the new building
+    float payback_days;         // days until base_cost is earned back (INFINITY if never)
+    float neighbor_customers_delta; // customers per day gained (+) or lost (-) by nearby restaurants
+    uint32_t neighbor_count;
+
+} PreviewResult;
+
+// Buildings a drag would place, checked against the grid and the company's
+// funds. Entries step by the footprint's bounding box, so they never overlap
+// each other.
+typedef struct
+{
+    int32_t city_index;
+    BuildingType building_type;
+    float rotation_angle;
+    uint32_t count;
+    uint32_t valid_count; // entries that fit and can still be paid for
+    uint64_t total_cost;  // of the valid entries
+    int16_t grid_x[MAX_PLACEMENT_BATCH]; // footprint corners
+    int16_t grid_z[MAX_PLACEMENT_BATCH];
+    bool is_valid[MAX_PLACEMENT_BATCH];
+
+} PlacementBatch;
+
+// Every change a company makes to the world goes through a Command, for the
+// player and the rival AIs alike.
+typedef struct
+{
+    CommandType type;
+    uint8_t company_id;
+    int32_t city_index;
+    int32_t building_id;
+    int32_t staff_id;
+    BuildingType building_type;
+    StaffRole role;
+    Vector3 position;
+    float rotation_angle;
+    const PlacementBatch *batch; // CMD_PLACE_BUILDINGS
+
+} Command;
+
+typedef struct
+{
+    Vector3 position;
+    uint8_t owner_id;
+
+} AiPlanSite;
+
+typedef struct
+{
+    int32_t city_index;
+    int32_t cell;
+
+} AiFailedSite;
+
+// Scores candidate cells for a new building. The job reads only the site
+// and occupancy snapshots taken when planning started and runs a time-boxed
+// slice per frame.
+typedef struct
+{
+    Job job;
+    AiPlannerPhase phase;
+
+    uint8_t company_id;
+    int32_t city_index;
+    uint32_t grid_size; // cells per side of the city being planned
+    BuildingType building_type;
+    float aggression; // > 0 seeks out the player's restaurants, < 0 avoids them
+    AiPlanSite *sites;
+    uint32_t site_count;
+    OccupancyGrid occupancy; // copy of the city's occupancy bits (buildings and blocked terrain), no chunks
+
+    // Cells where a placement failed anyway, skipped by later plans. Kept
+    // across plans; the oldest is forgotten first.
+    AiFailedSite failed_sites[AI_FAILED_SITE_COUNT];
+    uint32_t failed_site_count;
+    uint32_t next_failed_site;
+
+    uint32_t next_cell;
+    uint32_t cell_count;
+    int32_t best_cell;
+    float best_score;
+
+} AiPlanner;
+
+typedef struct
+{
+    char name[32];
+    bool is_active;
+    bool is_ai;
+    Color color;
+    uint64_t net_worth; // unused for the player, whose money lives in Player
+    float think_timer;
+    uint64_t rng_state;
+    AiPlanner planner;
+
+} Company;
+
+typedef struct
+{
+    Job job;
+    bool is_running;
+    atomic_bool cancel;
+
+    // Inputs captured when the job was started.
+    BuildingType type;
+    Vector3 position;
+    float rotation_angle;
+    int32_t city_index;
+    SimFork *baseline;
+    SimFork *candidate;
+    DemandWindow demand; // field around the candidate, settled by the job
+
+    PreviewResult result;
+
+} PlacementPreview;
+
+// One reversible player edit, small enough to keep thousands of. Buildings
+// are referred to by their slot handle and footprints by their corner cell;
+// everything else is rederived from the template when the edit is replayed.
+typedef struct
+{
+    uint8_t type; // EditType
+    uint8_t city_index;
+    uint8_t building_type;
+    uint8_t joins_previous; // undone and redone together with the entry before it
+    uint8_t rotation;       // quarter turns before the edit
+    uint8_t new_rotation;   // quarter turns after it (EDIT_ROTATE)
+    uint8_t staff_city;     // staff's home city before the edit (EDIT_ASSIGN_STAFF)
+    uint8_t new_staff_city;
+    int16_t grid_x; // footprint corner before the edit
+    int16_t grid_z;
+    int16_t new_grid_x; // footprint corner after it (EDIT_ROTATE)
+    int16_t new_grid_z;
+    int32_t building_id; // slot handle; for EDIT_ASSIGN_STAFF the staff's building before the edit
+    int32_t new_building_id;
+    int32_t staff_id;
+    int64_t money; // change in the player's funds
+
+} EditDelta;
+
+// Ring buffer of edits. The first undo_count entries from head can be
+// undone, the rest redone. A new edit drops whatever could be redone.
+typedef struct
+{
+    EditDelta entries[EDIT_JOURNAL_CAPACITY];
+    uint32_t head;
+    uint32_t count;
+    uint32_t undo_count;
+
+} EditJournal;
+
 typedef struct
 {
     uint64_t net_worth;
@@ -174,17 +849,6 @@ typedef struct
 
 } MemoryArena;
 
-typedef struct
-{
-    Rectangle panel_rect;
-    Rectangle small_restaurant_btn;
-    Rectangle medium_restaurant_btn;
-    Rectangle large_restaurant_btn;
-    float button_padding;
-    float button_height;
-
-} BuildingMenu;
-
 typedef struct
 {
     Rectangle panel_rect;
@@ -197,35 +861,287 @@ typedef struct
 
 } SettingsMenu;
 
+// A line of text kept laid out between frames. It is only formatted and
+// laid out again when the value it shows (key) changes.
+typedef struct
+{
+    char text[MAX_LABEL_LENGTH];
+    float vertices[MAX_LABEL_LENGTH * 8];  // x, y of 4 corners per glyph
+    float texcoords[MAX_LABEL_LENGTH * 8]; // into the default font's texture
+    uint32_t glyph_count;
+    float width;
+    uint8_t key[TEXT_LABEL_KEY_SIZE];
+    uint32_t key_size;
+    bool is_valid;
+
+} TextLabel;
+
 typedef struct
 {
     Rectangle net_worth_display_area;
     Rectangle player_level_display_area;
     Rectangle current_city_display_area;
     Rectangle time_control_area;
+    Rectangle render_stats_area;
+    Rectangle projection_area; // placement preview, two lines
+    Rectangle batch_area;
+
+    Rectangle planet_button;
+    Rectangle skill_tree_button;
+    Rectangle hire_staff_button;
+    Rectangle demand_map_button;
+    Rectangle undo_button;
+    Rectangle redo_button;
+    Rectangle perk_buttons[PERK_COUNT];
+
+    TextLabel net_worth_label;
+    TextLabel city_label;
+    TextLabel render_stats_label;
+    TextLabel projection_label;
+    TextLabel neighbors_label;
+    TextLabel batch_label;
+    TextLabel hover_hint_label;
+    TextLabel placement_hint_labels[2];
+    TextLabel no_fit_label;
+    TextLabel projecting_label;
+    TextLabel perk_labels[PERK_COUNT]; // text only, raygui lays the buttons out
 
 } HUDUi;
 
 typedef struct
 {
+    Rectangle panel_rect;
+    Rectangle small_restaurant_btn;
+    Rectangle medium_restaurant_btn;
+    Rectangle large_restaurant_btn;
+    float button_padding;
+    float button_height;
+
+    TextLabel button_labels[TEMPLATE_COUNT]; // text only
+
+} BuildingMenu;
+
+typedef struct
+{
+    Rectangle start_button;
+    TextLabel title_label;
+
+} MainMenu;
+
+typedef struct
+{
+    Rectangle back_button;
+    Rectangle city_buttons[MAX_CITIES];
+    TextLabel title_label;
+    TextLabel city_labels[MAX_CITIES]; // text only
+
+} PlanetMenu;
+
+// Where every widget goes, worked out when the window changes size rather
+// than every frame, and the text they show. Each screen's widgets are
+// evaluated once per frame, while drawing (see the UI section of game.c).
+typedef struct
+{
+    MainMenu main_menu_ui;
+    PlanetMenu planet_ui;
     BuildingMenu building_ui;
     SettingsMenu settings_ui;
     HUDUi hud_ui;
+    int layout_width; // screen size the layout is for, 0 before the first
+    int layout_height;
 
 } UIData;
 
+#define MAX_CHUNK_QUADS (GRID_CHUNK_SIZE * GRID_CHUNK_SIZE * 5) // a top and four walls per cell
+#define FLOOR_MESH_QUADS 16384 // 16-bit indices reach 65536 vertices
+#define MAX_FLOOR_MESHES ((MAX_GRID_CHUNKS * MAX_CHUNK_QUADS + FLOOR_MESH_QUADS - 1) / FLOOR_MESH_QUADS)
+
+// Terrain quads of one grid chunk, kept on the CPU so the floor can be
+// stitched back together without remeshing the chunks that didn't change.
+typedef struct
+{
+    float *vertices;
+    float *texcoords;
+    float *normals;
+    unsigned char *colors;
+    int quad_count;
+
+} FloorChunk;
+
+// The ground of one city. Chunks flagged GRID_DIRTY_RENDER are remeshed and
+// the whole floor is uploaded again as a few large static meshes, one for
+// an ordinary map. Grid lines are drawn by the floor shader, and so is the
+// demand map, from a texture with a texel per cell whose chunks are
+// repainted when flagged GRID_DIRTY_OVERLAY.
+typedef struct
+{
+    FloorChunk terrain[MAX_GRID_CHUNKS];
+    bool has_terrain[MAX_GRID_CHUNKS];
+    Mesh meshes[MAX_FLOOR_MESHES];
+    BoundingBox mesh_bounds[MAX_FLOOR_MESHES];
+    int mesh_count;
+    bool shows_demand;    // demand texture is up to date with the demand field
+    Material material;    // floor shader, demand texture as its diffuse map
+    int show_demand_location;
+    bool has_material;
+
+} CityFloor;
+
+// Transforms and tints of one template's buildings, in GPU buffers that
+// stay put between frames. Instances are grouped by grid chunk, so the
+// buildings of the chunks in view are a few runs of the buffers; chunks on
+// the edge of the view add a run per stretch of their buildings in view.
+typedef struct
+{
+    unsigned int transform_buffer; // a Matrix per instance
+    unsigned int tint_buffer;      // a Color per instance
+    Matrix *transforms;
+    Color *tints; // owner's color, alpha 255 where the lights are on
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t chunk_starts[MAX_GRID_CHUNKS + 1]; // chunk c holds instances [chunk_starts[c], chunk_starts[c + 1])
+    uint32_t *run_firsts; // runs of instances in view, one draw each; as many as the capacity
+    uint32_t *run_counts;
+    uint32_t run_count;
+
+} BuildingInstances;
+
+// Draws the current city's buildings with one instanced call per template
+// mesh and run of chunks in view. Every building of the city is in the
+// instance buffers, which are only refilled when the city, its set of
+// buildings (the BVH revision) or which of them have their lights on
+// changes. When the view changes, only the runs are worked out again.
+typedef struct
+{
+    BuildingInstances templates[TEMPLATE_COUNT];
+    Shader shader;
+    bool has_shader;
+    int32_t city_index;
+    uint32_t revision;
+    uint32_t lights_revision;
+    uint32_t chunk_count; // grid chunks the instances are grouped by, 1 without a BVH
+    Frustum frustum;      // view the runs were picked for
+    int32_t lods[TEMPLATE_COUNT]; // level each template is drawn at, 0 for the full model
+    int time_of_day_location;
+
+} BuildingRenderer;
+
+// Sorted back to front within a layer only where it matters: opaque items
+// are grouped by state, see make_sort_key().
+typedef enum
+{
+    RENDER_LAYER_OPAQUE,
+    RENDER_LAYER_TRANSPARENT
+
+} RenderLayer;
+
+typedef enum
+{
+    RENDER_ITEM_MESH,
+    RENDER_ITEM_MODEL,
+    RENDER_ITEM_BUILDINGS, // one template mesh of the instanced buildings
+    RENDER_ITEM_CUBE,
+    RENDER_ITEM_CUBE_WIRES
+
+} RenderItemType;
+
+typedef struct
+{
+    RenderItemType type;
+    union
+    {
+        struct
+        {
+            const Mesh *mesh;
+            const Material *material;
+            Matrix transform;
+        } mesh;
+        struct
+        {
+            const Model *model;
+            Vector3 position;
+            float rotation_angle;
+            float scale;
+            Color tint;
+        } model;
+        struct
+        {
+            int32_t template_index;
+            int32_t lod;
+            int32_t mesh_index;
+        } buildings;
+        struct
+        {
+            Vector3 position;
+            Vector3 size;
+            Color color;
+        } cube;
+    };
+
+} RenderItem;
+
+typedef struct
+{
+    uint64_t key;
+    uint32_t item;
+
+} RenderSortEntry;
+
+// State changes and flushes the last submitted frame cost.
+typedef struct
+{
+    uint32_t item_count;
+    uint32_t shader_binds;
+    uint32_t texture_binds;
+    uint32_t batch_flushes; // rlgl batches drawn by the queue, to keep order with direct draws
+    uint32_t dropped_count; // items that didn't fit
+
+} RenderStats;
+
+// The 3D draws of a frame, collected, radix sorted by their keys and
+// submitted in one go, so draws that share a shader and texture run back
+// to back and rlgl's immediate-mode primitives land in a single batch.
+typedef struct
+{
+    RenderItem items[MAX_RENDER_ITEMS];
+    RenderSortEntry entries[MAX_RENDER_ITEMS];
+    RenderSortEntry scratch[MAX_RENDER_ITEMS];
+    uint32_t count;
+    uint32_t dropped_count;
+    Vector3 eye;     // depth is measured from here,
+    Vector3 forward; // along this
+    RenderStats stats;
+
+} RenderQueue;
+
+// Builds a city's terrain on a worker the first time anyone buys into it.
+// The worker only writes these buffers; the main thread copies the blocked
+// cells into the grid once the job is done.
+typedef struct
+{
+    Job job;
+    uint64_t seed;
+    uint32_t size;
+    float *height;       // size * size
+    uint8_t *is_blocked; // size * size
+    double seconds;      // time the last generation took
+
+} CityGenerator;
+
 typedef struct
 {
     Model small_restaurant_model;
     Model medium_restaurant_model;
     Model large_restaurant_model;
 
-    Model cities_model[MAX_CITIES];
-
     Model planet;
 
     Texture2D intro_texture;
 
+    VoxelShape building_shapes[TEMPLATE_COUNT];
+    Model building_lods[TEMPLATE_COUNT][MAX_VOXEL_LODS];
+    int32_t building_lod_counts[TEMPLATE_COUNT];
+
 } Assets;
 
 typedef struct
@@ -239,27 +1155,80 @@ typedef struct
     BuildingTemplate building_templates[TEMPLATE_COUNT];
 
     City cities[MAX_CITIES];
+    CityFloor city_floors[MAX_CITIES];
+    BuildingRenderer building_renderer;
+    RenderQueue render_queue;
+    CityGenerator city_generators[MAX_CITIES];
 
     Staff staff_owned[MAX_STAFF_OWNED];
 
+    Company companies[MAX_COMPANIES];
+    uint32_t company_count;
+
+    SkillTree skill_tree;
+
+    Simulation sim;
+
     Assets assets;
 
 } GameData;
 
 /* ========== GAME STATE ========== */
 
+// Where the mouse points on the current city's ground.
+typedef struct
+{
+    bool is_hit;           // the ray meets the ground inside the grid
+    bool is_on_ground;     // the ray meets the ground at all, maybe off the grid
+    int grid_x;
+    int grid_z;
+    Vector3 ground_position; // where the ray meets the ground
+    Vector3 cell_position;   // center of the cell under the mouse (if is_hit)
+    Ray ray;
+    int32_t building_id; // building the ray hits first (-1 if none)
+
+} PickResult;
+
+// Answers every mouse query of a frame from one ray cast. The inverse
+// view-projection is only rebuilt when the camera or window changes, and
+// the ray only when the mouse, camera or city does.
+typedef struct
+{
+    bool is_valid;
+    Camera3D camera; // the matrix was built for
+    int screen_width;
+    int screen_height;
+    Matrix inverse_view_projection;
+    Vector2 mouse;
+    int32_t city_index;
+    uint32_t bvh_revision;
+    PickResult result;
+
+} Picker;
+
 typedef struct
 {
     GameScenes current_scene;
 
     CityId current_city;
     int32_t selected_building_id;
+    int32_t hovered_building_id; // building under the mouse in the current city (-1 if none)
     int32_t selected_staff_id;
     BuildingType selected_building_type_to_place;
     Vector3 building_placement_position;
     float building_placement_rotation_angle;
 
     bool is_building_placement_mode;
+    bool is_dragging_placement;
+    Vector3 placement_drag_start;
+    PlacementBatch placement_batch; // what releasing the drag would place
+    bool is_skill_menu_open;
+    bool is_demand_map_visible;
+    bool is_render_stats_visible;
+    PlacementPreview placement_preview;
+    PreviewResult placement_preview_result; // last finished preview
+    EditJournal edit_journal;
+    Picker picker;
     bool is_paused;
     bool is_game_over;
     bool is_victory;
@@ -284,13 +1253,181 @@ void update_game(Game *game, float dt);
 void draw_game(Game *game);
 void clean_up(Game *game);
 
-void place_building(City *city, BuildingType type, Vector3 position, BuildingTemplate template, float rotation_angle);
-void hire_staff();
-void sell_staff();
-void assign_staff();
+int32_t place_building(City *city, Vector3 position, BuildingTemplate template, float rotation_angle);
+int32_t place_building_in_slot(City *city, int32_t building_index, Vector3 position, BuildingTemplate template, float rotation_angle);
 void collect_money();
-Vector3 get_grid_position_from_mouse(Game *game);
+const PickResult *pick_mouse(Game *game);
+Vector3 get_grid_cell_position(uint32_t grid_size, int grid_x, int grid_z);
+bool get_grid_cell_from_position(uint32_t grid_size, Vector3 position, int *grid_x, int *grid_z);
 bool unlock_city(Game *game, int city_index);
 const char *get_city_name(CityId id);
 
+/* ========== SIMULATION (sim.c) ========== */
+void init_simulation(Game *game);
+void update_simulation(Game *game, float dt);
+void clean_up_simulation(Game *game);
+void sim_set_visible_city(Game *game, int32_t city_index);
+void sim_forget_building(Game *game, int32_t city_index, int32_t building_id);
+void sim_step_world(City *cities, Simulation *sim, uint64_t *funds);
+void sim_tick_city_aggregate(City *city, Simulation *sim, uint64_t *funds, float dt);
+void sim_tick_city_full(City *city, Simulation *sim, uint64_t *funds, float dt);
+void sim_refresh_building_staff(const Simulation *sim, City *city, uint32_t building_id);
+void sim_refresh_staff(Game *game);
+uint32_t sim_random(uint64_t *state);
+float sim_random_float(uint64_t *state);
+float sim_time_of_day(const Simulation *sim);
+
+/* ========== CITY GRID (grid.c) ========== */
+void init_footprints(void);
+const Footprint *get_footprint(BuildingType type, float rotation_angle);
+bool city_grid_init(City *city, MemoryArena *arena);
+GridCellType city_grid_get_type(const City *city, int grid_x, int grid_z);
+int32_t city_grid_get_building(const City *city, int grid_x, int grid_z);
+int32_t city_grid_building_at(const City *city, Vector3 position);
+bool city_grid_find_corner(const City *city, BuildingType type, Vector3 anchor, float rotation_angle, int *grid_x, int *grid_z);
+bool occupancy_can_place(const OccupancyGrid *grid, BuildingType type, int cell_x, int cell_z, float rotation_angle);
+bool city_grid_can_place(const City *city, BuildingType type, Vector3 anchor, float rotation_angle);
+bool city_grid_can_place_at(const City *city, BuildingType type, int grid_x, int grid_z, float rotation_angle);
+Vector3 city_grid_footprint_center(const City *city, BuildingType type, int grid_x, int grid_z, float rotation_angle);
+void city_grid_set_building(City *city, const Building *building, bool is_present);
+void city_grid_mark_dirty(City *city, int grid_x, int grid_z, uint8_t flags);
+const GridChunk *city_grid_get_chunk(const City *city, uint32_t chunk_index);
+bool city_grid_take_dirty(City *city, uint32_t chunk_index, uint8_t flag);
+void city_grid_set_blocked(City *city, int grid_x, int grid_z);
+
+/* ========== CITY GENERATION (terrain.c) ========== */
+void generate_city_terrain(uint64_t seed, uint32_t size, float *height, uint8_t *is_blocked);
+bool city_generator_init(CityGenerator *generator, MemoryArena *arena, uint32_t size, uint64_t seed);
+void start_city_generation(Game *game, int32_t city_index);
+void update_city_generation(Game *game);
+void clean_up_city_generation(Game *game);
+
+/* ========== RENDERING (render.c) ========== */
+void update_city_floor(Game *game, int32_t city_index);
+void queue_city_floor(Game *game, int32_t city_index, const Frustum *frustum, RenderQueue *queue);
+void unload_city_floors(Game *game);
+void queue_city_buildings(Game *game, int32_t city_index, const Frustum *frustum, RenderQueue *queue);
+void unload_building_renderer(Game *game);
+void render_queue_begin(RenderQueue *queue, Camera3D camera);
+void queue_mesh(RenderQueue *queue, RenderLayer layer, const Mesh *mesh, const Material *material, Matrix transform, Vector3 position);
+void queue_model(RenderQueue *queue, RenderLayer layer, const Model *model, Vector3 position, float rotation_angle, float scale, Color tint);
+void queue_cube(RenderQueue *queue, Vector3 position, Vector3 size, Color color);
+void queue_cube_wires(RenderQueue *queue, Vector3 position, Vector3 size, Color color);
+void render_queue_submit(Game *game, RenderQueue *queue);
+
+/* ========== DEMAND FIELD (demand.c) ========== */
+DemandField *demand_field_create(MemoryArena *arena, uint32_t size, uint64_t seed);
+void demand_field_step(DemandField *field);
+void demand_field_rebuild_sinks(DemandField *field, City *city);
+float demand_field_sample(const DemandField *field, Vector3 position);
+bool demand_window_copy(DemandWindow *window, const DemandField *field, Vector3 center, int radius);
+void demand_window_add_building(DemandWindow *window, const Building *building);
+void demand_window_settle(DemandWindow *window, uint32_t max_steps);
+float demand_window_sample(const DemandWindow *window, Vector3 position, float fallback);
+void demand_window_free(DemandWindow *window);
+void update_demand(Game *game, float dt);
+
+/* ========== VOXEL MODELS (voxel.c) ========== */
+bool load_voxel_shape(VoxelShape *shape, const char *path, BoundingBox mesh_bounds);
+bool load_voxel_model(Model *model, Model lods[MAX_VOXEL_LODS], int32_t *lod_count, VoxelShape *shape, const char *path);
+void unload_voxel_shape(VoxelShape *shape);
+bool voxel_shape_raycast(const VoxelShape *shape, Vector3 origin, Vector3 direction, float max_t, float *hit_t);
+
+/* ========== BUILDING BVH (bvh.c) ========== */
+BoundingBox get_building_world_bounds(const Building *building);
+BuildingBvh *building_bvh_create(MemoryArena *arena, uint32_t city_size);
+void building_bvh_free(BuildingBvh *bvh);
+void building_bvh_insert(BuildingBvh *bvh, const Building *building);
+void building_bvh_remove(BuildingBvh *bvh, int32_t building_id);
+int32_t building_bvh_raycast(const BuildingBvh *bvh, const City *city, Ray ray, float *distance);
+
+/* ========== FRUSTUM CULLING (cull.c) ========== */
+Frustum make_frustum(Matrix view_projection);
+Frustum get_view_frustum(void);
+bool frustum_test_box(const Frustum *frustum, BoundingBox box);
+int frustum_test_packet(const Frustum *frustum, const BvhPacket *packet, int *inside);
+uint32_t cull_city_chunks(const City *city, const Frustum *frustum, uint8_t visibility[MAX_GRID_CHUNKS]);
+
+/* ========== HUD TEXT (text.c) ========== */
+char *append_text(char *out, const char *text);
+char *append_u64(char *out, uint64_t value);
+char *append_i64(char *out, int64_t value);
+char *append_tenths(char *out, float value);
+bool text_label_update(TextLabel *label, const void *value, size_t size);
+void text_label_set(TextLabel *label, const char *text, Vector2 position, float font_size);
+void draw_text_label(const TextLabel *label, Color color);
+
+/* ========== SYNERGY (synergy.c) ========== */
+SynergyField *synergy_field_create(MemoryArena *arena, uint32_t size);
+void synergy_field_add_building(SynergyField *field, const Building *building, float sign);
+float synergy_field_bonus(const SynergyField *field, Vector3 position, const BuildingTemplate *exclude);
+float synergy_field_bonus_with(const SynergyField *field, Vector3 position, const BuildingTemplate *exclude,
+                               const Building *added);
+void update_synergy(Game *game);
+
+/* ========== COMMANDS (commands.c) ========== */
+bool execute_command(Game *game, const Command *command);
+uint64_t *get_company_funds(Game *game, uint8_t company_id);
+int32_t hire_staff(Game *game, uint8_t company_id, StaffRole role);
+bool sell_staff(Game *game, int32_t staff_id);
+bool assign_staff(Game *game, int32_t staff_id, int32_t city_index, int32_t building_id);
+uint32_t get_staff_hire_fee(const Staff *staff);
+int32_t city_add_building(Game *game, int32_t city_index, int32_t building_id, BuildingType type, int grid_x, int grid_z,
+                          float rotation_angle, uint8_t owner_id);
+void city_remove_building(Game *game, int32_t city_index, int32_t building_id);
+bool city_rotate_building(Game *game, int32_t city_index, int32_t building_id, int grid_x, int grid_z, float rotation_angle);
+void plan_placement_batch(Game *game, PlacementBatch *batch, uint8_t company_id, int32_t city_index, BuildingType type,
+                          Vector3 from, Vector3 to, float rotation_angle, bool is_rect);
+
+/* ========== EDIT HISTORY (edits.c) ========== */
+void edit_journal_clear(Game *game);
+void edit_journal_record(Game *game, const EditDelta *delta);
+bool can_undo_edit(const Game *game);
+bool can_redo_edit(const Game *game);
+bool undo_edit(Game *game);
+bool redo_edit(Game *game);
+
+/* ========== RIVAL COMPANIES (ai.c) ========== */
+void init_companies(Game *game);
+void update_companies(Game *game, float dt);
+void clean_up_companies(Game *game);
+
+/* ========== SKILL TREE (skills.c) ========== */
+const PerkDefinition *get_perk_definition(PerkId id);
+bool is_perk_unlocked(const SkillTree *tree, PerkId id);
+bool can_unlock_perk(const Game *game, PerkId id);
+bool unlock_perk(Game *game, PerkId id);
+void compile_modifier_tables(const SkillTree *tree, const BuildingTemplate *templates, ModifierTables *tables);
+
+/* ========== COPY-ON-WRITE POOLS (pool.c) ========== */
+void arena_init(MemoryArena *arena, uint64_t size);
+void *arena_alloc(MemoryArena *arena, uint64_t size);
+void arena_free(MemoryArena *arena);
+void *cow_chunk_alloc(size_t size);
+void cow_chunk_retain(ChunkHeader *chunk);
+void cow_chunk_release(ChunkHeader *chunk);
+void *cow_chunk_make_writable(ChunkHeader **slot, size_t size);
+uint32_t city_building_slots(const City *city);
+const Building *city_get_building(const City *city, uint32_t id);
+Building *city_get_building_mut(City *city, uint32_t id);
+int32_t city_alloc_building_slot(City *city);
+bool city_claim_building_slot(City *city, uint32_t id);
+bool city_share_buildings(City *copy);
+void city_release_buildings(City *city);
+
+/* ========== SNAPSHOTS (snapshot.c) ========== */
+SimFork *sim_fork_create(Game *game);
+void sim_fork_destroy(SimFork *fork);
+void sim_fork_step(SimFork *fork, uint32_t ticks);
+void update_placement_preview(Game *game);
+void cancel_placement_preview(Game *game);
+
+/* ========== JOBS (jobs.c) ========== */
+void jobs_init(int worker_count);
+double jobs_time_now(void);
+void jobs_shutdown(void);
+bool jobs_submit(Job *job, JobFunction function, void *data);
+bool job_is_done(Job *job);
+void job_wait(Job *job);
+
 #endif // GAME_H
@@ -0,0 +1,278 @@
+#include "game.h"
+
+/* ========== FOOTPRINTS ========== */
+
+// Footprints as drawn from above at rotation 0, one string per row.
+static const char *footprint_shapes[TEMPLATE_COUNT][FOOTPRINT_MAX_SIZE] = {
+    [BUILDING_RESTAURANT_SMALL] = {"#"},
+    [BUILDING_RESTAURANT_MEDIUM] = {"##"},
+    [BUILDING_RESTAURANT_LARGE] = {"###", "###"},
+};
+
+static Footprint footprints[TEMPLATE_COUNT][GRID_ROTATION_COUNT];
+
+// Builds every rotation of every footprint once, so placement never rotates
+// anything. A quarter turn matches DrawModelEx's +90 degrees about Y, which
+// takes (x, z) to (z, -x).
+void init_footprints(void)
+{
+    for (int type = 0; type < TEMPLATE_COUNT; type++)
+    {
+        int cells_x[FOOTPRINT_MAX_SIZE * FOOTPRINT_MAX_SIZE], cells_z[FOOTPRINT_MAX_SIZE * FOOTPRINT_MAX_SIZE];
+        int cell_count = 0, width = 0, height = 0;
+
+        for (int z = 0; z < FOOTPRINT_MAX_SIZE && footprint_shapes[type][z]; z++)
+        {
+            for (int x = 0; footprint_shapes[type][z][x]; x++)
+            {
+                if (footprint_shapes[type][z][x] != '#')
+                    continue;
+                cells_x[cell_count] = x;
+                cells_z[cell_count] = z;
+                cell_count++;
+                width = (x + 1 > width) ? x + 1 : width;
+                height = (z + 1 > height) ? z + 1 : height;
+            }
+        }
+
+        for (int rotation = 0; rotation < GRID_ROTATION_COUNT; rotation++)
+        {
+            Footprint *footprint = &footprints[type][rotation];
+            *footprint = (Footprint){0};
+            footprint->width = (uint8_t)width;
+            footprint->height = (uint8_t)height;
+            footprint->offset_x = (int8_t)(-(width - 1) / 2);
+            footprint->offset_z = (int8_t)(-(height - 1) / 2);
+            footprint->cell_count = (uint8_t)cell_count;
+
+            for (int i = 0; i < cell_count; i++)
+                footprint->rows[cells_z[i]] |= 1ull << cells_x[i];
+
+            // Turn the cells a quarter for the next rotation.
+            for (int i = 0; i < cell_count; i++)
+            {
+                int x = cells_x[i];
+                cells_x[i] = cells_z[i];
+                cells_z[i] = width - 1 - x;
+            }
+            int swap = width;
+            width = height;
+            height = swap;
+        }
+    }
+}
+
+const Footprint *get_footprint(BuildingType type, float rotation_angle)
+{
+    int rotation = ((int)lroundf(rotation_angle / 90.0f) % GRID_ROTATION_COUNT + GRID_ROTATION_COUNT) % GRID_ROTATION_COUNT;
+    return &footprints[type][rotation];
+}
+
+/* ========== OCCUPANCY ========== */
+
+// City sizes are all multiples of GRID_CHUNK_SIZE, so chunks are never partial.
+bool city_grid_init(City *city, MemoryArena *arena)
+{
+    OccupancyGrid *grid = &city->grid;
+    grid->size = city->size;
+    grid->words_per_row = (grid->size + 63) / 64;
+    grid->chunks_per_side = grid->size / GRID_CHUNK_SIZE;
+    grid->occupied = (uint64_t *)arena_alloc(arena, sizeof(uint64_t) * grid->words_per_row * grid->size);
+    grid->chunks = (GridChunk *)arena_alloc(arena, sizeof(GridChunk) * grid->chunks_per_side * grid->chunks_per_side);
+    if (!grid->occupied || !grid->chunks)
+        return false;
+
+    for (uint32_t c = 0; c < grid->chunks_per_side * grid->chunks_per_side; c++)
+    {
+        for (uint32_t i = 0; i < GRID_CHUNK_SIZE * GRID_CHUNK_SIZE; i++)
+            grid->chunks[c].cells[i] = (GridCell){GRID_CELL_EMPTY, -1};
+        grid->chunks[c].dirty = GRID_DIRTY_ALL; // nobody has seen the chunk yet
+    }
+    return true;
+}
+
+static GridChunk *get_chunk(const OccupancyGrid *grid, int grid_x, int grid_z)
+{
+    return &grid->chunks[(grid_z / GRID_CHUNK_SIZE) * grid->chunks_per_side + grid_x / GRID_CHUNK_SIZE];
+}
+
+static GridCell *get_cell(const OccupancyGrid *grid, int grid_x, int grid_z)
+{
+    if (!grid->chunks || grid_x < 0 || grid_z < 0 || grid_x >= (int)grid->size || grid_z >= (int)grid->size)
+        return NULL;
+    return &get_chunk(grid, grid_x, grid_z)->cells[(grid_z % GRID_CHUNK_SIZE) * GRID_CHUNK_SIZE + grid_x % GRID_CHUNK_SIZE];
+}
+
+const GridChunk *city_grid_get_chunk(const City *city, uint32_t chunk_index)
+{
+    const OccupancyGrid *grid = &city->grid;
+    if (!grid->chunks || chunk_index >= grid->chunks_per_side * grid->chunks_per_side)
+        return NULL;
+    return &grid->chunks[chunk_index];
+}
+
+// Flags the chunk holding the cell for the given systems.
+void city_grid_mark_dirty(City *city, int grid_x, int grid_z, uint8_t flags)
+{
+    if (get_cell(&city->grid, grid_x, grid_z))
+        get_chunk(&city->grid, grid_x, grid_z)->dirty |= flags;
+}
+
+// Returns whether the chunk was dirty for one system and clears that
+// system's flag. The other systems keep theirs.
+bool city_grid_take_dirty(City *city, uint32_t chunk_index, uint8_t flag)
+{
+    OccupancyGrid *grid = &city->grid;
+    if (!grid->chunks || chunk_index >= grid->chunks_per_side * grid->chunks_per_side)
+        return false;
+
+    bool was_dirty = grid->chunks[chunk_index].dirty & flag;
+    grid->chunks[chunk_index].dirty &= (uint8_t)~flag;
+    return was_dirty;
+}
+
+// Rock, ridges and crater rims. Only called for empty cells.
+void city_grid_set_blocked(City *city, int grid_x, int grid_z)
+{
+    OccupancyGrid *grid = &city->grid;
+    GridCell *cell = get_cell(grid, grid_x, grid_z);
+    if (!cell || cell->type != GRID_CELL_EMPTY)
+        return;
+
+    grid->occupied[(uint32_t)grid_z * grid->words_per_row + (uint32_t)grid_x / 64] |= 1ull << ((uint32_t)grid_x % 64);
+    cell->type = GRID_CELL_BLOCKED;
+    get_chunk(grid, grid_x, grid_z)->dirty = GRID_DIRTY_ALL;
+}
+
+// Cells outside the city read as GRID_CELL_NOT_USED.
+GridCellType city_grid_get_type(const City *city, int grid_x, int grid_z)
+{
+    const GridCell *cell = get_cell(&city->grid, grid_x, grid_z);
+    return cell ? (GridCellType)cell->type : GRID_CELL_NOT_USED;
+}
+
+int32_t city_grid_get_building(const City *city, int grid_x, int grid_z)
+{
+    const GridCell *cell = get_cell(&city->grid, grid_x, grid_z);
+    return cell ? cell->building_id : -1;
+}
+
+int32_t city_grid_building_at(const City *city, Vector3 position)
+{
+    int x, z;
+    if (!get_grid_cell_from_position(city->grid.size, position, &x, &z))
+        return -1;
+    return city_grid_get_building(city, x, z);
+}
+
+// Finds the corner cell of the footprint centered on the cell under anchor.
+// Returns false if any part of it would hang off the map.
+bool city_grid_find_corner(const City *city, BuildingType type, Vector3 anchor, float rotation_angle, int *grid_x, int *grid_z)
+{
+    const OccupancyGrid *grid = &city->grid;
+    const Footprint *footprint = get_footprint(type, rotation_angle);
+    int x, z;
+    if (!grid->occupied || city->terrain_state != CITY_TERRAIN_READY || !get_grid_cell_from_position(grid->size, anchor, &x, &z))
+        return false;
+
+    x += footprint->offset_x;
+    z += footprint->offset_z;
+    if (x < 0 || z < 0 || x + footprint->width > (int)grid->size || z + footprint->height > (int)grid->size)
+        return false;
+
+    *grid_x = x;
+    *grid_z = z;
+    return true;
+}
+
+// One AND per footprint row, two when the row straddles a word boundary.
+static bool footprint_overlaps(const OccupancyGrid *grid, const Footprint *footprint, int grid_x, int grid_z)
+{
+    uint32_t word = (uint32_t)grid_x / 64;
+    uint32_t shift = (uint32_t)grid_x % 64;
+
+    for (int row = 0; row < footprint->height; row++)
+    {
+        const uint64_t *occupied = grid->occupied + (uint32_t)(grid_z + row) * grid->words_per_row;
+        uint64_t mask = footprint->rows[row];
+
+        if (occupied[word] & (mask << shift))
+            return true;
+        if (shift != 0 && word + 1 < grid->words_per_row && (occupied[word + 1] & (mask >> (64 - shift))))
+            return true;
+    }
+    return false;
+}
+
+// Same test for a footprint centered on (cell_x, cell_z) that only reads the
+// occupancy bits, so it works on a copy of them too.
+bool occupancy_can_place(const OccupancyGrid *grid, BuildingType type, int cell_x, int cell_z, float rotation_angle)
+{
+    const Footprint *footprint = get_footprint(type, rotation_angle);
+    int x = cell_x + footprint->offset_x;
+    int z = cell_z + footprint->offset_z;
+    if (!grid->occupied || x < 0 || z < 0 || x + footprint->width > (int)grid->size || z + footprint->height > (int)grid->size)
+        return false;
+    return !footprint_overlaps(grid, footprint, x, z);
+}
+
+bool city_grid_can_place(const City *city, BuildingType type, Vector3 anchor, float rotation_angle)
+{
+    int x, z;
+    if (!city_grid_find_corner(city, type, anchor, rotation_angle, &x, &z))
+        return false;
+    return !footprint_overlaps(&city->grid, get_footprint(type, rotation_angle), x, z);
+}
+
+// Same check for a footprint whose corner is already known, as when undo
+// puts a building back where it was.
+bool city_grid_can_place_at(const City *city, BuildingType type, int grid_x, int grid_z, float rotation_angle)
+{
+    const OccupancyGrid *grid = &city->grid;
+    const Footprint *footprint = get_footprint(type, rotation_angle);
+    if (!grid->occupied || city->terrain_state != CITY_TERRAIN_READY || grid_x < 0 || grid_z < 0 ||
+        grid_x + footprint->width > (int)grid->size || grid_z + footprint->height > (int)grid->size)
+        return false;
+    return !footprint_overlaps(grid, footprint, grid_x, grid_z);
+}
+
+// World position of the middle of a footprint whose corner is at (grid_x, grid_z).
+Vector3 city_grid_footprint_center(const City *city, BuildingType type, int grid_x, int grid_z, float rotation_angle)
+{
+    const Footprint *footprint = get_footprint(type, rotation_angle);
+    const float cellSize = FLOOR_CUBE_SIZE + FLOOR_SPACING;
+    Vector3 corner = get_grid_cell_position(city->grid.size, grid_x, grid_z);
+
+    return (Vector3){
+        corner.x + (footprint->width - 1) * cellSize / 2.0f,
+        corner.y,
+        corner.z + (footprint->height - 1) * cellSize / 2.0f};
+}
+
+// Marks the building's footprint as taken, or frees it when is_present is false.
+void city_grid_set_building(City *city, const Building *building, bool is_present)
+{
+    OccupancyGrid *grid = &city->grid;
+    const Footprint *footprint = get_footprint(building->template.type, building->rotation_angle);
+
+    for (int row = 0; row < footprint->height; row++)
+    {
+        for (int column = 0; column < footprint->width; column++)
+        {
+            if (!((footprint->rows[row] >> column) & 1u))
+                continue;
+
+            int x = building->grid_x + column;
+            int z = building->grid_z + row;
+            GridCell *cell = get_cell(grid, x, z);
+            if (!cell)
+                continue;
+
+            uint64_t *word = &grid->occupied[(uint32_t)z * grid->words_per_row + (uint32_t)x / 64];
+            uint64_t bit = 1ull << ((uint32_t)x % 64);
+            *word = is_present ? (*word | bit) : (*word & ~bit);
+            *cell = is_present ? (GridCell){GRID_CELL_BUILDING, (int32_t)building->id} : (GridCell){GRID_CELL_EMPTY, -1};
+            get_chunk(grid, x, z)->dirty = GRID_DIRTY_ALL;
+        }
+    }
+}
@@ -0,0 +1,134 @@
+#include "game.h"
+#include <pthread.h>
+#include <time.h>
+
+// Small fixed pool of worker threads pulling jobs from a ring buffer. Jobs
+// are owned by the caller and must stay alive until job_is_done() is true.
+
+static struct
+{
+    pthread_t workers[JOB_WORKER_COUNT];
+    int worker_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t has_work;
+    pthread_cond_t finished;
+
+    Job *queue[JOB_QUEUE_CAPACITY];
+    uint32_t head;
+    uint32_t count;
+    bool is_shutting_down;
+
+} job_system;
+
+static void *job_worker_main(void *arg)
+{
+    (void)arg;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&job_system.lock);
+        while (job_system.count == 0 && !job_system.is_shutting_down)
+            pthread_cond_wait(&job_system.has_work, &job_system.lock);
+
+        if (job_system.count == 0)
+        {
+            pthread_mutex_unlock(&job_system.lock);
+            return NULL;
+        }
+
+        Job *job = job_system.queue[job_system.head];
+        job_system.head = (job_system.head + 1) % JOB_QUEUE_CAPACITY;
+        job_system.count--;
+        pthread_mutex_unlock(&job_system.lock);
+
+        job->function(job->data);
+
+        pthread_mutex_lock(&job_system.lock);
+        atomic_store_explicit(&job->done, true, memory_order_release);
+        pthread_cond_broadcast(&job_system.finished);
+        pthread_mutex_unlock(&job_system.lock);
+    }
+}
+
+void jobs_init(int worker_count)
+{
+    pthread_mutex_init(&job_system.lock, NULL);
+    pthread_cond_init(&job_system.has_work, NULL);
+    pthread_cond_init(&job_system.finished, NULL);
+    job_system.head = 0;
+    job_system.count = 0;
+    job_system.is_shutting_down = false;
+    job_system.worker_count = 0;
+
+    if (worker_count > JOB_WORKER_COUNT)
+        worker_count = JOB_WORKER_COUNT;
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        if (pthread_create(&job_system.workers[job_system.worker_count], NULL, job_worker_main, NULL) == 0)
+            job_system.worker_count++;
+    }
+}
+
+// Lets queued jobs finish, then joins the workers.
+void jobs_shutdown(void)
+{
+    pthread_mutex_lock(&job_system.lock);
+    job_system.is_shutting_down = true;
+    pthread_cond_broadcast(&job_system.has_work);
+    pthread_mutex_unlock(&job_system.lock);
+
+    for (int i = 0; i < job_system.worker_count; i++)
+        pthread_join(job_system.workers[i], NULL);
+    job_system.worker_count = 0;
+
+    pthread_cond_destroy(&job_system.finished);
+    pthread_cond_destroy(&job_system.has_work);
+    pthread_mutex_destroy(&job_system.lock);
+}
+
+// Queues a job. Without workers (or with a full queue) it runs inline, so
+// callers never have to handle a rejected submit.
+bool jobs_submit(Job *job, JobFunction function, void *data)
+{
+    job->function = function;
+    job->data = data;
+    atomic_store_explicit(&job->done, false, memory_order_relaxed);
+
+    pthread_mutex_lock(&job_system.lock);
+    if (job_system.worker_count > 0 && job_system.count < JOB_QUEUE_CAPACITY)
+    {
+        job_system.queue[(job_system.head + job_system.count) % JOB_QUEUE_CAPACITY] = job;
+        job_system.count++;
+        pthread_cond_signal(&job_system.has_work);
+        pthread_mutex_unlock(&job_system.lock);
+        return true;
+    }
+    pthread_mutex_unlock(&job_system.lock);
+
+    function(data);
+    atomic_store_explicit(&job->done, true, memory_order_release);
+    return false;
+}
+
+// Monotonic clock for jobs that work to a time budget.
+double jobs_time_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+bool job_is_done(Job *job)
+{
+    return atomic_load_explicit(&job->done, memory_order_acquire);
+}
+
+void job_wait(Job *job)
+{
+    pthread_mutex_lock(&job_system.lock);
+    while (!job_is_done(job))
+        pthread_cond_wait(&job_system.finished, &job_system.lock);
+    pthread_mutex_unlock(&job_system.lock);
+}
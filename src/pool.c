@@ -0,0 +1,190 @@
+#include "game.h"
+#include <string.h>
+
+/* ========== ARENA ========== */
+
+// Long-lived allocations that are all freed together at shutdown.
+void arena_init(MemoryArena *arena, uint64_t size)
+{
+    arena->base = (char *)malloc(size);
+    arena->current = arena->base;
+    arena->size = arena->base ? size : 0;
+    arena->used = 0;
+}
+
+// Returns zeroed, 16-byte aligned memory, or NULL when the arena is full.
+void *arena_alloc(MemoryArena *arena, uint64_t size)
+{
+    uint64_t start = (arena->used + 15) & ~(uint64_t)15;
+    if (start + size > arena->size)
+        return NULL;
+
+    arena->current = arena->base + start + size;
+    arena->used = start + size;
+    return memset(arena->base + start, 0, size);
+}
+
+void arena_free(MemoryArena *arena)
+{
+    free(arena->base);
+    *arena = (MemoryArena){0};
+}
+
+/* ========== COPY-ON-WRITE CHUNKS ========== */
+
+void *cow_chunk_alloc(size_t size)
+{
+    ChunkHeader *chunk = (ChunkHeader *)calloc(1, size);
+    if (chunk)
+        atomic_init(&chunk->refcount, 1);
+    return chunk;
+}
+
+void cow_chunk_retain(ChunkHeader *chunk)
+{
+    if (chunk)
+        atomic_fetch_add_explicit(&chunk->refcount, 1, memory_order_relaxed);
+}
+
+void cow_chunk_release(ChunkHeader *chunk)
+{
+    if (chunk && atomic_fetch_sub_explicit(&chunk->refcount, 1, memory_order_acq_rel) == 1)
+        free(chunk);
+}
+
+// Returns a chunk the caller may modify. If the chunk in the slot is shared
+// with a snapshot it is cloned first and the slot repointed to the clone.
+void *cow_chunk_make_writable(ChunkHeader **slot, size_t size)
+{
+    ChunkHeader *chunk = *slot;
+    if (atomic_load_explicit(&chunk->refcount, memory_order_acquire) == 1)
+        return chunk;
+
+    ChunkHeader *copy = (ChunkHeader *)malloc(size);
+    if (!copy)
+        return NULL;
+
+    memcpy(copy, chunk, size);
+    atomic_init(&copy->refcount, 1);
+    cow_chunk_release(chunk);
+    *slot = copy;
+    return copy;
+}
+
+/* ========== BUILDINGS ========== */
+
+uint32_t city_building_slots(const City *city)
+{
+    return city->building_chunk_count * BUILDING_CHUNK_CAPACITY;
+}
+
+const Building *city_get_building(const City *city, uint32_t id)
+{
+    if (id >= city_building_slots(city))
+        return NULL;
+    return &city->building_chunks[id / BUILDING_CHUNK_CAPACITY]->buildings[id % BUILDING_CHUNK_CAPACITY];
+}
+
+static BuildingChunk *city_building_chunk_mut(City *city, uint32_t chunk_index)
+{
+    return (BuildingChunk *)cow_chunk_make_writable((ChunkHeader **)&city->building_chunks[chunk_index],
+                                                    sizeof(BuildingChunk));
+}
+
+Building *city_get_building_mut(City *city, uint32_t id)
+{
+    if (id >= city_building_slots(city))
+        return NULL;
+
+    BuildingChunk *chunk = city_building_chunk_mut(city, id / BUILDING_CHUNK_CAPACITY);
+    return chunk ? &chunk->buildings[id % BUILDING_CHUNK_CAPACITY] : NULL;
+}
+
+// Appends a chunk of free slots, and room for their flows.
+static bool add_building_chunk(City *city)
+{
+    if (city->building_chunk_count >= MAX_BUILDING_CHUNKS)
+        return false;
+
+    uint32_t slots = city_building_slots(city);
+    BuildingFlow *flows = (BuildingFlow *)realloc(city->flows, sizeof(BuildingFlow) * (slots + BUILDING_CHUNK_CAPACITY));
+    if (!flows)
+        return false;
+    city->flows = flows;
+    memset(flows + slots, 0, sizeof(BuildingFlow) * BUILDING_CHUNK_CAPACITY);
+
+    BuildingChunk *chunk = (BuildingChunk *)cow_chunk_alloc(sizeof(BuildingChunk));
+    if (!chunk)
+        return false;
+
+    for (uint32_t k = 0; k < BUILDING_CHUNK_CAPACITY; k++)
+        chunk->buildings[k].id = -1;
+
+    city->building_chunks[city->building_chunk_count++] = chunk;
+    return true;
+}
+
+// Finds a free building slot that the undo journal isn't holding for a
+// building it may put back, growing the pool by a chunk when all are taken.
+int32_t city_alloc_building_slot(City *city)
+{
+    for (uint32_t c = 0; c < city->building_chunk_count; c++)
+    {
+        const BuildingChunk *chunk = city->building_chunks[c];
+        for (uint32_t k = 0; k < BUILDING_CHUNK_CAPACITY; k++)
+        {
+            if (chunk->buildings[k].id == -1 && chunk->buildings[k].edit_holds == 0)
+                return (int32_t)(c * BUILDING_CHUNK_CAPACITY + k);
+        }
+    }
+
+    if (!add_building_chunk(city))
+        return -1;
+    return (int32_t)((city->building_chunk_count - 1) * BUILDING_CHUNK_CAPACITY);
+}
+
+// Makes sure a particular slot exists and is free, for putting a building
+// back under the handle it had before.
+bool city_claim_building_slot(City *city, uint32_t id)
+{
+    while (id >= city_building_slots(city))
+    {
+        if (!add_building_chunk(city))
+            return false;
+    }
+    return city_get_building(city, id)->id == -1;
+}
+
+// Called on a copy of a city header: shares the building chunks with the
+// original and gives the copy flows of its own, since both sides keep
+// writing those.
+bool city_share_buildings(City *copy)
+{
+    uint32_t slots = city_building_slots(copy);
+    BuildingFlow *flows = slots ? (BuildingFlow *)malloc(sizeof(BuildingFlow) * slots) : NULL;
+    if (slots && !flows)
+    {
+        copy->building_chunk_count = 0;
+        copy->flows = NULL;
+        return false;
+    }
+
+    if (flows)
+        memcpy(flows, copy->flows, sizeof(BuildingFlow) * slots);
+    copy->flows = flows;
+    for (uint32_t c = 0; c < copy->building_chunk_count; c++)
+        cow_chunk_retain(&copy->building_chunks[c]->header);
+    return true;
+}
+
+void city_release_buildings(City *city)
+{
+    for (uint32_t c = 0; c < city->building_chunk_count; c++)
+    {
+        cow_chunk_release(&city->building_chunks[c]->header);
+        city->building_chunks[c] = NULL;
+    }
+    city->building_chunk_count = 0;
+    free(city->flows);
+    city->flows = NULL;
+}
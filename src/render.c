@@ -0,0 +1,1183 @@
+#include "game.h"
+#include "rlgl.h"
+#include <string.h>
+
+#define GRID_LINE_WIDTH 0.0625f // of a cell, along two of its edges
+
+// Vertex attribute slots of the building instance data, past the ones rlgl
+// binds mesh data to.
+#define INSTANCE_TRANSFORM_LOCATION 9 // and the three after it, a column each
+#define INSTANCE_TINT_LOCATION 13
+
+#define STRINGIFY(x) #x
+#define TO_STRING(x) STRINGIFY(x)
+
+/* ========== MESH BUILDING ========== */
+
+// Scratch space for the chunk being built. Chunks are built one at a time on
+// the main thread and copied out at their final size.
+static struct
+{
+    float vertices[MAX_CHUNK_QUADS * 4 * 3];
+    float texcoords[MAX_CHUNK_QUADS * 4 * 2];
+    float normals[MAX_CHUNK_QUADS * 4 * 3];
+    unsigned char colors[MAX_CHUNK_QUADS * 4 * 4];
+    int quad_count;
+
+} mesh_builder;
+
+// Adds a quad facing normal. Corners go around the edge in either direction;
+// they are flipped if needed so the quad survives backface culling.
+static void add_quad(Vector3 corners[4], const Vector2 texcoords[4], Vector3 normal, Color color)
+{
+    int order[4] = {0, 1, 2, 3};
+    Vector3 winding = Vector3CrossProduct(Vector3Subtract(corners[1], corners[0]), Vector3Subtract(corners[2], corners[0]));
+    if (Vector3DotProduct(winding, normal) < 0.0f)
+    {
+        order[1] = 3;
+        order[3] = 1;
+    }
+
+    int base = mesh_builder.quad_count++ * 4;
+    for (int v = 0; v < 4; v++)
+    {
+        float *vertex = mesh_builder.vertices + (base + v) * 3;
+        float *texcoord = mesh_builder.texcoords + (base + v) * 2;
+        float *normal_out = mesh_builder.normals + (base + v) * 3;
+        unsigned char *color_out = mesh_builder.colors + (base + v) * 4;
+
+        vertex[0] = corners[order[v]].x;
+        vertex[1] = corners[order[v]].y;
+        vertex[2] = corners[order[v]].z;
+        texcoord[0] = texcoords[order[v]].x;
+        texcoord[1] = texcoords[order[v]].y;
+        normal_out[0] = normal.x;
+        normal_out[1] = normal.y;
+        normal_out[2] = normal.z;
+        color_out[0] = color.r;
+        color_out[1] = color.g;
+        color_out[2] = color.b;
+        color_out[3] = color.a;
+    }
+}
+
+// Horizontal quad over cells [x0, x1] x [z0, z1] at height y. Texture
+// coordinates count cells, so the grid lines repeat once per cell however
+// many cells the quad covers.
+static void add_cell_rect(const City *city, int x0, int z0, int x1, int z1, float y, Color color)
+{
+    const float halfCell = (FLOOR_CUBE_SIZE + FLOOR_SPACING) / 2.0f;
+    Vector3 low = get_grid_cell_position(city->size, x0, z0);
+    Vector3 high = get_grid_cell_position(city->size, x1, z1);
+
+    Vector3 corners[4] = {
+        {low.x - halfCell, y, low.z - halfCell},
+        {low.x - halfCell, y, high.z + halfCell},
+        {high.x + halfCell, y, high.z + halfCell},
+        {high.x + halfCell, y, low.z - halfCell}};
+    Vector2 texcoords[4] = {
+        {(float)x0, (float)z0},
+        {(float)x0, (float)(z1 + 1)},
+        {(float)(x1 + 1), (float)(z1 + 1)},
+        {(float)(x1 + 1), (float)z0}};
+    add_quad(corners, texcoords, (Vector3){0.0f, 1.0f, 0.0f}, color);
+}
+
+// Copies the scratch quads out into a chunk of their own.
+static FloorChunk take_chunk_geometry(void)
+{
+    FloorChunk chunk = {0};
+    int vertex_count = mesh_builder.quad_count * 4;
+    chunk.quad_count = mesh_builder.quad_count;
+    chunk.vertices = (float *)MemAlloc(sizeof(float) * 3 * vertex_count);
+    chunk.texcoords = (float *)MemAlloc(sizeof(float) * 2 * vertex_count);
+    chunk.normals = (float *)MemAlloc(sizeof(float) * 3 * vertex_count);
+    chunk.colors = (unsigned char *)MemAlloc(4 * vertex_count);
+
+    memcpy(chunk.vertices, mesh_builder.vertices, sizeof(float) * 3 * vertex_count);
+    memcpy(chunk.texcoords, mesh_builder.texcoords, sizeof(float) * 2 * vertex_count);
+    memcpy(chunk.normals, mesh_builder.normals, sizeof(float) * 3 * vertex_count);
+    memcpy(chunk.colors, mesh_builder.colors, 4 * vertex_count);
+
+    mesh_builder.quad_count = 0;
+    return chunk;
+}
+
+static void free_chunk_geometry(FloorChunk *chunk)
+{
+    MemFree(chunk->vertices);
+    MemFree(chunk->texcoords);
+    MemFree(chunk->normals);
+    MemFree(chunk->colors);
+    *chunk = (FloorChunk){0};
+}
+
+static void get_chunk_origin(const City *city, uint32_t chunk_index, int *x0, int *z0)
+{
+    uint32_t chunks = city->grid.chunks_per_side;
+    *x0 = (int)(chunk_index % chunks) * GRID_CHUNK_SIZE;
+    *z0 = (int)(chunk_index / chunks) * GRID_CHUNK_SIZE;
+}
+
+/* ========== TERRAIN ========== */
+
+// Only rock rises out of the ground. Everything buildable sits at 0, where
+// buildings stand and the mouse picks.
+static float get_cell_height(const City *city, int grid_x, int grid_z)
+{
+    if (!city->terrain_height || city_grid_get_type(city, grid_x, grid_z) != GRID_CELL_BLOCKED)
+        return 0.0f;
+
+    float rock = (city->terrain_height[grid_z * city->size + grid_x] - TERRAIN_BLOCK_HEIGHT) * TERRAIN_HEIGHT_SCALE;
+    return TERRAIN_HEIGHT_STEP * fmaxf(1.0f, ceilf(rock / TERRAIN_HEIGHT_STEP));
+}
+
+static Color get_cell_color(const City *city, int grid_x, int grid_z, float height)
+{
+    switch (city_grid_get_type(city, grid_x, grid_z))
+    {
+    case GRID_CELL_BUILDING:
+        return (Color){60, 60, 60, 255};
+    case GRID_CELL_BLOCKED:
+        // Higher rock catches more light.
+        return ColorLerp((Color){110, 55, 35, 255}, (Color){175, 105, 70, 255}, Clamp(height / 4.0f, 0.0f, 1.0f));
+    default:
+        return DARKGRAY;
+    }
+}
+
+// Cliff faces on the sides of a rock cell that drop to a lower neighbor. The
+// camera looks down from +x +z, so the faces it sees are lit the most.
+static void add_cell_walls(const City *city, int grid_x, int grid_z, float height, Color color)
+{
+    static const int step_x[4] = {1, 0, -1, 0};
+    static const int step_z[4] = {0, 1, 0, -1};
+    static const float shade[4] = {0.85f, 0.7f, 0.55f, 0.55f};
+    const float halfCell = (FLOOR_CUBE_SIZE + FLOOR_SPACING) / 2.0f;
+    Vector3 center = get_grid_cell_position(city->size, grid_x, grid_z);
+
+    for (int side = 0; side < 4; side++)
+    {
+        float below = get_cell_height(city, grid_x + step_x[side], grid_z + step_z[side]);
+        if (below >= height)
+            continue;
+
+        // The edge shared with the neighbor, running across the side.
+        Vector3 normal = {(float)step_x[side], 0.0f, (float)step_z[side]};
+        Vector3 edge = {center.x + normal.x * halfCell, 0.0f, center.z + normal.z * halfCell};
+        Vector3 across = {normal.z * halfCell, 0.0f, -normal.x * halfCell};
+
+        Vector3 corners[4] = {
+            {edge.x - across.x, height, edge.z - across.z},
+            {edge.x - across.x, below, edge.z - across.z},
+            {edge.x + across.x, below, edge.z + across.z},
+            {edge.x + across.x, height, edge.z + across.z}};
+        float cellSize = FLOOR_CUBE_SIZE + FLOOR_SPACING;
+        Vector2 texcoords[4] = {
+            {0.0f, height / cellSize},
+            {0.0f, below / cellSize},
+            {1.0f, below / cellSize},
+            {1.0f, height / cellSize}};
+        add_quad(corners, texcoords, normal, ColorBrightness(color, shade[side] - 1.0f));
+    }
+}
+
+// Greedy meshing: the top of the chunk is covered with the fewest rectangles
+// of cells that share a height and color, and rock gets its cliff faces. A
+// chunk of open ground is a single quad.
+static FloorChunk build_terrain_chunk(const City *city, uint32_t chunk_index)
+{
+    int x0, z0;
+    get_chunk_origin(city, chunk_index, &x0, &z0);
+
+    float heights[GRID_CHUNK_SIZE * GRID_CHUNK_SIZE];
+    Color colors[GRID_CHUNK_SIZE * GRID_CHUNK_SIZE];
+    bool is_covered[GRID_CHUNK_SIZE * GRID_CHUNK_SIZE] = {0};
+
+    for (int z = 0; z < GRID_CHUNK_SIZE; z++)
+    {
+        for (int x = 0; x < GRID_CHUNK_SIZE; x++)
+        {
+            int cell = z * GRID_CHUNK_SIZE + x;
+            heights[cell] = get_cell_height(city, x0 + x, z0 + z);
+            colors[cell] = get_cell_color(city, x0 + x, z0 + z, heights[cell]);
+            if (heights[cell] > 0.0f)
+                add_cell_walls(city, x0 + x, z0 + z, heights[cell], colors[cell]);
+        }
+    }
+
+#define SAME_TOP(a, b) (heights[a] == heights[b] && ColorToInt(colors[a]) == ColorToInt(colors[b]))
+
+    for (int z = 0; z < GRID_CHUNK_SIZE; z++)
+    {
+        for (int x = 0; x < GRID_CHUNK_SIZE; x++)
+        {
+            int first = z * GRID_CHUNK_SIZE + x;
+            if (is_covered[first])
+                continue;
+
+            int width = 1;
+            while (x + width < GRID_CHUNK_SIZE && !is_covered[first + width] && SAME_TOP(first, first + width))
+                width++;
+
+            int depth = 1;
+            for (; z + depth < GRID_CHUNK_SIZE; depth++)
+            {
+                int row = first + depth * GRID_CHUNK_SIZE;
+                bool is_match = true;
+                for (int i = 0; i < width && is_match; i++)
+                    is_match = !is_covered[row + i] && SAME_TOP(first, row + i);
+                if (!is_match)
+                    break;
+            }
+
+            for (int dz = 0; dz < depth; dz++)
+                for (int dx = 0; dx < width; dx++)
+                    is_covered[first + dz * GRID_CHUNK_SIZE + dx] = true;
+
+            add_cell_rect(city, x0 + x, z0 + z, x0 + x + width - 1, z0 + z + depth - 1, heights[first], colors[first]);
+        }
+    }
+
+#undef SAME_TOP
+
+    return take_chunk_geometry();
+}
+
+/* ========== DEMAND MAP ========== */
+
+// Repaints the chunk's texels of the demand texture.
+static void paint_demand_chunk(const City *city, uint32_t chunk_index, Texture2D texture)
+{
+    int x0, z0;
+    get_chunk_origin(city, chunk_index, &x0, &z0);
+    Color pixels[GRID_CHUNK_SIZE * GRID_CHUNK_SIZE];
+
+    for (int z = 0; z < GRID_CHUNK_SIZE; z++)
+    {
+        for (int x = 0; x < GRID_CHUNK_SIZE; x++)
+        {
+            // Blue for no demand, through green, to red at twice the city average.
+            float demand = demand_field_sample(city->demand, get_grid_cell_position(city->size, x0 + x, z0 + z));
+            pixels[z * GRID_CHUNK_SIZE + x] = ColorFromHSV(240.0f * (1.0f - Clamp(demand / 2.0f, 0.0f, 1.0f)), 0.75f, 0.8f);
+        }
+    }
+
+    UpdateTextureRec(texture, (Rectangle){(float)x0, (float)z0, GRID_CHUNK_SIZE, GRID_CHUNK_SIZE}, pixels);
+}
+
+/* ========== CITY FLOOR ========== */
+
+static const char *floor_vertex_shader =
+    "#version 330\n"
+    "in vec3 vertexPosition;\n"
+    "in vec2 vertexTexCoord;\n"
+    "in vec3 vertexNormal;\n"
+    "in vec4 vertexColor;\n"
+    "uniform mat4 mvp;\n"
+    "uniform mat4 matModel;\n"
+    "out vec3 fragPosition;\n"
+    "out vec2 fragTexCoord;\n"
+    "out vec3 fragNormal;\n"
+    "out vec4 fragColor;\n"
+    "void main()\n"
+    "{\n"
+    "    fragPosition = vec3(matModel * vec4(vertexPosition, 1.0));\n"
+    "    fragTexCoord = vertexTexCoord;\n"
+    "    fragNormal = vertexNormal;\n"
+    "    fragColor = vertexColor;\n"
+    "    gl_Position = mvp * vec4(vertexPosition, 1.0);\n"
+    "}\n";
+
+// Texture coordinates count cells, so the lines sit where they cross whole
+// numbers. fwidth keeps them at least a pixel wide when zoomed out, where a
+// texture would have faded them into its smaller mipmaps.
+static const char *floor_fragment_shader =
+    "#version 330\n"
+    "in vec3 fragPosition;\n"
+    "in vec2 fragTexCoord;\n"
+    "in vec3 fragNormal;\n"
+    "in vec4 fragColor;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform vec4 colDiffuse;\n"
+    "uniform vec4 gridArea;\n" // corner x, corner z, cell size, cells per side
+    "uniform float lineWidth;\n"
+    "uniform int showDemand;\n"
+    "out vec4 finalColor;\n"
+    "void main()\n"
+    "{\n"
+    "    vec4 color = fragColor;\n"
+    "    if (showDemand != 0 && fragNormal.y > 0.5)\n"
+    "        color = texture(texture0, (fragPosition.xz - gridArea.xy) / (gridArea.z * gridArea.w));\n"
+    "    vec2 width = max(fwidth(fragTexCoord), vec2(lineWidth));\n"
+    "    vec2 edge = 1.0 - smoothstep(width, width * 1.5, fract(fragTexCoord));\n"
+    "    color.rgb *= mix(1.0, 0.6, max(edge.x, edge.y));\n"
+    "    finalColor = color * colDiffuse;\n"
+    "}\n";
+
+static void load_floor_material(CityFloor *floor, const City *city)
+{
+    const float cellSize = FLOOR_CUBE_SIZE + FLOOR_SPACING;
+    Vector3 corner = get_grid_cell_position(city->size, 0, 0);
+    float gridArea[4] = {corner.x - cellSize / 2.0f, corner.z - cellSize / 2.0f, cellSize, (float)city->size};
+    float lineWidth = GRID_LINE_WIDTH;
+    int showDemand = 0;
+
+    Shader shader = LoadShaderFromMemory(floor_vertex_shader, floor_fragment_shader);
+    SetShaderValue(shader, GetShaderLocation(shader, "gridArea"), gridArea, SHADER_UNIFORM_VEC4);
+    SetShaderValue(shader, GetShaderLocation(shader, "lineWidth"), &lineWidth, SHADER_UNIFORM_FLOAT);
+    floor->show_demand_location = GetShaderLocation(shader, "showDemand");
+    SetShaderValue(shader, floor->show_demand_location, &showDemand, SHADER_UNIFORM_INT);
+
+    // One texel per cell, sampled as is.
+    Image image = GenImageColor((int)city->size, (int)city->size, BLANK);
+    Texture2D texture = LoadTextureFromImage(image);
+    UnloadImage(image);
+    SetTextureFilter(texture, TEXTURE_FILTER_POINT);
+    SetTextureWrap(texture, TEXTURE_WRAP_CLAMP);
+
+    floor->material = LoadMaterialDefault();
+    floor->material.shader = shader;
+    SetMaterialTexture(&floor->material, MATERIAL_MAP_DIFFUSE, texture);
+    floor->has_material = true;
+}
+
+// Copies count quads, starting at quad first of the chunks taken in order,
+// into mesh from quad offset on.
+static void copy_chunk_quads(const CityFloor *floor, uint32_t chunk_count, int first, int count, Mesh *mesh)
+{
+    int offset = 0;
+    for (uint32_t c = 0; c < chunk_count && count > 0; c++)
+    {
+        const FloorChunk *chunk = &floor->terrain[c];
+        if (first >= chunk->quad_count)
+        {
+            first -= chunk->quad_count;
+            continue;
+        }
+
+        int quads = chunk->quad_count - first;
+        quads = (quads > count) ? count : quads;
+        int from = first * 4, to = offset * 4, vertices = quads * 4;
+        memcpy(mesh->vertices + to * 3, chunk->vertices + from * 3, sizeof(float) * 3 * vertices);
+        memcpy(mesh->texcoords + to * 2, chunk->texcoords + from * 2, sizeof(float) * 2 * vertices);
+        memcpy(mesh->normals + to * 3, chunk->normals + from * 3, sizeof(float) * 3 * vertices);
+        memcpy(mesh->colors + to * 4, chunk->colors + from * 4, 4 * vertices);
+
+        offset += quads;
+        count -= quads;
+        first = 0;
+    }
+}
+
+// Stitches the chunks into as few static meshes as 16-bit indices allow and
+// uploads them in place of the old ones.
+static void upload_floor_meshes(CityFloor *floor, uint32_t chunk_count)
+{
+    for (int m = 0; m < floor->mesh_count; m++)
+        UnloadMesh(floor->meshes[m]);
+    floor->mesh_count = 0;
+
+    int total = 0;
+    for (uint32_t c = 0; c < chunk_count; c++)
+        total += floor->terrain[c].quad_count;
+
+    for (int first = 0; first < total; first += FLOOR_MESH_QUADS)
+    {
+        int quads = (total - first > FLOOR_MESH_QUADS) ? FLOOR_MESH_QUADS : total - first;
+        Mesh mesh = {0};
+        mesh.vertexCount = quads * 4;
+        mesh.triangleCount = quads * 2;
+        mesh.vertices = (float *)MemAlloc(sizeof(float) * 3 * mesh.vertexCount);
+        mesh.texcoords = (float *)MemAlloc(sizeof(float) * 2 * mesh.vertexCount);
+        mesh.normals = (float *)MemAlloc(sizeof(float) * 3 * mesh.vertexCount);
+        mesh.colors = (unsigned char *)MemAlloc(4 * mesh.vertexCount);
+        mesh.indices = (unsigned short *)MemAlloc(sizeof(unsigned short) * 3 * mesh.triangleCount);
+
+        copy_chunk_quads(floor, chunk_count, first, quads, &mesh);
+        for (int quad = 0; quad < quads; quad++)
+        {
+            unsigned short *index = mesh.indices + quad * 6;
+            unsigned short base = (unsigned short)(quad * 4);
+            index[0] = base;
+            index[1] = base + 1;
+            index[2] = base + 2;
+            index[3] = base;
+            index[4] = base + 2;
+            index[5] = base + 3;
+        }
+
+        UploadMesh(&mesh, false);
+        floor->mesh_bounds[floor->mesh_count] = GetMeshBoundingBox(mesh);
+        floor->meshes[floor->mesh_count++] = mesh;
+    }
+}
+
+// Remeshes the chunks whose cells changed, then uploads the floor again if
+// any did. The demand texture is repainted where the field moved, or all
+// of it when the demand map is turned on.
+void update_city_floor(Game *game, int32_t city_index)
+{
+    City *city = &game->data.cities[city_index];
+    CityFloor *floor = &game->data.city_floors[city_index];
+    bool shows_demand = game->state.is_demand_map_visible && city->demand;
+    bool repaint_all = shows_demand && !floor->shows_demand;
+    uint32_t chunks = city->grid.chunks_per_side;
+    bool is_remeshed = false;
+
+    if (!floor->has_material)
+        load_floor_material(floor, city);
+    if (shows_demand != floor->shows_demand)
+    {
+        int showDemand = shows_demand;
+        SetShaderValue(floor->material.shader, floor->show_demand_location, &showDemand, SHADER_UNIFORM_INT);
+        floor->shows_demand = shows_demand;
+    }
+
+    for (uint32_t c = 0; c < chunks * chunks; c++)
+    {
+        bool is_terrain_dirty = city_grid_take_dirty(city, c, GRID_DIRTY_RENDER);
+        bool is_overlay_dirty = city_grid_take_dirty(city, c, GRID_DIRTY_OVERLAY);
+
+        if (!floor->has_terrain[c] || is_terrain_dirty)
+        {
+            if (floor->has_terrain[c])
+                free_chunk_geometry(&floor->terrain[c]);
+            floor->terrain[c] = build_terrain_chunk(city, c);
+            floor->has_terrain[c] = true;
+            is_remeshed = true;
+        }
+
+        if (shows_demand && (is_overlay_dirty || repaint_all))
+            paint_demand_chunk(city, c, floor->material.maps[MATERIAL_MAP_DIFFUSE].texture);
+    }
+
+    if (is_remeshed)
+        upload_floor_meshes(floor, chunks * chunks);
+}
+
+// One draw call for the whole floor on all but rocky giant maps, where the
+// meshes are bands of chunks and those out of view are skipped.
+void queue_city_floor(Game *game, int32_t city_index, const Frustum *frustum, RenderQueue *queue)
+{
+    CityFloor *floor = &game->data.city_floors[city_index];
+    for (int m = 0; m < floor->mesh_count; m++)
+    {
+        BoundingBox bounds = floor->mesh_bounds[m];
+        if (frustum_test_box(frustum, bounds))
+            queue_mesh(queue, RENDER_LAYER_OPAQUE, &floor->meshes[m], &floor->material, MatrixIdentity(),
+                       Vector3Scale(Vector3Add(bounds.min, bounds.max), 0.5f));
+    }
+}
+
+void unload_city_floors(Game *game)
+{
+    for (int i = 0; i < MAX_CITIES; i++)
+    {
+        CityFloor *floor = &game->data.city_floors[i];
+        for (int c = 0; c < MAX_GRID_CHUNKS; c++)
+        {
+            if (floor->has_terrain[c])
+                free_chunk_geometry(&floor->terrain[c]);
+            floor->has_terrain[c] = false;
+        }
+
+        for (int m = 0; m < floor->mesh_count; m++)
+            UnloadMesh(floor->meshes[m]);
+        floor->mesh_count = 0;
+
+        // Takes the shader and the demand texture with it.
+        if (floor->has_material)
+            UnloadMaterial(floor->material);
+        floor->has_material = false;
+    }
+}
+
+/* ========== BUILDINGS ========== */
+
+static void queue_building_mesh(Game *game, RenderQueue *queue, int32_t template_index, int32_t lod, int32_t mesh_index);
+
+// The template's model at a level of detail, 0 being the full one.
+static const Model *get_building_model(const Game *game, int32_t template_index, int32_t lod)
+{
+    const BuildingTemplate *template = &game->data.building_templates[template_index];
+    return (lod > 0) ? &template->lods[lod - 1] : &template->model;
+}
+
+// Lit by a sun and a sky that follow timeOfDay, the only uniform that
+// changes from frame to frame. Buildings with their lights on (tint alpha)
+// glow warm once the sun is down. Everything but the texture lookup is done
+// per vertex: voxel faces are flat, so it looks the same.
+static const char *building_vertex_shader =
+    "#version 330\n"
+    "in vec3 vertexPosition;\n"
+    "in vec2 vertexTexCoord;\n"
+    "in vec3 vertexNormal;\n"
+    "in vec4 vertexColor;\n"
+    "layout(location = " TO_STRING(INSTANCE_TRANSFORM_LOCATION) ") in mat4 instanceTransform;\n"
+    "layout(location = " TO_STRING(INSTANCE_TINT_LOCATION) ") in vec4 instanceTint;\n"
+    "uniform mat4 mvp;\n" // view and projection only, the model comes per instance
+    "uniform float timeOfDay;\n" // 0 at midnight, 0.5 at noon
+    "out vec2 fragTexCoord;\n"
+    "out vec4 fragColor;\n"
+    "out vec3 fragLight;\n"
+    "void main()\n"
+    "{\n"
+    "    float angle = (timeOfDay - 0.25) * 6.2831853;\n" // rises in the east at 6:00
+    "    vec3 sun = normalize(vec3(cos(angle), sin(angle), 0.4));\n"
+    "    float daylight = smoothstep(-0.1, 0.25, sun.y);\n"
+    "    vec3 sky = mix(vec3(0.10, 0.12, 0.24), vec3(0.42, 0.42, 0.46), daylight);\n"
+    "    vec3 sunColor = mix(vec3(1.0, 0.55, 0.3), vec3(1.0, 0.96, 0.88), clamp(sun.y * 2.0, 0.0, 1.0)) * daylight;\n"
+    "    vec3 normal = normalize(mat3(instanceTransform) * vertexNormal);\n"
+    "    vec3 lights = vec3(1.0, 0.78, 0.45) * 0.55 * instanceTint.a * (1.0 - daylight);\n"
+    "    fragLight = sky + sunColor * 0.7 * max(dot(normal, sun), 0.0) + lights;\n"
+    "    fragTexCoord = vertexTexCoord;\n"
+    "    fragColor = vertexColor * vec4(instanceTint.rgb, 1.0);\n"
+    "    gl_Position = mvp * instanceTransform * vec4(vertexPosition, 1.0);\n"
+    "}\n";
+
+static const char *building_fragment_shader =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "in vec4 fragColor;\n"
+    "in vec3 fragLight;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform vec4 colDiffuse;\n"
+    "out vec4 finalColor;\n"
+    "void main()\n"
+    "{\n"
+    "    vec4 albedo = texture(texture0, fragTexCoord) * colDiffuse * fragColor;\n"
+    "    finalColor = vec4(albedo.rgb * fragLight, albedo.a);\n"
+    "}\n";
+
+static void load_building_shader(BuildingRenderer *renderer)
+{
+    renderer->shader = LoadShaderFromMemory(building_vertex_shader, building_fragment_shader);
+    renderer->time_of_day_location = GetShaderLocation(renderer->shader, "timeOfDay");
+    renderer->has_shader = true;
+    renderer->city_index = -1;
+}
+
+// Grows both buffers of a template to fit count instances, at least
+// doubling so a row of placements doesn't reallocate every time.
+static void reserve_instances(BuildingInstances *instances, uint32_t count)
+{
+    if (count <= instances->capacity)
+        return;
+
+    uint32_t capacity = (instances->capacity < 16) ? 16 : instances->capacity;
+    while (capacity < count)
+        capacity *= 2;
+
+    instances->transforms = (Matrix *)MemRealloc(instances->transforms, sizeof(Matrix) * capacity);
+    instances->tints = (Color *)MemRealloc(instances->tints, sizeof(Color) * capacity);
+    instances->run_firsts = (uint32_t *)MemRealloc(instances->run_firsts, sizeof(uint32_t) * capacity);
+    instances->run_counts = (uint32_t *)MemRealloc(instances->run_counts, sizeof(uint32_t) * capacity);
+    if (instances->transform_buffer)
+        rlUnloadVertexBuffer(instances->transform_buffer);
+    if (instances->tint_buffer)
+        rlUnloadVertexBuffer(instances->tint_buffer);
+    instances->transform_buffer = rlLoadVertexBuffer(NULL, (int)(sizeof(Matrix) * capacity), true);
+    instances->tint_buffer = rlLoadVertexBuffer(NULL, (int)(sizeof(Color) * capacity), true);
+    instances->capacity = capacity;
+}
+
+// Scratch list of the city's buildings in chunk order, refilled with the instances.
+static int32_t ordered_buildings[MAX_BUILDINGS_PER_CITY];
+
+// Lists every building of the city chunk by chunk, in the order of the BVH
+// leaves, and the end of each chunk in the list. Without a BVH they all go
+// in one chunk. Returns how many chunks there are.
+static uint32_t order_buildings_by_chunk(const City *city, uint32_t chunk_ends[MAX_GRID_CHUNKS])
+{
+    const BuildingBvh *bvh = city->bvh;
+    uint32_t count = 0;
+
+    if (!bvh)
+    {
+        for (uint32_t i = 0; i < city_building_slots(city); i++)
+        {
+            if (city_get_building(city, i)->id != -1)
+                ordered_buildings[count++] = (int32_t)i;
+        }
+        chunk_ends[0] = count;
+        return 1;
+    }
+
+    uint32_t chunk_count = bvh->chunks_per_side * bvh->chunks_per_side;
+    for (uint32_t c = 0; c < chunk_count; c++)
+    {
+        const BvhLeaf *leaf = &bvh->leaves[c];
+        for (uint32_t i = 0; i < leaf->count && count < MAX_BUILDINGS_PER_CITY; i++)
+            ordered_buildings[count++] = leaf->packets[i / 4].items[i % 4];
+        chunk_ends[c] = count;
+    }
+    return chunk_count;
+}
+
+// Regroups all of the city's buildings by template, chunk by chunk, and
+// uploads their transforms, built the way DrawModelEx builds them.
+static void fill_building_instances(Game *game, const City *city)
+{
+    BuildingRenderer *renderer = &game->data.building_renderer;
+    const Vector3 scale = {BUILDING_MODEL_SCALE, BUILDING_MODEL_SCALE, BUILDING_MODEL_SCALE};
+    uint32_t chunk_ends[MAX_GRID_CHUNKS];
+    uint32_t counts[TEMPLATE_COUNT] = {0};
+    renderer->chunk_count = order_buildings_by_chunk(city, chunk_ends);
+    uint32_t building_count = renderer->chunk_count ? chunk_ends[renderer->chunk_count - 1] : 0;
+
+    for (uint32_t i = 0; i < building_count; i++)
+        counts[city_get_building(city, (uint32_t)ordered_buildings[i])->template.type]++;
+
+    for (int t = 0; t < TEMPLATE_COUNT; t++)
+    {
+        reserve_instances(&renderer->templates[t], counts[t]);
+        renderer->templates[t].count = 0;
+    }
+
+    uint32_t i = 0;
+    for (uint32_t c = 0; c < renderer->chunk_count; c++)
+    {
+        for (int t = 0; t < TEMPLATE_COUNT; t++)
+            renderer->templates[t].chunk_starts[c] = renderer->templates[t].count;
+
+        for (; i < chunk_ends[c]; i++)
+        {
+            const Building *building = city_get_building(city, (uint32_t)ordered_buildings[i]);
+            BuildingInstances *instances = &renderer->templates[building->template.type];
+            const Model *model = &game->data.building_templates[building->template.type].model;
+            Matrix placement = MatrixMultiply(MatrixMultiply(MatrixScale(scale.x, scale.y, scale.z),
+                                                             MatrixRotateY(building->rotation_angle * DEG2RAD)),
+                                              MatrixTranslate(building->position.x, building->position.y, building->position.z));
+
+            // rlgl hands matrices to GL column by column, and the shader reads them back that way.
+            float16 columns = MatrixToFloatV(MatrixMultiply(model->transform, placement));
+            memcpy(&instances->transforms[instances->count], columns.v, sizeof(Matrix));
+            Color tint = game->data.companies[building->owner_id].color;
+            tint.a = building->is_operational ? 255 : 0;
+            instances->tints[instances->count] = tint;
+            instances->count++;
+        }
+    }
+
+    for (int t = 0; t < TEMPLATE_COUNT; t++)
+    {
+        BuildingInstances *instances = &renderer->templates[t];
+        instances->chunk_starts[renderer->chunk_count] = instances->count;
+        if (instances->count == 0)
+            continue;
+        rlUpdateVertexBuffer(instances->transform_buffer, instances->transforms, (int)(sizeof(Matrix) * instances->count), 0);
+        rlUpdateVertexBuffer(instances->tint_buffer, instances->tints, (int)(sizeof(Color) * instances->count), 0);
+    }
+}
+
+// Adds instances [first, first + count) to the runs to draw, extending the
+// last run when they follow on from it.
+static void add_instance_run(BuildingInstances *instances, uint32_t first, uint32_t count)
+{
+    uint32_t last = instances->run_count - 1;
+    if (instances->run_count > 0 && instances->run_firsts[last] + instances->run_counts[last] == first)
+    {
+        instances->run_counts[last] += count;
+        return;
+    }
+    instances->run_firsts[instances->run_count] = first;
+    instances->run_counts[instances->run_count] = count;
+    instances->run_count++;
+}
+
+// Picks the runs of instances to draw: the chunks in view, with neighbors
+// in the buffers merged into one run. Chunks on the edge of the view have
+// their buildings tested four at a time against the frustum, and only
+// those that pass are drawn. Nothing is uploaded.
+static void select_instance_runs(BuildingRenderer *renderer, const City *city, const Frustum *frustum)
+{
+    uint8_t visibility[MAX_GRID_CHUNKS] = {0};
+    if (city->bvh)
+        cull_city_chunks(city, frustum, visibility);
+    else
+        visibility[0] = CHUNK_INSIDE; // one chunk of everything; the GPU clips what's off screen
+
+    for (int t = 0; t < TEMPLATE_COUNT; t++)
+        renderer->templates[t].run_count = 0;
+
+    for (uint32_t c = 0; c < renderer->chunk_count; c++)
+    {
+        if (visibility[c] == CHUNK_INSIDE)
+        {
+            for (int t = 0; t < TEMPLATE_COUNT; t++)
+            {
+                BuildingInstances *instances = &renderer->templates[t];
+                uint32_t first = instances->chunk_starts[c];
+                uint32_t count = instances->chunk_starts[c + 1] - first;
+                if (count > 0)
+                    add_instance_run(instances, first, count);
+            }
+            continue;
+        }
+        if (visibility[c] != CHUNK_CROSSING)
+            continue;
+
+        // The chunk's instances went into the buffers in leaf order, so the
+        // next building of a template in the leaf is the next instance of it.
+        uint32_t next[TEMPLATE_COUNT];
+        for (int t = 0; t < TEMPLATE_COUNT; t++)
+            next[t] = renderer->templates[t].chunk_starts[c];
+
+        const BvhLeaf *leaf = &city->bvh->leaves[c];
+        for (uint32_t i = 0; i < leaf->count; i += 4)
+        {
+            const BvhPacket *packet = &leaf->packets[i / 4];
+            int inside;
+            int visible = frustum_test_packet(frustum, packet, &inside);
+            for (uint32_t j = 0; j < 4 && i + j < leaf->count; j++)
+            {
+                int type = city_get_building(city, (uint32_t)packet->items[j])->template.type;
+                BuildingInstances *instances = &renderer->templates[type];
+                if (next[type] >= instances->chunk_starts[c + 1])
+                    continue; // past what fit in the buffers
+                if (visible & (1 << j))
+                    add_instance_run(instances, next[type], 1);
+                next[type]++;
+            }
+        }
+    }
+}
+
+// Hooks the instance buffers to the mesh's vertex array for one draw, and
+// unhooks them after so plain DrawModelEx calls on the same model, like the
+// placement preview, still work.
+static void draw_mesh_instances(const BuildingRenderer *renderer, const BuildingInstances *instances, Mesh mesh,
+                                const Material *material)
+{
+    if (!rlEnableVertexArray(mesh.vaoId))
+        return;
+
+    Color color = material->maps[MATERIAL_MAP_DIFFUSE].color;
+    float diffuse[4] = {color.r / 255.0f, color.g / 255.0f, color.b / 255.0f, color.a / 255.0f};
+    rlSetUniform(renderer->shader.locs[SHADER_LOC_COLOR_DIFFUSE], diffuse, SHADER_UNIFORM_VEC4, 1);
+
+    int slot = 0;
+    rlActiveTextureSlot(0);
+    rlEnableTexture(material->maps[MATERIAL_MAP_DIFFUSE].texture.id);
+    rlSetUniform(renderer->shader.locs[SHADER_LOC_MAP_DIFFUSE], &slot, SHADER_UNIFORM_INT, 1);
+
+    if (!mesh.colors)
+    {
+        float white[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        rlSetVertexAttributeDefault(RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR, white, SHADER_ATTRIB_VEC4, 4);
+    }
+    if (!mesh.normals)
+    {
+        float up[3] = {0.0f, 1.0f, 0.0f};
+        rlSetVertexAttributeDefault(RL_DEFAULT_SHADER_ATTRIB_LOCATION_NORMAL, up, SHADER_ATTRIB_VEC3, 3);
+    }
+
+    for (int column = 0; column < 4; column++)
+    {
+        rlEnableVertexAttribute(INSTANCE_TRANSFORM_LOCATION + column);
+        rlSetVertexAttributeDivisor(INSTANCE_TRANSFORM_LOCATION + column, 1);
+    }
+    rlEnableVertexAttribute(INSTANCE_TINT_LOCATION);
+    rlSetVertexAttributeDivisor(INSTANCE_TINT_LOCATION, 1);
+
+    // GL 3.3 has no base instance, so each run points the attributes at its
+    // first instance instead.
+    for (uint32_t r = 0; r < instances->run_count; r++)
+    {
+        int first = (int)instances->run_firsts[r];
+        rlEnableVertexBuffer(instances->transform_buffer);
+        for (int column = 0; column < 4; column++)
+        {
+            rlSetVertexAttribute(INSTANCE_TRANSFORM_LOCATION + column, 4, RL_FLOAT, false, sizeof(Matrix),
+                                 first * (int)sizeof(Matrix) + column * (int)sizeof(Vector4));
+        }
+        rlEnableVertexBuffer(instances->tint_buffer);
+        rlSetVertexAttribute(INSTANCE_TINT_LOCATION, 4, RL_UNSIGNED_BYTE, true, 0, first * (int)sizeof(Color));
+
+        if (mesh.indices)
+            rlDrawVertexArrayElementsInstanced(0, mesh.triangleCount * 3, 0, (int)instances->run_counts[r]);
+        else
+            rlDrawVertexArrayInstanced(0, mesh.vertexCount, (int)instances->run_counts[r]);
+    }
+
+    for (int column = 0; column < 4; column++)
+    {
+        rlSetVertexAttributeDivisor(INSTANCE_TRANSFORM_LOCATION + column, 0);
+        rlDisableVertexAttribute(INSTANCE_TRANSFORM_LOCATION + column);
+    }
+    rlSetVertexAttributeDivisor(INSTANCE_TINT_LOCATION, 0);
+    rlDisableVertexAttribute(INSTANCE_TINT_LOCATION);
+
+    rlDisableVertexBuffer();
+    rlDisableVertexArray();
+    rlDisableTexture();
+}
+
+// Picks each template's level of detail by how big one of its voxels is on
+// screen: the coarsest level whose voxels stay under LOD_VOXEL_PIXELS. The
+// city camera is orthographic, so every building of a template is the same
+// size on screen and one level serves them all, which keeps them in one
+// instanced draw; a perspective camera is judged at its target. A level is
+// only left once the view is LOD_HYSTERESIS of a level past the switch
+// point, so a zoom resting there doesn't flicker between two.
+static void select_building_lods(Game *game)
+{
+    BuildingRenderer *renderer = &game->data.building_renderer;
+    const Camera3D *camera = &game->camera;
+    float view_height = camera->fovy;
+    if (camera->projection == CAMERA_PERSPECTIVE)
+        view_height = 2.0f * Vector3Distance(camera->position, camera->target) * tanf(camera->fovy * 0.5f * DEG2RAD);
+    float pixels_per_unit = GetScreenHeight() / view_height;
+
+    for (int t = 0; t < TEMPLATE_COUNT; t++)
+    {
+        const BuildingTemplate *template = &game->data.building_templates[t];
+        if (template->lod_count == 0 || !template->shape)
+        {
+            renderer->lods[t] = 0;
+            continue;
+        }
+
+        float voxel_pixels = template->shape->cell_size.y * BUILDING_MODEL_SCALE * pixels_per_unit;
+        float level = log2f(LOD_VOXEL_PIXELS / voxel_pixels);
+        int32_t lod = renderer->lods[t];
+        if (level >= lod + 1 + LOD_HYSTERESIS)
+            lod = (int32_t)floorf(level - LOD_HYSTERESIS);
+        else if (level < lod - LOD_HYSTERESIS)
+            lod = (int32_t)floorf(level + LOD_HYSTERESIS);
+        renderer->lods[t] = (lod < 0) ? 0 : (lod > template->lod_count) ? template->lod_count : lod;
+    }
+}
+
+// Queues the city's buildings in view, one instanced draw per template mesh
+// however many buildings share it.
+void queue_city_buildings(Game *game, int32_t city_index, const Frustum *frustum, RenderQueue *queue)
+{
+    BuildingRenderer *renderer = &game->data.building_renderer;
+    const City *city = &game->data.cities[city_index];
+
+    if (!renderer->has_shader)
+        load_building_shader(renderer);
+
+    // Without a BVH there is nothing to tell edits by, so refill every frame.
+    bool is_stale = !city->bvh || renderer->city_index != city_index || renderer->revision != city->bvh->revision ||
+                    renderer->lights_revision != city->lights_revision;
+    if (is_stale)
+    {
+        fill_building_instances(game, city);
+        renderer->city_index = city_index;
+        renderer->revision = city->bvh ? city->bvh->revision : 0;
+        renderer->lights_revision = city->lights_revision;
+    }
+    if (is_stale || memcmp(&renderer->frustum, frustum, sizeof(Frustum)) != 0)
+    {
+        select_instance_runs(renderer, city, frustum);
+        renderer->frustum = *frustum;
+    }
+
+    // The whole day/night cycle, for every building at once.
+    float time_of_day = sim_time_of_day(&game->data.sim);
+    SetShaderValue(renderer->shader, renderer->time_of_day_location, &time_of_day, SHADER_UNIFORM_FLOAT);
+
+    select_building_lods(game);
+    for (int t = 0; t < TEMPLATE_COUNT; t++)
+    {
+        if (renderer->templates[t].run_count == 0)
+            continue;
+
+        for (int m = 0; m < get_building_model(game, t, renderer->lods[t])->meshCount; m++)
+            queue_building_mesh(game, queue, t, renderer->lods[t], m);
+    }
+}
+
+void unload_building_renderer(Game *game)
+{
+    BuildingRenderer *renderer = &game->data.building_renderer;
+    for (int t = 0; t < TEMPLATE_COUNT; t++)
+    {
+        BuildingInstances *instances = &renderer->templates[t];
+        if (instances->transform_buffer)
+            rlUnloadVertexBuffer(instances->transform_buffer);
+        if (instances->tint_buffer)
+            rlUnloadVertexBuffer(instances->tint_buffer);
+        MemFree(instances->transforms);
+        MemFree(instances->tints);
+        MemFree(instances->run_firsts);
+        MemFree(instances->run_counts);
+        *instances = (BuildingInstances){0};
+    }
+
+    if (renderer->has_shader)
+        UnloadShader(renderer->shader);
+    renderer->has_shader = false;
+}
+
+/* ========== RENDER QUEUE ========== */
+
+void render_queue_begin(RenderQueue *queue, Camera3D camera)
+{
+    queue->count = 0;
+    queue->dropped_count = 0;
+    queue->eye = camera.position;
+    queue->forward = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+}
+
+// Opaque items are grouped by shader, then texture, then mesh, and drawn
+// front to back within a group so the depth test throws more away. Blended
+// items go last, back to front, whatever their state. Ids are cut down to
+// fit; a collision only splits a group.
+static uint64_t make_sort_key(RenderLayer layer, unsigned int shader, unsigned int texture, unsigned int mesh, float depth)
+{
+    uint64_t state = ((uint64_t)(shader & 0x3FF) << 28) | ((uint64_t)(texture & 0xFFF) << 16) | (uint64_t)(mesh & 0xFFFF);
+    uint64_t near = (uint64_t)(Clamp(depth / RENDER_MAX_DEPTH, 0.0f, 1.0f) * 0xFFFFFF);
+
+    if (layer == RENDER_LAYER_TRANSPARENT)
+        return ((uint64_t)layer << 62) | ((0xFFFFFF - near) << 38) | state;
+    return ((uint64_t)layer << 62) | (state << 24) | near;
+}
+
+// Shader and texture an item binds when drawn.
+static void get_item_state(const Game *game, const RenderItem *item, unsigned int *shader, unsigned int *texture)
+{
+    const Material *material = NULL;
+    switch (item->type)
+    {
+    case RENDER_ITEM_MESH:
+        material = item->mesh.material;
+        break;
+    case RENDER_ITEM_MODEL:
+        material = (item->model.model->materialCount > 0) ? &item->model.model->materials[0] : NULL;
+        break;
+    case RENDER_ITEM_BUILDINGS:
+    {
+        const Model *model = get_building_model(game, item->buildings.template_index, item->buildings.lod);
+        material = &model->materials[model->meshMaterial[item->buildings.mesh_index]];
+        *shader = game->data.building_renderer.shader.id;
+        *texture = material->maps[MATERIAL_MAP_DIFFUSE].texture.id;
+        return;
+    }
+    default:
+        break;
+    }
+
+    *shader = material ? material->shader.id : rlGetShaderIdDefault();
+    *texture = material ? material->maps[MATERIAL_MAP_DIFFUSE].texture.id : rlGetTextureIdDefault();
+}
+
+static float get_depth(const RenderQueue *queue, Vector3 position)
+{
+    return Vector3DotProduct(Vector3Subtract(position, queue->eye), queue->forward);
+}
+
+// Everything the submit loop carries from one item to the next.
+typedef struct
+{
+    Matrix view_projection;
+    unsigned int shader;
+    unsigned int texture;
+    bool is_building_shader_bound;
+    bool is_batch_pending; // rlgl holds primitives not drawn yet
+    RenderStats stats;
+
+} SubmitState;
+
+static void draw_item(Game *game, const RenderItem *item, SubmitState *state)
+{
+    unsigned int shader = 0, texture = 0;
+    get_item_state(game, item, &shader, &texture);
+    state->stats.shader_binds += (shader != state->shader);
+    state->stats.texture_binds += (texture != state->texture);
+    state->shader = shader;
+    state->texture = texture;
+
+    // Direct draws go out at once, so primitives batched before them must
+    // go first, or blended items would end up under what they cover.
+    bool is_batched = item->type == RENDER_ITEM_CUBE || item->type == RENDER_ITEM_CUBE_WIRES;
+    if (!is_batched && state->is_batch_pending)
+    {
+        rlDrawRenderBatchActive();
+        state->stats.batch_flushes++;
+        state->is_batch_pending = false;
+    }
+
+    const BuildingRenderer *renderer = &game->data.building_renderer;
+    if (item->type != RENDER_ITEM_BUILDINGS && state->is_building_shader_bound)
+    {
+        rlDisableShader();
+        state->is_building_shader_bound = false;
+    }
+
+    switch (item->type)
+    {
+    case RENDER_ITEM_MESH:
+        DrawMesh(*item->mesh.mesh, *item->mesh.material, item->mesh.transform);
+        break;
+    case RENDER_ITEM_MODEL:
+    {
+        float scale = item->model.scale;
+        DrawModelEx(*item->model.model, item->model.position, (Vector3){0, 1, 0}, item->model.rotation_angle,
+                    (Vector3){scale, scale, scale}, item->model.tint);
+        break;
+    }
+    case RENDER_ITEM_BUILDINGS:
+    {
+        const Model *model = get_building_model(game, item->buildings.template_index, item->buildings.lod);
+        int32_t m = item->buildings.mesh_index;
+        if (!state->is_building_shader_bound)
+        {
+            rlEnableShader(renderer->shader.id);
+            rlSetUniformMatrix(renderer->shader.locs[SHADER_LOC_MATRIX_MVP], state->view_projection);
+            state->is_building_shader_bound = true;
+        }
+        draw_mesh_instances(renderer, &renderer->templates[item->buildings.template_index], model->meshes[m],
+                            &model->materials[model->meshMaterial[m]]);
+        break;
+    }
+    case RENDER_ITEM_CUBE:
+        DrawCubeV(item->cube.position, item->cube.size, item->cube.color);
+        break;
+    case RENDER_ITEM_CUBE_WIRES:
+        DrawCubeWiresV(item->cube.position, item->cube.size, item->cube.color);
+        break;
+    }
+
+    state->is_batch_pending |= is_batched;
+}
+
+// Hands out the next item, or NULL once the queue is full. The floor and
+// the buildings are queued first, so what gets dropped is a few agents.
+static RenderItem *push_item(RenderQueue *queue, uint64_t key)
+{
+    if (queue->count == MAX_RENDER_ITEMS)
+    {
+        queue->dropped_count++;
+        return NULL;
+    }
+
+    uint32_t i = queue->count++;
+    queue->entries[i] = (RenderSortEntry){key, i};
+    return &queue->items[i];
+}
+
+void queue_mesh(RenderQueue *queue, RenderLayer layer, const Mesh *mesh, const Material *material, Matrix transform, Vector3 position)
+{
+    uint64_t key = make_sort_key(layer, material->shader.id, material->maps[MATERIAL_MAP_DIFFUSE].texture.id, mesh->vaoId,
+                                 get_depth(queue, position));
+    RenderItem *item = push_item(queue, key);
+    if (item)
+        *item = (RenderItem){.type = RENDER_ITEM_MESH, .mesh = {mesh, material, transform}};
+}
+
+void queue_model(RenderQueue *queue, RenderLayer layer, const Model *model, Vector3 position, float rotation_angle, float scale, Color tint)
+{
+    unsigned int shader = rlGetShaderIdDefault(), texture = rlGetTextureIdDefault();
+    if (model->materialCount > 0)
+    {
+        shader = model->materials[0].shader.id;
+        texture = model->materials[0].maps[MATERIAL_MAP_DIFFUSE].texture.id;
+    }
+
+    unsigned int mesh = (model->meshCount > 0) ? model->meshes[0].vaoId : 0;
+    RenderItem *item = push_item(queue, make_sort_key(layer, shader, texture, mesh, get_depth(queue, position)));
+    if (item)
+        *item = (RenderItem){.type = RENDER_ITEM_MODEL, .model = {model, position, rotation_angle, scale, tint}};
+}
+
+static void queue_building_mesh(Game *game, RenderQueue *queue, int32_t template_index, int32_t lod, int32_t mesh_index)
+{
+    const Model *model = get_building_model(game, template_index, lod);
+    const Material *material = &model->materials[model->meshMaterial[mesh_index]];
+    uint64_t key = make_sort_key(RENDER_LAYER_OPAQUE, game->data.building_renderer.shader.id,
+                                 material->maps[MATERIAL_MAP_DIFFUSE].texture.id, model->meshes[mesh_index].vaoId, 0.0f);
+    RenderItem *item = push_item(queue, key);
+    if (item)
+        *item = (RenderItem){.type = RENDER_ITEM_BUILDINGS, .buildings = {template_index, lod, mesh_index}};
+}
+
+// Cubes go through rlgl's batch; with the default shader and texture they
+// all sort into one run, drawn with a single flush.
+void queue_cube(RenderQueue *queue, Vector3 position, Vector3 size, Color color)
+{
+    uint64_t key = make_sort_key((color.a < 255) ? RENDER_LAYER_TRANSPARENT : RENDER_LAYER_OPAQUE, rlGetShaderIdDefault(),
+                                 rlGetTextureIdDefault(), 0, get_depth(queue, position));
+    RenderItem *item = push_item(queue, key);
+    if (item)
+        *item = (RenderItem){.type = RENDER_ITEM_CUBE, .cube = {position, size, color}};
+}
+
+void queue_cube_wires(RenderQueue *queue, Vector3 position, Vector3 size, Color color)
+{
+    uint64_t key = make_sort_key((color.a < 255) ? RENDER_LAYER_TRANSPARENT : RENDER_LAYER_OPAQUE, rlGetShaderIdDefault(),
+                                 rlGetTextureIdDefault(), 0, get_depth(queue, position));
+    RenderItem *item = push_item(queue, key);
+    if (item)
+        *item = (RenderItem){.type = RENDER_ITEM_CUBE_WIRES, .cube = {position, size, color}};
+}
+
+// Least significant byte first, eight passes at most. A pass whose byte is
+// the same in every key (most of the shader and texture bytes, in practice)
+// is skipped.
+static void radix_sort(RenderSortEntry *entries, RenderSortEntry *scratch, uint32_t count)
+{
+    uint32_t histograms[8][256] = {0};
+    for (uint32_t i = 0; i < count; i++)
+    {
+        for (int pass = 0; pass < 8; pass++)
+            histograms[pass][(entries[i].key >> (pass * 8)) & 0xFF]++;
+    }
+
+    RenderSortEntry *from = entries, *to = scratch;
+    for (int pass = 0; pass < 8; pass++)
+    {
+        uint32_t *histogram = histograms[pass];
+        int shift = pass * 8;
+        if (count == 0 || histogram[(from[0].key >> shift) & 0xFF] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (int digit = 0; digit < 256; digit++)
+        {
+            uint32_t digit_count = histogram[digit];
+            histogram[digit] = offset;
+            offset += digit_count;
+        }
+        for (uint32_t i = 0; i < count; i++)
+            to[histogram[(from[i].key >> shift) & 0xFF]++] = from[i];
+
+        RenderSortEntry *swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != entries)
+        memcpy(entries, from, sizeof(RenderSortEntry) * count);
+}
+
+// Sorts the frame's items and draws them. Call inside BeginMode3D; the
+// stats of the frame are left in queue->stats.
+void render_queue_submit(Game *game, RenderQueue *queue)
+{
+    radix_sort(queue->entries, queue->scratch, queue->count);
+
+    SubmitState state = {0};
+    state.view_projection = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+    state.shader = state.texture = (unsigned int)-1; // the first item always binds
+    state.stats.item_count = queue->count;
+    state.stats.dropped_count = queue->dropped_count;
+
+    for (uint32_t i = 0; i < queue->count; i++)
+        draw_item(game, &queue->items[queue->entries[i].item], &state);
+
+    if (state.is_building_shader_bound)
+        rlDisableShader();
+    if (state.is_batch_pending)
+    {
+        rlDrawRenderBatchActive();
+        state.stats.batch_flushes++;
+    }
+
+    queue->stats = state.stats;
+    queue->count = 0;
+    queue->dropped_count = 0;
+}
@@ -0,0 +1,588 @@
+#include "game.h"
+
+/* ========== RANDOM ========== */
+
+// PCG32: small, fast and fully determined by the seed, so a simulation
+// replays identically from the same state.
+uint32_t sim_random(uint64_t *state)
+{
+    uint64_t old = *state;
+    *state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+    uint32_t rot = (uint32_t)(old >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+float sim_random_float(uint64_t *state)
+{
+    return (sim_random(state) >> 8) * (1.0f / 16777216.0f); // [0, 1)
+}
+
+static float random_exponential(uint64_t *state, float rate)
+{
+    if (rate <= 0.0f)
+        return INFINITY;
+    return -logf(1.0f - sim_random_float(state)) / rate;
+}
+
+static uint32_t random_poisson(uint64_t *state, float mean)
+{
+    if (mean <= 0.0f)
+        return 0;
+
+    // Knuth for small means, normal approximation for large ones.
+    if (mean < 30.0f)
+    {
+        float limit = expf(-mean);
+        float product = sim_random_float(state);
+        uint32_t k = 0;
+        while (product > limit)
+        {
+            product *= sim_random_float(state);
+            k++;
+        }
+        return k;
+    }
+
+    float u1 = fmaxf(sim_random_float(state), 1e-7f);
+    float u2 = sim_random_float(state);
+    float normal = sqrtf(-2.0f * logf(u1)) * cosf(2.0f * PI * u2);
+    float value = mean + sqrtf(mean) * normal + 0.5f;
+    return (value > 0.0f) ? (uint32_t)value : 0;
+}
+
+/* ========== CUSTOMER POOL ========== */
+
+static Customer *spawn_customer(CustomerPool *pool)
+{
+    for (uint32_t i = 0; i < pool->chunk_count; i++)
+    {
+        CustomerChunk *chunk = pool->chunks[i];
+        if (chunk->count < CUSTOMER_CHUNK_CAPACITY)
+        {
+            pool->total++;
+            return &chunk->customers[chunk->count++];
+        }
+    }
+
+    if (pool->chunk_count >= MAX_CUSTOMER_CHUNKS)
+        return NULL;
+
+    CustomerChunk *chunk = (CustomerChunk *)calloc(1, sizeof(CustomerChunk));
+    if (!chunk)
+        return NULL;
+
+    pool->chunks[pool->chunk_count++] = chunk;
+    pool->total++;
+    return &chunk->customers[chunk->count++];
+}
+
+static void clear_customers(CustomerPool *pool)
+{
+    for (uint32_t i = 0; i < pool->chunk_count; i++)
+        pool->chunks[i]->count = 0;
+    pool->total = 0;
+}
+
+/* ========== PLACEMENT HELPERS ========== */
+
+// Picks a point on the spawn ring around the building and returns it.
+static Vector3 random_spawn_point(uint64_t *rng, Vector3 around)
+{
+    float angle = sim_random_float(rng) * 2.0f * PI;
+    return (Vector3){
+        around.x + cosf(angle) * CUSTOMER_SPAWN_RADIUS,
+        0.0f,
+        around.z + sinf(angle) * CUSTOMER_SPAWN_RADIUS};
+}
+
+// Offsets queued and eating customers around the door so they don't overlap.
+static Vector3 queue_slot_position(Vector3 door, uint32_t slot)
+{
+    float angle = slot * 0.9f;
+    float radius = 1.2f + 0.15f * slot;
+    return (Vector3){door.x + cosf(angle) * radius, 0.0f, door.z + sinf(angle) * radius};
+}
+
+/* ========== RATES ========== */
+
+static const ModifierTables *building_modifiers(const Simulation *sim, const Building *building)
+{
+    return (building->owner_id == PLAYER_COMPANY_ID) ? &sim->modifiers : &sim->rival_modifiers;
+}
+
+// Sums up what the building's staff add and cost, with perks. Staff records
+// belong to the main thread, so this runs there whenever a building's staff
+// or the perks change; the tick and the forks only read the sums.
+void sim_refresh_building_staff(const Simulation *sim, City *city, uint32_t building_id)
+{
+    const Building *building = city_get_building(city, building_id);
+    BuildingFlow *flow = &city->flows[building_id];
+    const ModifierTables *modifiers = building_modifiers(sim, building);
+    BuildingType type = building->template.type;
+    float staff_efficiency = 0.0f;
+    float payroll = 0.0f;
+
+    for (uint32_t i = 0; i < building->current_staff_count; i++)
+    {
+        const Staff *staff = building->assigned_staff[i];
+        if (!staff)
+            continue;
+
+        staff_efficiency += staff->base_efficiency * modifiers->efficiency[staff->role][staff->rarity][type];
+        payroll += staff->salary * modifiers->salary[staff->role][staff->rarity][type];
+    }
+
+    flow->staff_efficiency = staff_efficiency;
+    flow->payroll = payroll;
+    flow->rates_revision = 0;
+}
+
+// Main thread, after the perks changed.
+void sim_refresh_staff(Game *game)
+{
+    for (int c = 0; c < MAX_CITIES; c++)
+    {
+        City *city = &game->data.cities[c];
+        for (uint32_t i = 0; i < city_building_slots(city); i++)
+        {
+            if (city_get_building(city, i)->id != -1)
+                sim_refresh_building_staff(&game->data.sim, city, i);
+        }
+    }
+}
+
+// Recomputes the rates that depend on staff, perks and local demand. Runs when
+// one of those changes, never as part of the regular tick. Only reads the
+// building and its flow, so forks can run it on a worker.
+static void refresh_building_rates(const Building *building, BuildingFlow *flow, const ModifierTables *modifiers)
+{
+    BuildingType type = building->template.type;
+    flow->arrival_rate = building->template.customer_rate * modifiers->economy[type].customer_multiplier * flow->demand *
+                         flow->synergy;
+    flow->service_rate = building->template.service_rate * (1.0f + flow->staff_efficiency);
+    flow->rates_revision = modifiers->revision;
+}
+
+static void ensure_building_rates(const Building *building, BuildingFlow *flow, const ModifierTables *modifiers)
+{
+    if (flow->rates_revision != modifiers->revision)
+        refresh_building_rates(building, flow, modifiers);
+}
+
+// Steady-state M/D/1 queue length (Poisson arrivals, the fixed service rate
+// the agents see), capped where customers start to balk.
+static float expected_queue_length(float arrival_rate, float service_rate)
+{
+    if (service_rate <= 0.0f)
+        return CUSTOMER_MAX_QUEUE;
+
+    float rho = arrival_rate / service_rate;
+    if (rho >= 1.0f)
+        return CUSTOMER_MAX_QUEUE;
+
+    return fminf(rho * rho / (2.0f * (1.0f - rho)), CUSTOMER_MAX_QUEUE);
+}
+
+// Moves whole dollars earned and owed by the building into its owner's funds.
+static void settle_building_money(const Building *building, BuildingFlow *flow, const BuildingEconomy *economy,
+                                  uint64_t *funds, float dt)
+{
+    flow->upkeep_carry += (economy->upkeep_per_second + flow->payroll / SIM_DAY_LENGTH) * dt;
+
+    uint64_t revenue = (uint64_t)flow->revenue_carry;
+    uint64_t upkeep = (uint64_t)flow->upkeep_carry;
+    flow->revenue_carry -= (float)revenue;
+    flow->upkeep_carry -= (float)upkeep;
+
+    uint64_t *net_worth = &funds[building->owner_id];
+    *net_worth += revenue;
+    *net_worth = (*net_worth > upkeep) ? *net_worth - upkeep : 0;
+}
+
+/* ========== AGGREGATE LOD ========== */
+
+void sim_tick_city_aggregate(City *city, Simulation *sim, uint64_t *funds, float dt)
+{
+    float blend = 1.0f - expf(-dt / SIM_QUEUE_SMOOTHING);
+
+    for (uint32_t c = 0; c < city->building_chunk_count; c++)
+    {
+        const BuildingChunk *chunk = city->building_chunks[c];
+        for (uint32_t k = 0; k < BUILDING_CHUNK_CAPACITY; k++)
+        {
+            const Building *building = &chunk->buildings[k];
+            if (building->id == -1)
+                continue;
+
+            const ModifierTables *modifiers = building_modifiers(sim, building);
+            BuildingFlow *flow = &city->flows[c * BUILDING_CHUNK_CAPACITY + k];
+            ensure_building_rates(building, flow, modifiers);
+
+            const BuildingEconomy *economy = &modifiers->economy[building->template.type];
+            float served = fminf(flow->arrival_rate, flow->service_rate);
+            float target_queue = expected_queue_length(flow->arrival_rate, flow->service_rate);
+
+            flow->avg_queue += (target_queue - flow->avg_queue) * blend;
+            flow->served_total += served * dt;
+            flow->revenue_carry += served * economy->revenue_per_customer * dt;
+            settle_building_money(building, flow, economy, funds, dt);
+        }
+    }
+}
+
+/* ========== FULL LOD ========== */
+
+void sim_tick_city_full(City *city, Simulation *sim, uint64_t *funds, float dt)
+{
+    CustomerPool *pool = &sim->customers;
+    uint16_t serve_budget[MAX_BUILDINGS_PER_CITY];
+
+    // Arrivals and service capacity per building.
+    for (uint32_t c = 0; c < city->building_chunk_count; c++)
+    {
+        const BuildingChunk *chunk = city->building_chunks[c];
+        for (uint32_t k = 0; k < BUILDING_CHUNK_CAPACITY; k++)
+        {
+            uint32_t i = c * BUILDING_CHUNK_CAPACITY + k;
+            const Building *building = &chunk->buildings[k];
+            serve_budget[i] = 0;
+            if (building->id == -1)
+                continue;
+
+            BuildingFlow *flow = &city->flows[i];
+            ensure_building_rates(building, flow, building_modifiers(sim, building));
+
+            flow->next_arrival -= dt;
+            while (flow->next_arrival <= 0.0f)
+            {
+                Customer *customer = spawn_customer(pool);
+                if (customer)
+                {
+                    customer->position = random_spawn_point(&flow->rng_state, building->position);
+                    customer->destination = building->position;
+                    customer->building_id = i;
+                    customer->state = CUSTOMER_STATE_MOVING;
+                    customer->timer = 0.0f;
+                }
+                flow->next_arrival += random_exponential(&flow->rng_state, flow->arrival_rate);
+            }
+
+            flow->service_credit += flow->service_rate * dt;
+            uint32_t servable = (uint32_t)flow->service_credit;
+            serve_budget[i] = (uint16_t)((servable < flow->queue_count) ? servable : flow->queue_count);
+            flow->service_credit -= serve_budget[i];
+            if (flow->queue_count == 0)
+                flow->service_credit = fminf(flow->service_credit, 1.0f); // idle staff can't bank service
+        }
+    }
+
+    // One pass over all agents.
+    float step = CUSTOMER_WALK_SPEED * dt;
+    for (uint32_t c = 0; c < pool->chunk_count; c++)
+    {
+        CustomerChunk *chunk = pool->chunks[c];
+        for (uint32_t k = 0; k < chunk->count;)
+        {
+            Customer *customer = &chunk->customers[k];
+            const Building *building = city_get_building(city, customer->building_id);
+            BuildingFlow *flow = &city->flows[customer->building_id];
+            bool despawn = false;
+
+            switch (customer->state)
+            {
+            case CUSTOMER_STATE_MOVING:
+            case CUSTOMER_STATE_LEAVING:
+            {
+                Vector3 to_target = Vector3Subtract(customer->destination, customer->position);
+                float distance = Vector3Length(to_target);
+                if (distance > step)
+                {
+                    customer->position = Vector3Add(customer->position, Vector3Scale(to_target, step / distance));
+                    break;
+                }
+
+                customer->position = customer->destination;
+                if (customer->state == CUSTOMER_STATE_LEAVING)
+                {
+                    despawn = true;
+                }
+                else if (flow->queue_count >= CUSTOMER_MAX_QUEUE)
+                {
+                    // Queue too long: balk and walk away.
+                    customer->state = CUSTOMER_STATE_LEAVING;
+                    customer->destination = random_spawn_point(&flow->rng_state, customer->position);
+                }
+                else
+                {
+                    customer->state = CUSTOMER_STATE_QUEUED;
+                    customer->position = queue_slot_position(customer->destination, flow->queue_count);
+                    flow->queue_count++;
+                }
+            }
+            break;
+            case CUSTOMER_STATE_QUEUED:
+            {
+                if (serve_budget[customer->building_id] > 0)
+                {
+                    serve_budget[customer->building_id]--;
+                    flow->queue_count--;
+                    flow->eating_count++;
+                    flow->served_total += 1.0f;
+                    flow->revenue_carry += building_modifiers(sim, building)->economy[building->template.type].revenue_per_customer;
+                    customer->state = CUSTOMER_STATE_EATING;
+                    customer->timer = CUSTOMER_EAT_TIME;
+                }
+            }
+            break;
+            case CUSTOMER_STATE_EATING:
+            {
+                customer->timer -= dt;
+                if (customer->timer <= 0.0f)
+                {
+                    flow->eating_count--;
+                    customer->state = CUSTOMER_STATE_LEAVING;
+                    customer->destination = random_spawn_point(&flow->rng_state, customer->destination);
+                }
+            }
+            break;
+            default:
+                break;
+            }
+
+            if (despawn)
+            {
+                chunk->customers[k] = chunk->customers[--chunk->count];
+                pool->total--;
+            }
+            else
+            {
+                k++;
+            }
+        }
+    }
+
+    // Feed the live queues back into the statistics the aggregate model uses.
+    float blend = 1.0f - expf(-dt / SIM_QUEUE_SMOOTHING);
+    for (uint32_t c = 0; c < city->building_chunk_count; c++)
+    {
+        const BuildingChunk *chunk = city->building_chunks[c];
+        for (uint32_t k = 0; k < BUILDING_CHUNK_CAPACITY; k++)
+        {
+            const Building *building = &chunk->buildings[k];
+            if (building->id == -1)
+                continue;
+
+            BuildingFlow *flow = &city->flows[c * BUILDING_CHUNK_CAPACITY + k];
+            flow->avg_queue += (flow->queue_count - flow->avg_queue) * blend;
+            settle_building_money(building, flow, &building_modifiers(sim, building)->economy[building->template.type], funds, dt);
+        }
+    }
+}
+
+/* ========== LOD SWITCHING ========== */
+
+// Drops the city's agents. Their effect is already folded into each
+// building's flow statistics, which the aggregate model continues from.
+static void collapse_city_agents(City *city, Simulation *sim)
+{
+    clear_customers(&sim->customers);
+    for (uint32_t i = 0; i < city_building_slots(city); i++)
+    {
+        city->flows[i].queue_count = 0;
+        city->flows[i].eating_count = 0;
+    }
+    city->lod = SIM_LOD_AGGREGATE;
+}
+
+// Rebuilds live agents whose counts match the aggregate model: queue lengths
+// from avg_queue, and walkers/eaters from the flow rates times the time each
+// stage takes (Little's law).
+static void regenerate_city_agents(City *city, Simulation *sim)
+{
+    uint64_t *rng = &sim->rng_state;
+    clear_customers(&sim->customers);
+
+    for (uint32_t i = 0; i < city_building_slots(city); i++)
+    {
+        const Building *building = city_get_building(city, i);
+        if (building->id == -1)
+            continue;
+
+        BuildingFlow *flow = &city->flows[i];
+        ensure_building_rates(building, flow, building_modifiers(sim, building));
+
+        float served = fminf(flow->arrival_rate, flow->service_rate);
+        uint32_t queued = random_poisson(rng, flow->avg_queue);
+        uint32_t eating = random_poisson(rng, served * CUSTOMER_EAT_TIME);
+        uint32_t arriving = random_poisson(rng, flow->arrival_rate * CUSTOMER_TRAVEL_TIME);
+        uint32_t leaving = random_poisson(rng, served * CUSTOMER_TRAVEL_TIME);
+        if (queued > CUSTOMER_MAX_QUEUE)
+            queued = CUSTOMER_MAX_QUEUE;
+
+        flow->queue_count = 0;
+        flow->eating_count = 0;
+        flow->service_credit = 0.0f;
+        flow->next_arrival = random_exponential(rng, flow->arrival_rate);
+
+        uint32_t total = queued + eating + arriving + leaving;
+        for (uint32_t n = 0; n < total; n++)
+        {
+            Customer *customer = spawn_customer(&sim->customers);
+            if (!customer)
+                break;
+
+            customer->building_id = i;
+            customer->timer = 0.0f;
+
+            if (n < queued)
+            {
+                customer->state = CUSTOMER_STATE_QUEUED;
+                customer->destination = building->position;
+                customer->position = queue_slot_position(building->position, flow->queue_count);
+                flow->queue_count++;
+            }
+            else if (n < queued + eating)
+            {
+                customer->state = CUSTOMER_STATE_EATING;
+                customer->destination = building->position;
+                customer->position = building->position;
+                customer->timer = sim_random_float(rng) * CUSTOMER_EAT_TIME;
+                flow->eating_count++;
+            }
+            else
+            {
+                // Walkers are spread uniformly along their path.
+                Vector3 edge = random_spawn_point(rng, building->position);
+                float progress = sim_random_float(rng);
+                bool inbound = n < queued + eating + arriving;
+
+                customer->state = inbound ? CUSTOMER_STATE_MOVING : CUSTOMER_STATE_LEAVING;
+                customer->destination = inbound ? building->position : edge;
+                customer->position = inbound ? Vector3Lerp(edge, building->position, progress)
+                                             : Vector3Lerp(building->position, edge, progress);
+            }
+        }
+    }
+
+    city->lod = SIM_LOD_FULL;
+}
+
+void sim_set_visible_city(Game *game, int32_t city_index)
+{
+    Simulation *sim = &game->data.sim;
+    if (sim->visible_city == city_index)
+        return;
+
+    if (sim->visible_city >= 0)
+        collapse_city_agents(&game->data.cities[sim->visible_city], sim);
+
+    sim->visible_city = city_index;
+
+    if (city_index >= 0)
+        regenerate_city_agents(&game->data.cities[city_index], sim);
+}
+
+// Drops the live agents headed for a building that is going away, so a
+// building placed in its slot later doesn't inherit their queue.
+void sim_forget_building(Game *game, int32_t city_index, int32_t building_id)
+{
+    CustomerPool *pool = &game->data.sim.customers;
+    if (game->data.sim.visible_city != city_index)
+        return;
+
+    for (uint32_t c = 0; c < pool->chunk_count; c++)
+    {
+        CustomerChunk *chunk = pool->chunks[c];
+        for (uint32_t k = 0; k < chunk->count;)
+        {
+            if (chunk->customers[k].building_id == building_id)
+            {
+                chunk->customers[k] = chunk->customers[--chunk->count];
+                pool->total--;
+            }
+            else
+            {
+                k++;
+            }
+        }
+    }
+}
+
+/* ========== MAIN LOOP ========== */
+
+void init_simulation(Game *game)
+{
+    Simulation *sim = &game->data.sim;
+    sim->tick = 0;
+    sim->rng_state = 0x853C49E6748FEA9BULL ^ (uint64_t)time(NULL);
+    sim->accumulator = 0.0f;
+    sim->visible_city = -1;
+    sim->customers = (CustomerPool){0};
+    sim->modifiers.revision = 0;
+    compile_modifier_tables(&game->data.skill_tree, game->data.building_templates, &sim->modifiers);
+    sim->rival_modifiers.revision = 0;
+    compile_modifier_tables(&(SkillTree){0}, game->data.building_templates, &sim->rival_modifiers);
+
+    for (int i = 0; i < MAX_CITIES; i++)
+        game->data.cities[i].lod = SIM_LOD_AGGREGATE;
+}
+
+// Advances every unlocked city by one fixed tick. Takes the pieces of the
+// world separately so snapshots can run it on their own copies.
+void sim_step_world(City *cities, Simulation *sim, uint64_t *funds)
+{
+    for (int i = 0; i < MAX_CITIES; i++)
+    {
+        City *city = &cities[i];
+        if (city->company_mask == 0)
+            continue;
+
+        if (city->lod == SIM_LOD_FULL)
+            sim_tick_city_full(city, sim, funds, SIM_TICK_DT);
+        else
+            sim_tick_city_aggregate(city, sim, funds, SIM_TICK_DT);
+    }
+    sim->tick++;
+}
+
+// Share of the in-game day gone by, 0 at midnight and 0.5 at noon.
+float sim_time_of_day(const Simulation *sim)
+{
+    const uint64_t ticks_per_day = (uint64_t)(SIM_DAY_LENGTH * SIM_TICK_RATE);
+    float time = SIM_DAY_START + (float)(sim->tick % ticks_per_day) / (float)ticks_per_day;
+    return (time >= 1.0f) ? time - 1.0f : time;
+}
+
+void update_simulation(Game *game, float dt)
+{
+    Simulation *sim = &game->data.sim;
+
+    int32_t visible = (game->state.current_scene == CITY_SCENE) ? (int32_t)game->state.current_city : -1;
+    sim_set_visible_city(game, visible);
+
+    // The kernel pays into one array indexed by company id.
+    uint64_t funds[MAX_COMPANIES];
+    for (int i = 0; i < MAX_COMPANIES; i++)
+        funds[i] = *get_company_funds(game, (uint8_t)i);
+
+    sim->accumulator = fminf(sim->accumulator + dt, SIM_TICK_DT * SIM_MAX_TICKS_PER_FRAME);
+    while (sim->accumulator >= SIM_TICK_DT)
+    {
+        sim_step_world(game->data.cities, sim, funds);
+        sim->accumulator -= SIM_TICK_DT;
+    }
+
+    for (int i = 0; i < MAX_COMPANIES; i++)
+        *get_company_funds(game, (uint8_t)i) = funds[i];
+}
+
+void clean_up_simulation(Game *game)
+{
+    CustomerPool *pool = &game->data.sim.customers;
+    for (uint32_t i = 0; i < pool->chunk_count; i++)
+        free(pool->chunks[i]);
+    *pool = (CustomerPool){0};
+    for (int i = 0; i < MAX_CITIES; i++)
+        city_release_buildings(&game->data.cities[i]);
+}
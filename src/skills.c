@@ -0,0 +1,108 @@
+#include "game.h"
+
+#define ROLE_BIT(role) (1u << (role))
+#define RARITY_BIT(rarity) (1u << (rarity))
+#define TYPE_BIT(type) (1u << (type))
+
+static const PerkDefinition perk_definitions[PERK_COUNT] = {
+    [PERK_SECRET_SAUCE] = {"Secret Sauce", 2000, -1, MODIFIER_REVENUE, 0, 0, 0, 1.15f},
+    [PERK_FLAGSHIP_KITCHENS] = {"Flagship Kitchens", 15000, PERK_SECRET_SAUCE, MODIFIER_REVENUE, 0, 0, TYPE_BIT(BUILDING_RESTAURANT_LARGE), 1.25f},
+    [PERK_DRIVE_THRU_TUBES] = {"Drive-Thru Tubes", 3000, -1, MODIFIER_CUSTOMERS, 0, 0, TYPE_BIT(BUILDING_RESTAURANT_SMALL), 1.2f},
+    [PERK_BULK_BUYING] = {"Bulk Buying", 8000, PERK_SECRET_SAUCE, MODIFIER_UPKEEP, 0, 0, 0, 0.85f},
+    [PERK_COOK_ACADEMY] = {"Cook Academy", 5000, -1, MODIFIER_EFFICIENCY, ROLE_BIT(ROLE_COOK), 0, 0, 1.25f},
+    [PERK_SERVER_TRAINING] = {"Server Training", 5000, -1, MODIFIER_EFFICIENCY, ROLE_BIT(ROLE_SERVER), 0, 0, 1.25f},
+    [PERK_TALENT_SCOUTS] = {"Talent Scouts", 20000, PERK_COOK_ACADEMY, MODIFIER_EFFICIENCY, 0, RARITY_BIT(RARITY_VERY_RARE) | RARITY_BIT(RARITY_UNIQUE), 0, 1.3f},
+    [PERK_UNION_DEAL] = {"Union Deal", 10000, PERK_SERVER_TRAINING, MODIFIER_SALARY, 0, 0, 0, 0.9f},
+};
+
+const PerkDefinition *get_perk_definition(PerkId id)
+{
+    return &perk_definitions[id];
+}
+
+bool is_perk_unlocked(const SkillTree *tree, PerkId id)
+{
+    return (tree->unlocked_mask >> id) & 1u;
+}
+
+bool can_unlock_perk(const Game *game, PerkId id)
+{
+    const PerkDefinition *perk = get_perk_definition(id);
+    const SkillTree *tree = &game->data.skill_tree;
+
+    if (is_perk_unlocked(tree, id))
+        return false;
+    if (perk->requires >= 0 && !is_perk_unlocked(tree, (PerkId)perk->requires))
+        return false;
+    return game->data.player.net_worth >= perk->cost;
+}
+
+bool unlock_perk(Game *game, PerkId id)
+{
+    if (!can_unlock_perk(game, id))
+        return false;
+
+    game->data.player.net_worth -= get_perk_definition(id)->cost;
+    game->data.skill_tree.unlocked_mask |= 1u << id;
+
+    // Staff sums are redone here; the rates follow on the next tick, when
+    // buildings notice the new revision.
+    compile_modifier_tables(&game->data.skill_tree, game->data.building_templates, &game->data.sim.modifiers);
+    sim_refresh_staff(game);
+    return true;
+}
+
+static bool mask_matches(uint32_t mask, uint32_t index)
+{
+    return mask == 0 || ((mask >> index) & 1u);
+}
+
+// Flattens every unlocked perk into the per-(role, rarity, type) tables. The
+// perk list is only walked here, never during a tick.
+void compile_modifier_tables(const SkillTree *tree, const BuildingTemplate *templates, ModifierTables *tables)
+{
+    float multipliers[MODIFIER_STAT_COUNT][ROLE_COUNT][RARITY_COUNT][TEMPLATE_COUNT];
+    for (int stat = 0; stat < MODIFIER_STAT_COUNT; stat++)
+        for (int role = 0; role < ROLE_COUNT; role++)
+            for (int rarity = 0; rarity < RARITY_COUNT; rarity++)
+                for (int type = 0; type < TEMPLATE_COUNT; type++)
+                    multipliers[stat][role][rarity][type] = 1.0f;
+
+    for (int id = 0; id < PERK_COUNT; id++)
+    {
+        if (!is_perk_unlocked(tree, (PerkId)id))
+            continue;
+
+        const PerkDefinition *perk = &perk_definitions[id];
+        for (int role = 0; role < ROLE_COUNT; role++)
+            for (int rarity = 0; rarity < RARITY_COUNT; rarity++)
+                for (int type = 0; type < TEMPLATE_COUNT; type++)
+                {
+                    if (mask_matches(perk->role_mask, role) && mask_matches(perk->rarity_mask, rarity) &&
+                        mask_matches(perk->type_mask, type))
+                        multipliers[perk->stat][role][rarity][type] *= perk->multiplier;
+                }
+    }
+
+    // Building-wide stats don't depend on staff; perks that target them
+    // ignore role and rarity, so any row of the table will do.
+    for (int type = 0; type < TEMPLATE_COUNT; type++)
+    {
+        BuildingEconomy *economy = &tables->economy[type];
+        economy->revenue_per_customer = templates[type].meal_price * multipliers[MODIFIER_REVENUE][0][0][type];
+        economy->customer_multiplier = multipliers[MODIFIER_CUSTOMERS][0][0][type];
+        economy->upkeep_per_second = templates[type].maintenance_cost * multipliers[MODIFIER_UPKEEP][0][0][type] / SIM_DAY_LENGTH;
+    }
+
+    for (int role = 0; role < ROLE_COUNT; role++)
+        for (int rarity = 0; rarity < RARITY_COUNT; rarity++)
+            for (int type = 0; type < TEMPLATE_COUNT; type++)
+            {
+                tables->efficiency[role][rarity][type] = multipliers[MODIFIER_EFFICIENCY][role][rarity][type];
+                tables->salary[role][rarity][type] = multipliers[MODIFIER_SALARY][role][rarity][type];
+            }
+
+    tables->revision++;
+    if (tables->revision == 0)
+        tables->revision = 1; // 0 marks stale building rates
+}
@@ -0,0 +1,251 @@
+#include "game.h"
+
+/* ========== FORKS ========== */
+
+// Forking copies the small per-city headers and the flows and bumps the
+// building chunks' refcounts; no building is copied until one side writes
+// it. Forks step on a worker with every city on the aggregate model, which
+// reads nothing outside the buildings and writes nothing but their flows:
+// the live agents are left behind, staff show up only as the sums in
+// BuildingFlow, and the city's grid and fields, which the main thread keeps
+// changing, are left out of the copy.
+SimFork *sim_fork_create(Game *game)
+{
+    SimFork *fork = (SimFork *)malloc(sizeof(SimFork));
+    if (!fork)
+        return NULL;
+
+    for (int i = 0; i < MAX_COMPANIES; i++)
+        fork->funds[i] = *get_company_funds(game, (uint8_t)i);
+    fork->sim = game->data.sim;
+    fork->sim.customers = (CustomerPool){0};
+    fork->sim.visible_city = -1;
+
+    bool is_shared = true;
+    for (int i = 0; i < MAX_CITIES; i++)
+    {
+        City *city = &fork->cities[i];
+        *city = game->data.cities[i];
+        city->lod = SIM_LOD_AGGREGATE;
+        city->terrain_height = NULL;
+        city->grid = (OccupancyGrid){0};
+        city->demand = NULL;
+        city->synergy = NULL;
+        city->bvh = NULL;
+        is_shared = city_share_buildings(city) && is_shared;
+    }
+
+    if (!is_shared)
+    {
+        sim_fork_destroy(fork);
+        return NULL;
+    }
+    return fork;
+}
+
+void sim_fork_destroy(SimFork *fork)
+{
+    if (!fork)
+        return;
+
+    for (int i = 0; i < MAX_CITIES; i++)
+        city_release_buildings(&fork->cities[i]);
+    free(fork);
+}
+
+void sim_fork_step(SimFork *fork, uint32_t ticks)
+{
+    for (uint32_t t = 0; t < ticks; t++)
+        sim_step_world(fork->cities, &fork->sim, fork->funds);
+}
+
+/* ========== PLACEMENT PREVIEW ========== */
+
+#define PREVIEW_STEP_TICKS 200 // ticks between cancel checks
+
+// Runs on a worker: simulates the world with and without the candidate
+// building and compares the two.
+static void run_placement_preview(void *data)
+{
+    PlacementPreview *preview = (PlacementPreview *)data;
+    uint32_t total_ticks = (uint32_t)(PREVIEW_DAYS * SIM_DAY_LENGTH * SIM_TICK_RATE);
+
+    preview->result = (PreviewResult){0};
+
+    // Let the candidate's draw spread through the demand around it, then
+    // hand the candidate and its neighbors what they'll see once it has.
+    City *city = &preview->candidate->cities[preview->city_index];
+    demand_window_settle(&preview->demand, (uint32_t)(PREVIEW_DAYS * SIM_DAY_LENGTH * DEMAND_UPDATE_RATE));
+    for (uint32_t i = 0; i < city_building_slots(city); i++)
+    {
+        const Building *building = city_get_building(city, i);
+        if (building->id == -1 || Vector3Distance(building->position, preview->position) > PREVIEW_NEIGHBOR_RADIUS)
+            continue;
+
+        city->flows[i].demand = demand_window_sample(&preview->demand, building->position, city->flows[i].demand);
+        city->flows[i].rates_revision = 0;
+    }
+
+    for (uint32_t t = 0; t < total_ticks; t += PREVIEW_STEP_TICKS)
+    {
+        if (atomic_load_explicit(&preview->cancel, memory_order_relaxed))
+            return;
+
+        uint32_t ticks = (total_ticks - t < PREVIEW_STEP_TICKS) ? total_ticks - t : PREVIEW_STEP_TICKS;
+        sim_fork_step(preview->baseline, ticks);
+        sim_fork_step(preview->candidate, ticks);
+    }
+
+    const City *base_city = &preview->baseline->cities[preview->city_index];
+    const City *new_city = &preview->candidate->cities[preview->city_index];
+    PreviewResult *result = &preview->result;
+
+    // Neighbors exist in both forks under the same ids; the candidate was
+    // placed into a slot that is empty in the baseline.
+    for (uint32_t i = 0; i < city_building_slots(base_city); i++)
+    {
+        const Building *before = city_get_building(base_city, i);
+        if (before->id == -1 || Vector3Distance(before->position, preview->position) > PREVIEW_NEIGHBOR_RADIUS)
+            continue;
+
+        result->neighbor_customers_delta += new_city->flows[i].served_total - base_city->flows[i].served_total;
+        result->neighbor_count++;
+    }
+    result->neighbor_customers_delta /= PREVIEW_DAYS;
+
+    // Marginal profit includes whatever the new building takes from its neighbors.
+    int64_t gain = (int64_t)preview->candidate->funds[PLAYER_COMPANY_ID] -
+                   (int64_t)preview->baseline->funds[PLAYER_COMPANY_ID];
+    result->profit_per_day = gain / PREVIEW_DAYS;
+    result->payback_days = INFINITY; // filled in by the main thread, which owns the templates
+    result->is_valid = true;
+}
+
+static void release_preview_forks(PlacementPreview *preview)
+{
+    sim_fork_destroy(preview->baseline);
+    sim_fork_destroy(preview->candidate);
+    demand_window_free(&preview->demand);
+    preview->baseline = NULL;
+    preview->candidate = NULL;
+    preview->is_running = false;
+}
+
+static void start_placement_preview(Game *game)
+{
+    PlacementPreview *preview = &game->state.placement_preview;
+    BuildingType type = game->state.selected_building_type_to_place;
+
+    preview->type = type;
+    preview->position = game->state.building_placement_position;
+    preview->rotation_angle = game->state.building_placement_rotation_angle;
+    preview->city_index = game->state.current_city;
+
+    const City *live_city = &game->data.cities[preview->city_index];
+    int grid_x, grid_z;
+    if (!city_grid_can_place(live_city, type, preview->position, preview->rotation_angle))
+        return;
+    city_grid_find_corner(live_city, type, preview->position, preview->rotation_angle, &grid_x, &grid_z);
+    Vector3 center = city_grid_footprint_center(live_city, type, grid_x, grid_z, preview->rotation_angle);
+
+    preview->baseline = sim_fork_create(game);
+    preview->candidate = sim_fork_create(game);
+    if (!preview->baseline || !preview->candidate)
+    {
+        release_preview_forks(preview);
+        return;
+    }
+
+    // Only the building chunk that receives the candidate gets copied.
+    City *city = &preview->candidate->cities[preview->city_index];
+    int32_t building_id = place_building(city, center, game->data.building_templates[type], preview->rotation_angle);
+    if (building_id < 0)
+    {
+        release_preview_forks(preview);
+        return;
+    }
+    Building *building = city_get_building_mut(city, building_id);
+    building->owner_id = PLAYER_COMPANY_ID;
+    building->grid_x = grid_x;
+    building->grid_z = grid_z;
+    city->flows[building_id].demand = demand_field_sample(live_city->demand, center);
+    city->flows[building_id].synergy = synergy_field_bonus(live_city->synergy, center, NULL);
+    city->current_building_count++;
+
+    // The forks have no fields, so what the candidate does to its neighbors
+    // is worked out from the live ones here: its crowding and appeal right
+    // away, its draw on demand by the job, on a copy of the field around it.
+    for (uint32_t i = 0; i < city_building_slots(city); i++)
+    {
+        const Building *neighbor = city_get_building(city, i);
+        if (neighbor->id == -1 || (int32_t)i == building_id ||
+            Vector3Distance(neighbor->position, preview->position) > PREVIEW_NEIGHBOR_RADIUS)
+            continue;
+
+        city->flows[i].synergy = synergy_field_bonus_with(live_city->synergy, neighbor->position, &neighbor->template, building);
+        city->flows[i].rates_revision = 0;
+    }
+
+    int radius = (int)ceilf(PREVIEW_NEIGHBOR_RADIUS / (FLOOR_CUBE_SIZE + FLOOR_SPACING)) + PREVIEW_DEMAND_MARGIN;
+    if (demand_window_copy(&preview->demand, live_city->demand, center, radius))
+        demand_window_add_building(&preview->demand, building);
+
+    atomic_store_explicit(&preview->cancel, false, memory_order_relaxed);
+    preview->is_running = true;
+    jobs_submit(&preview->job, run_placement_preview, preview);
+}
+
+// Called once per frame. Keeps at most one preview job in flight and restarts
+// it when the hovered cell, rotation or building type changes.
+void update_placement_preview(Game *game)
+{
+    PlacementPreview *preview = &game->state.placement_preview;
+    bool is_active = game->state.current_scene == CITY_SCENE && game->state.is_building_placement_mode;
+    bool inputs_changed = preview->type != game->state.selected_building_type_to_place ||
+                          preview->city_index != (int32_t)game->state.current_city ||
+                          preview->rotation_angle != game->state.building_placement_rotation_angle ||
+                          !Vector3Equals(preview->position, game->state.building_placement_position);
+
+    if (preview->is_running)
+    {
+        if (!is_active || inputs_changed)
+            atomic_store_explicit(&preview->cancel, true, memory_order_relaxed);
+
+        if (!job_is_done(&preview->job))
+            return;
+
+        if (!atomic_load_explicit(&preview->cancel, memory_order_relaxed) && preview->result.is_valid)
+        {
+            PreviewResult result = preview->result;
+            uint32_t base_cost = game->data.building_templates[preview->type].base_cost;
+            result.payback_days = (result.profit_per_day > 0) ? (float)base_cost / result.profit_per_day : INFINITY;
+            game->state.placement_preview_result = result;
+        }
+        release_preview_forks(preview);
+    }
+
+    if (!is_active)
+    {
+        game->state.placement_preview_result.is_valid = false;
+        preview->city_index = -1; // force a fresh preview next time
+        return;
+    }
+
+    if (inputs_changed)
+    {
+        game->state.placement_preview_result.is_valid = false;
+        start_placement_preview(game);
+    }
+}
+
+// Blocks until any running preview has stopped. Used on shutdown.
+void cancel_placement_preview(Game *game)
+{
+    PlacementPreview *preview = &game->state.placement_preview;
+    if (!preview->is_running)
+        return;
+
+    atomic_store_explicit(&preview->cancel, true, memory_order_relaxed);
+    job_wait(&preview->job);
+    release_preview_forks(preview);
+}
@@ -0,0 +1,253 @@
+#include "game.h"
+
+/* ========== SETUP ========== */
+
+SynergyField *synergy_field_create(MemoryArena *arena, uint32_t size)
+{
+    SynergyField *field = (SynergyField *)arena_alloc(arena, sizeof(SynergyField));
+    if (!field)
+        return NULL;
+
+    field->size = size;
+    field->row_sums = (float *)arena_alloc(arena, sizeof(float) * size * size);
+    if (!field->row_sums)
+        return NULL;
+
+    for (int channel = 0; channel < SYNERGY_CHANNEL_COUNT; channel++)
+    {
+        field->sources[channel] = (float *)arena_alloc(arena, sizeof(float) * size * size);
+        field->sums[channel] = (float *)arena_alloc(arena, sizeof(float) * size * size);
+        if (!field->sources[channel] || !field->sums[channel])
+            return NULL;
+    }
+
+    // The arena hands out zeroed memory, and no buildings means all sums are 0.
+    field->dirty_x0 = 0;
+    field->dirty_z0 = 0;
+    field->dirty_x1 = -1;
+    field->dirty_z1 = -1;
+    return field;
+}
+
+/* ========== EDITS ========== */
+
+static void expand_dirty_rect(SynergyField *field, int x0, int z0, int x1, int z1)
+{
+    x0 = (x0 < 0) ? 0 : x0;
+    z0 = (z0 < 0) ? 0 : z0;
+    x1 = (x1 >= (int)field->size) ? (int)field->size - 1 : x1;
+    z1 = (z1 >= (int)field->size) ? (int)field->size - 1 : z1;
+
+    if (field->dirty_x1 < field->dirty_x0)
+    {
+        field->dirty_x0 = x0;
+        field->dirty_z0 = z0;
+        field->dirty_x1 = x1;
+        field->dirty_z1 = z1;
+        return;
+    }
+
+    field->dirty_x0 = (x0 < field->dirty_x0) ? x0 : field->dirty_x0;
+    field->dirty_z0 = (z0 < field->dirty_z0) ? z0 : field->dirty_z0;
+    field->dirty_x1 = (x1 > field->dirty_x1) ? x1 : field->dirty_x1;
+    field->dirty_z1 = (z1 > field->dirty_z1) ? z1 : field->dirty_z1;
+}
+
+// Adds a building's crowding and appeal to its footprint (sign 1) or takes
+// them away again (sign -1). The sums catch up in update_synergy().
+void synergy_field_add_building(SynergyField *field, const Building *building, float sign)
+{
+    if (!field)
+        return;
+
+    const Footprint *footprint = get_footprint(building->template.type, building->rotation_angle);
+    float weights[SYNERGY_CHANNEL_COUNT] = {building->template.crowding, building->template.appeal};
+
+    for (int row = 0; row < footprint->height; row++)
+    {
+        for (int column = 0; column < footprint->width; column++)
+        {
+            if (!((footprint->rows[row] >> column) & 1u))
+                continue;
+
+            int x = building->grid_x + column;
+            int z = building->grid_z + row;
+            if (x < 0 || z < 0 || x >= (int)field->size || z >= (int)field->size)
+                continue;
+
+            for (int channel = 0; channel < SYNERGY_CHANNEL_COUNT; channel++)
+                field->sources[channel][z * field->size + x] += sign * weights[channel] / footprint->cell_count;
+        }
+    }
+
+    expand_dirty_rect(field, building->grid_x - SYNERGY_RADIUS, building->grid_z - SYNERGY_RADIUS,
+                      building->grid_x + footprint->width - 1 + SYNERGY_RADIUS,
+                      building->grid_z + footprint->height - 1 + SYNERGY_RADIUS);
+}
+
+/* ========== BOX SUMS ========== */
+
+// Recomputes the box sums inside the dirty rectangle as two running-sum
+// passes, so each cell costs the same whatever the radius.
+static void recompute_dirty_sums(SynergyField *field)
+{
+    const int size = (int)field->size;
+    const int x0 = field->dirty_x0, x1 = field->dirty_x1;
+    const int z0 = field->dirty_z0, z1 = field->dirty_z1;
+    const int row_z0 = (z0 - SYNERGY_RADIUS < 0) ? 0 : z0 - SYNERGY_RADIUS;
+    const int row_z1 = (z1 + SYNERGY_RADIUS >= size) ? size - 1 : z1 + SYNERGY_RADIUS;
+    float column_sums[MAP_SIZE_LARGE];
+
+    for (int channel = 0; channel < SYNERGY_CHANNEL_COUNT; channel++)
+    {
+        const float *sources = field->sources[channel];
+        float *sums = field->sums[channel];
+
+        // Horizontal: every row the vertical pass will read, dirty columns only.
+        for (int z = row_z0; z <= row_z1; z++)
+        {
+            const float *source_row = sources + z * size;
+            float *row_sums = field->row_sums + z * size;
+            float sum = 0.0f;
+            for (int x = x0 - SYNERGY_RADIUS; x <= x0 + SYNERGY_RADIUS; x++)
+                sum += (x >= 0 && x < size) ? source_row[x] : 0.0f;
+
+            row_sums[x0] = sum;
+            for (int x = x0 + 1; x <= x1; x++)
+            {
+                if (x + SYNERGY_RADIUS < size)
+                    sum += source_row[x + SYNERGY_RADIUS];
+                if (x - SYNERGY_RADIUS - 1 >= 0)
+                    sum -= source_row[x - SYNERGY_RADIUS - 1];
+                row_sums[x] = sum;
+            }
+        }
+
+        // Vertical: slide a window of rows down, a whole row at a time.
+        for (int x = x0; x <= x1; x++)
+            column_sums[x] = 0.0f;
+        for (int z = z0 - SYNERGY_RADIUS; z <= z0 + SYNERGY_RADIUS; z++)
+        {
+            if (z < 0 || z >= size)
+                continue;
+            for (int x = x0; x <= x1; x++)
+                column_sums[x] += field->row_sums[z * size + x];
+        }
+
+        for (int z = z0; z <= z1; z++)
+        {
+            if (z > z0)
+            {
+                const float *entering = field->row_sums + (z + SYNERGY_RADIUS) * size;
+                const float *leaving = field->row_sums + (z - SYNERGY_RADIUS - 1) * size;
+                bool has_entering = z + SYNERGY_RADIUS < size;
+                bool has_leaving = z - SYNERGY_RADIUS - 1 >= 0;
+                for (int x = x0; x <= x1; x++)
+                    column_sums[x] += (has_entering ? entering[x] : 0.0f) - (has_leaving ? leaving[x] : 0.0f);
+            }
+
+            for (int x = x0; x <= x1; x++)
+                sums[z * size + x] = column_sums[x];
+        }
+    }
+}
+
+// Multiplier on a restaurant's customers from what stands around position.
+// Pass the building's own template if it is already in the field, so it
+// doesn't compete with itself: the radius covers every footprint, so its
+// whole weight is in the sum at its center.
+float synergy_field_bonus(const SynergyField *field, Vector3 position, const BuildingTemplate *exclude)
+{
+    return synergy_field_bonus_with(field, position, exclude, NULL);
+}
+
+// The same, as if added stood in the field too. Lets a placement preview
+// see what a building would do to its neighbors before it is placed.
+float synergy_field_bonus_with(const SynergyField *field, Vector3 position, const BuildingTemplate *exclude,
+                               const Building *added)
+{
+    int x, z;
+    if (!field || !get_grid_cell_from_position(field->size, position, &x, &z))
+        return 1.0f;
+
+    float crowding = field->sums[SYNERGY_CROWDING][z * field->size + x];
+    float appeal = field->sums[SYNERGY_APPEAL][z * field->size + x];
+    if (exclude)
+    {
+        crowding -= exclude->crowding;
+        appeal -= exclude->appeal;
+    }
+
+    if (added)
+    {
+        // The part of its footprint within the radius, as the box sum would count it.
+        const Footprint *footprint = get_footprint(added->template.type, added->rotation_angle);
+        for (int row = 0; row < footprint->height; row++)
+        {
+            for (int column = 0; column < footprint->width; column++)
+            {
+                if (!((footprint->rows[row] >> column) & 1u) || abs(added->grid_x + column - x) > SYNERGY_RADIUS ||
+                    abs(added->grid_z + row - z) > SYNERGY_RADIUS)
+                    continue;
+
+                crowding += added->template.crowding / footprint->cell_count;
+                appeal += added->template.appeal / footprint->cell_count;
+            }
+        }
+    }
+
+    float bonus = 1.0f + SYNERGY_APPEAL_WEIGHT * fmaxf(appeal, 0.0f) - SYNERGY_CROWDING_WEIGHT * fmaxf(crowding, 0.0f);
+    return Clamp(bonus, SYNERGY_MIN, SYNERGY_MAX);
+}
+
+/* ========== UPDATE ========== */
+
+// Hands new bonuses to the buildings centered in the dirty rectangle, the
+// only ones whose neighborhood changed.
+static void refresh_dirty_buildings(City *city)
+{
+    const SynergyField *field = city->synergy;
+
+    for (int z = field->dirty_z0; z <= field->dirty_z1; z++)
+    {
+        for (int x = field->dirty_x0; x <= field->dirty_x1; x++)
+        {
+            int32_t building_id = city_grid_get_building(city, x, z);
+            if (building_id < 0)
+                continue;
+
+            const Building *building = city_get_building(city, building_id);
+            int center_x, center_z;
+            if (!get_grid_cell_from_position(city->size, building->position, &center_x, &center_z) ||
+                center_x != x || center_z != z)
+                continue;
+
+            BuildingFlow *flow = &city->flows[building_id];
+            float bonus = synergy_field_bonus(field, building->position, &building->template);
+            if (bonus == flow->synergy)
+                continue;
+
+            flow->synergy = bonus;
+            flow->rates_revision = 0;
+        }
+    }
+}
+
+// Called once per frame. Edits from the frame are merged into one rectangle
+// per city, so placing a row of buildings recomputes the overlap only once.
+void update_synergy(Game *game)
+{
+    for (int i = 0; i < MAX_CITIES; i++)
+    {
+        City *city = &game->data.cities[i];
+        SynergyField *field = city->synergy;
+        if (!field || field->dirty_x1 < field->dirty_x0)
+            continue;
+
+        recompute_dirty_sums(field);
+        refresh_dirty_buildings(city);
+
+        field->dirty_x1 = field->dirty_x0 - 1;
+        field->dirty_z1 = field->dirty_z0 - 1;
+    }
+}
@@ -0,0 +1,230 @@
+#include "game.h"
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* ========== NOISE ========== */
+
+static const float gradient_x[8] = {1.0f, -1.0f, 0.0f, 0.0f, 0.7071f, -0.7071f, 0.7071f, -0.7071f};
+static const float gradient_z[8] = {0.0f, 0.0f, 1.0f, -1.0f, 0.7071f, 0.7071f, -0.7071f, -0.7071f};
+
+// Picks one of the eight gradients for a lattice point.
+static uint32_t hash_lattice(uint64_t seed, int32_t x, int32_t z)
+{
+    uint64_t h = seed ^ ((uint64_t)(uint32_t)x * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t)(uint32_t)z * 0xC2B2AE3D27D4EB4FULL);
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 32;
+    return (uint32_t)h & 7u;
+}
+
+static float fade(float t)
+{
+    return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+// Adds one octave of gradient noise to height. Periods are multiples of 4 and
+// rows start on a lattice line, so each group of 4 cells sits inside a single
+// lattice cell and shares its 4 gradients; only the x offsets differ per lane.
+static void add_noise_octave(float *height, uint32_t size, uint64_t seed, uint32_t period, float amplitude)
+{
+    const float inv_period = 1.0f / period;
+    const uint32_t lattice_cells = (size + period - 1) / period;
+
+    for (uint32_t z = 0; z < size; z++)
+    {
+        int32_t lattice_z = (int32_t)(z / period);
+        float fz = ((z % period) + 0.5f) * inv_period;
+        float uz = fade(fz);
+        float *row = height + z * size;
+
+        for (uint32_t lattice_x = 0; lattice_x < lattice_cells; lattice_x++)
+        {
+            uint32_t g00 = hash_lattice(seed, (int32_t)lattice_x, lattice_z);
+            uint32_t g10 = hash_lattice(seed, (int32_t)lattice_x + 1, lattice_z);
+            uint32_t g01 = hash_lattice(seed, (int32_t)lattice_x, lattice_z + 1);
+            uint32_t g11 = hash_lattice(seed, (int32_t)lattice_x + 1, lattice_z + 1);
+
+            // The z halves of the dot products are the same for every lane.
+            float d00 = gradient_z[g00] * fz, d10 = gradient_z[g10] * fz;
+            float d01 = gradient_z[g01] * (fz - 1.0f), d11 = gradient_z[g11] * (fz - 1.0f);
+
+            uint32_t x0 = lattice_x * period;
+            uint32_t x1 = (x0 + period < size) ? x0 + period : size;
+            uint32_t x = x0;
+
+#if defined(__SSE2__)
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 lane_offset = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+            const __m128 vinv_period = _mm_set1_ps(inv_period);
+            const __m128 gx00 = _mm_set1_ps(gradient_x[g00]), gx10 = _mm_set1_ps(gradient_x[g10]);
+            const __m128 gx01 = _mm_set1_ps(gradient_x[g01]), gx11 = _mm_set1_ps(gradient_x[g11]);
+            const __m128 vd00 = _mm_set1_ps(d00), vd10 = _mm_set1_ps(d10);
+            const __m128 vd01 = _mm_set1_ps(d01), vd11 = _mm_set1_ps(d11);
+            const __m128 vuz = _mm_set1_ps(uz), vamplitude = _mm_set1_ps(amplitude);
+
+            for (; x + 4 <= x1; x += 4)
+            {
+                __m128 fx = _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)(x - x0)), lane_offset), vinv_period);
+                __m128 fx1 = _mm_sub_ps(fx, one);
+                __m128 n00 = _mm_add_ps(_mm_mul_ps(gx00, fx), vd00);
+                __m128 n10 = _mm_add_ps(_mm_mul_ps(gx10, fx1), vd10);
+                __m128 n01 = _mm_add_ps(_mm_mul_ps(gx01, fx), vd01);
+                __m128 n11 = _mm_add_ps(_mm_mul_ps(gx11, fx1), vd11);
+
+                // fade(fx) = fx^3 * (fx * (6 fx - 15) + 10)
+                __m128 ux = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(fx, fx), fx),
+                                       _mm_add_ps(_mm_mul_ps(fx, _mm_sub_ps(_mm_mul_ps(fx, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))),
+                                                  _mm_set1_ps(10.0f)));
+                __m128 near_z = _mm_add_ps(n00, _mm_mul_ps(ux, _mm_sub_ps(n10, n00)));
+                __m128 far_z = _mm_add_ps(n01, _mm_mul_ps(ux, _mm_sub_ps(n11, n01)));
+                __m128 value = _mm_add_ps(near_z, _mm_mul_ps(vuz, _mm_sub_ps(far_z, near_z)));
+                _mm_storeu_ps(row + x, _mm_add_ps(_mm_loadu_ps(row + x), _mm_mul_ps(value, vamplitude)));
+            }
+#endif
+
+            for (; x < x1; x++)
+            {
+                float fx = ((x - x0) + 0.5f) * inv_period;
+                float n00 = gradient_x[g00] * fx + d00;
+                float n10 = gradient_x[g10] * (fx - 1.0f) + d10;
+                float n01 = gradient_x[g01] * fx + d01;
+                float n11 = gradient_x[g11] * (fx - 1.0f) + d11;
+                float ux = fade(fx);
+                float near_z = n00 + ux * (n10 - n00);
+                float far_z = n01 + ux * (n11 - n01);
+                row[x] += (near_z + uz * (far_z - near_z)) * amplitude;
+            }
+        }
+    }
+}
+
+/* ========== TERRAIN ========== */
+
+// Sinks a bowl into the ground and raises a ring around it.
+static void add_crater(float *height, uint32_t size, float center_x, float center_z, float radius)
+{
+    const float rim_width = 0.25f * radius + 1.0f;
+    float reach = radius + rim_width;
+    int x0 = (int)fmaxf(center_x - reach, 0.0f), x1 = (int)fminf(center_x + reach, size - 1.0f);
+    int z0 = (int)fmaxf(center_z - reach, 0.0f), z1 = (int)fminf(center_z + reach, size - 1.0f);
+
+    for (int z = z0; z <= z1; z++)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            float dx = x + 0.5f - center_x, dz = z + 0.5f - center_z;
+            float distance = sqrtf(dx * dx + dz * dz);
+            float rim = 1.0f - ((distance - radius) / rim_width) * ((distance - radius) / rim_width);
+            float *cell = &height[z * size + x];
+
+            if (distance < radius)
+                *cell -= 0.5f * (1.0f - (distance * distance) / (radius * radius));
+            if (rim > 0.0f)
+                *cell += rim * rim;
+        }
+    }
+}
+
+// Fills height and is_blocked (size * size each) for a city. Only depends on
+// the seed and size, so a city always comes out the same. Ridges and crater
+// rims are blocked; the middle of the city is always left open.
+void generate_city_terrain(uint64_t seed, uint32_t size, float *height, uint8_t *is_blocked)
+{
+    memset(height, 0, sizeof(float) * size * size);
+
+    float amplitude = 1.0f;
+    for (uint32_t octave = 0; octave < TERRAIN_OCTAVES; octave++)
+    {
+        add_noise_octave(height, size, seed + octave, TERRAIN_BASE_PERIOD >> octave, amplitude);
+        amplitude *= 0.5f;
+    }
+
+    uint64_t rng = seed;
+    uint32_t crater_count = size * size / 4096 + 1;
+    for (uint32_t i = 0; i < crater_count; i++)
+    {
+        float center_x = sim_random_float(&rng) * size;
+        float center_z = sim_random_float(&rng) * size;
+        float radius = 3.0f + sim_random_float(&rng) * size / 12.0f;
+        add_crater(height, size, center_x, center_z, radius);
+    }
+
+    const float half = size / 2.0f;
+    const float clear_radius = TERRAIN_CLEAR_RADIUS * size;
+    for (uint32_t z = 0; z < size; z++)
+    {
+        for (uint32_t x = 0; x < size; x++)
+        {
+            float dx = x + 0.5f - half, dz = z + 0.5f - half;
+            bool is_central = dx * dx + dz * dz < clear_radius * clear_radius;
+            is_blocked[z * size + x] = !is_central && height[z * size + x] > TERRAIN_BLOCK_HEIGHT;
+        }
+    }
+}
+
+/* ========== GENERATION JOBS ========== */
+
+bool city_generator_init(CityGenerator *generator, MemoryArena *arena, uint32_t size, uint64_t seed)
+{
+    generator->seed = seed;
+    generator->size = size;
+    generator->height = (float *)arena_alloc(arena, sizeof(float) * size * size);
+    generator->is_blocked = (uint8_t *)arena_alloc(arena, size * size);
+    return generator->height && generator->is_blocked;
+}
+
+static void run_city_generation(void *data)
+{
+    CityGenerator *generator = (CityGenerator *)data;
+    double start = jobs_time_now();
+    generate_city_terrain(generator->seed, generator->size, generator->height, generator->is_blocked);
+    generator->seconds = jobs_time_now() - start;
+}
+
+// Called when the first company buys into a city. Until the job is done the
+// city takes no buildings.
+void start_city_generation(Game *game, int32_t city_index)
+{
+    City *city = &game->data.cities[city_index];
+    CityGenerator *generator = &game->data.city_generators[city_index];
+    if (city->terrain_state != CITY_TERRAIN_NONE || !generator->height)
+        return;
+
+    city->terrain_state = CITY_TERRAIN_GENERATING;
+    jobs_submit(&generator->job, run_city_generation, generator);
+}
+
+// Called once per frame. Moves finished terrain into the city's grid.
+void update_city_generation(Game *game)
+{
+    for (int i = 0; i < MAX_CITIES; i++)
+    {
+        City *city = &game->data.cities[i];
+        CityGenerator *generator = &game->data.city_generators[i];
+        if (city->terrain_state != CITY_TERRAIN_GENERATING || !job_is_done(&generator->job))
+            continue;
+
+        for (uint32_t z = 0; z < city->size; z++)
+        {
+            for (uint32_t x = 0; x < city->size; x++)
+            {
+                if (generator->is_blocked[z * city->size + x])
+                    city_grid_set_blocked(city, (int)x, (int)z);
+            }
+        }
+        city->terrain_height = generator->height;
+        city->terrain_state = CITY_TERRAIN_READY;
+    }
+}
+
+void clean_up_city_generation(Game *game)
+{
+    for (int i = 0; i < MAX_CITIES; i++)
+    {
+        if (game->data.cities[i].terrain_state == CITY_TERRAIN_GENERATING)
+            job_wait(&game->data.city_generators[i].job);
+    }
+}
@@ -0,0 +1,160 @@
+#include "game.h"
+#include "rlgl.h"
+#include <string.h>
+
+/* ========== FORMATTING ========== */
+
+static const char digit_pairs[201] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                                     "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                                     "8081828384858687888990919293949596979899";
+
+// Appends text at out and returns the new end. Neither these nor
+// append_u64 write a terminator; the label functions add it.
+char *append_text(char *out, const char *text)
+{
+    size_t length = strlen(text);
+    memcpy(out, text, length);
+    return out + length;
+}
+
+// Decimal digits of value, two at a time from the back.
+char *append_u64(char *out, uint64_t value)
+{
+    char digits[20];
+    int start = 20;
+    while (value >= 100)
+    {
+        uint32_t pair = (uint32_t)(value % 100) * 2;
+        value /= 100;
+        digits[--start] = digit_pairs[pair + 1];
+        digits[--start] = digit_pairs[pair];
+    }
+    if (value >= 10)
+    {
+        digits[--start] = digit_pairs[value * 2 + 1];
+        digits[--start] = digit_pairs[value * 2];
+    }
+    else
+    {
+        digits[--start] = (char)('0' + value);
+    }
+
+    memcpy(out, digits + start, (size_t)(20 - start));
+    return out + (20 - start);
+}
+
+char *append_i64(char *out, int64_t value)
+{
+    if (value < 0)
+    {
+        *out++ = '-';
+        return append_u64(out, 0 - (uint64_t)value);
+    }
+    return append_u64(out, (uint64_t)value);
+}
+
+// value to one decimal place, rounded half away from zero.
+char *append_tenths(char *out, float value)
+{
+    long long tenths = llround((double)value * 10.0);
+    if (tenths < 0)
+    {
+        *out++ = '-';
+        tenths = -tenths;
+    }
+    out = append_u64(out, (uint64_t)tenths / 10);
+    *out++ = '.';
+    *out++ = (char)('0' + tenths % 10);
+    return out;
+}
+
+/* ========== LABELS ========== */
+
+// True if the label doesn't show value yet, in which case it takes value
+// as its new one and the caller is expected to set its text. Values are
+// compared byte for byte, so structs passed here should be zeroed first.
+bool text_label_update(TextLabel *label, const void *value, size_t size)
+{
+    size = (size > TEXT_LABEL_KEY_SIZE) ? TEXT_LABEL_KEY_SIZE : size;
+    if (label->is_valid && label->key_size == size && memcmp(label->key, value, size) == 0)
+        return false;
+
+    memcpy(label->key, value, size);
+    label->key_size = (uint32_t)size;
+    label->is_valid = true;
+    return true;
+}
+
+// Lays text out the way DrawText() would at position, with the default
+// font, and keeps the glyph quads for draw_text_label(). The text is
+// cut to fit the label.
+void text_label_set(TextLabel *label, const char *text, Vector2 position, float font_size)
+{
+    size_t length = strlen(text);
+    length = (length >= MAX_LABEL_LENGTH) ? MAX_LABEL_LENGTH - 1 : length;
+    memcpy(label->text, text, length);
+    label->text[length] = '\0';
+
+    Font font = GetFontDefault();
+    font_size = (font_size < 10.0f) ? 10.0f : font_size;
+    float scale = font_size / font.baseSize;
+    float spacing = (float)((int)font_size / 10); // DrawText() spaces glyphs by whole pixels
+    float padding = (float)font.glyphPadding;
+    float offset_x = 0.0f;
+
+    label->glyph_count = 0;
+    for (size_t i = 0; i < length;)
+    {
+        int codepoint_size = 0;
+        int codepoint = GetCodepointNext(&label->text[i], &codepoint_size);
+        int index = GetGlyphIndex(font, codepoint);
+        i += (codepoint_size > 0) ? (size_t)codepoint_size : 1;
+
+        Rectangle source = font.recs[index];
+        if (codepoint != ' ' && codepoint != '\t')
+        {
+            float x = position.x + offset_x + (font.glyphs[index].offsetX - padding) * scale;
+            float y = position.y + (font.glyphs[index].offsetY - padding) * scale;
+            float width = (source.width + 2.0f * padding) * scale;
+            float height = (source.height + 2.0f * padding) * scale;
+            float u0 = (source.x - padding) / font.texture.width;
+            float v0 = (source.y - padding) / font.texture.height;
+            float u1 = (source.x + source.width + padding) / font.texture.width;
+            float v1 = (source.y + source.height + padding) / font.texture.height;
+
+            // Top left, bottom left, bottom right, top right, as rlgl's quads go.
+            float *vertex = &label->vertices[label->glyph_count * 8];
+            float *texcoord = &label->texcoords[label->glyph_count * 8];
+            const float corners[8] = {x, y, x, y + height, x + width, y + height, x + width, y};
+            const float uvs[8] = {u0, v0, u0, v1, u1, v1, u1, v0};
+            memcpy(vertex, corners, sizeof(corners));
+            memcpy(texcoord, uvs, sizeof(uvs));
+            label->glyph_count++;
+        }
+
+        float advance = font.glyphs[index].advanceX ? font.glyphs[index].advanceX : source.width;
+        offset_x += advance * scale + spacing;
+    }
+    label->width = (length > 0) ? offset_x - spacing : 0.0f;
+}
+
+// Replays the label's quads into rlgl's batch: no formatting, no glyph
+// lookups, one texture for every label.
+void draw_text_label(const TextLabel *label, Color color)
+{
+    if (label->glyph_count == 0)
+        return;
+
+    rlCheckRenderBatchLimit((int)label->glyph_count * 4);
+    rlSetTexture(GetFontDefault().texture.id);
+    rlBegin(RL_QUADS);
+    rlColor4ub(color.r, color.g, color.b, color.a);
+    rlNormal3f(0.0f, 0.0f, 1.0f);
+    for (uint32_t i = 0; i < label->glyph_count * 4; i++)
+    {
+        rlTexCoord2f(label->texcoords[i * 2], label->texcoords[i * 2 + 1]);
+        rlVertex2f(label->vertices[i * 2], label->vertices[i * 2 + 1]);
+    }
+    rlEnd();
+    rlSetTexture(0);
+}
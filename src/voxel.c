@@ -0,0 +1,722 @@
+#include "game.h"
+#include <string.h>
+
+/* ========== .VOX FILES ========== */
+
+// Cells are stored x fastest, then z, then y.
+static size_t voxel_shape_index(const VoxelShape *shape, int32_t x, int32_t y, int32_t z)
+{
+    return ((size_t)y * shape->size_z + z) * shape->size_x + x;
+}
+
+static uint32_t read_u32(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t *bytes = (length > 0) ? (uint8_t *)malloc((size_t)length) : NULL;
+    if (bytes && fread(bytes, 1, (size_t)length, file) != (size_t)length)
+    {
+        free(bytes);
+        bytes = NULL;
+    }
+    fclose(file);
+
+    *size = (size_t)length;
+    return bytes;
+}
+
+// FNV-1a, to tell whether a cache still belongs to its file.
+static uint64_t hash_bytes(const uint8_t *bytes, size_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+    return hash;
+}
+
+// Reads the first model of a MagicaVoxel file and its palette, if it has
+// one. MagicaVoxel is z up; raylib's loader turns file (x, y, z) into mesh
+// (x, z, size_y - 1 - y), and so does this. Only the cells are filled in.
+// The hash of the whole file goes to *file_hash.
+static bool parse_vox_file(VoxelShape *shape, const char *path, uint64_t *file_hash)
+{
+    *shape = (VoxelShape){0};
+
+    size_t size = 0;
+    uint8_t *bytes = read_file(path, &size);
+    if (!bytes)
+        return false;
+    if (size < 20 || memcmp(bytes, "VOX ", 4) != 0 || memcmp(bytes + 8, "MAIN", 4) != 0)
+    {
+        free(bytes);
+        return false;
+    }
+    *file_hash = hash_bytes(bytes, size);
+
+    // MAIN's children follow its 12-byte header; it has no content of its own.
+    size_t offset = 20 + read_u32(bytes + 12);
+    uint32_t file_x = 0, file_y = 0, file_z = 0;
+    bool has_voxels = false;
+    while (offset + 12 <= size)
+    {
+        const uint8_t *chunk = bytes + offset;
+        uint32_t content_size = read_u32(chunk + 4);
+        uint32_t children_size = read_u32(chunk + 8);
+        const uint8_t *content = chunk + 12;
+        if (offset + 12 + content_size > size)
+            break;
+
+        if (memcmp(chunk, "SIZE", 4) == 0 && content_size >= 12 && !shape->cells)
+        {
+            file_x = read_u32(content);
+            file_y = read_u32(content + 4);
+            file_z = read_u32(content + 8);
+            shape->size_x = (int32_t)file_x;
+            shape->size_y = (int32_t)file_z;
+            shape->size_z = (int32_t)file_y;
+            shape->cells = (uint8_t *)calloc((size_t)file_x * file_y * file_z, 1);
+        }
+        else if (memcmp(chunk, "XYZI", 4) == 0 && content_size >= 4 && shape->cells && !has_voxels)
+        {
+            uint32_t count = read_u32(content);
+            if (count > (content_size - 4) / 4)
+                count = (content_size - 4) / 4;
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                const uint8_t *voxel = content + 4 + i * 4;
+                if (voxel[0] >= file_x || voxel[1] >= file_y || voxel[2] >= file_z)
+                    continue;
+
+                int32_t x = voxel[0], y = voxel[2], z = (int32_t)file_y - 1 - voxel[1];
+                shape->cells[voxel_shape_index(shape, x, y, z)] = voxel[3];
+            }
+            has_voxels = true; // only the first model
+        }
+        else if (memcmp(chunk, "RGBA", 4) == 0 && content_size >= 256 * 4)
+        {
+            // Entry i holds the color of palette index i + 1.
+            for (int i = 0; i < 255; i++)
+                shape->palette[i + 1] = (Color){content[i * 4], content[i * 4 + 1], content[i * 4 + 2], content[i * 4 + 3]};
+            shape->has_palette = true;
+        }
+
+        offset += 12 + content_size + children_size;
+    }
+    free(bytes);
+
+    if (!shape->cells || !has_voxels)
+    {
+        unload_voxel_shape(shape);
+        return false;
+    }
+    return true;
+}
+
+// Lays the cells of a MagicaVoxel file over mesh_bounds, the bounds of the
+// mesh raylib built from the same file. Returns false if the file can't be
+// read or the mesh is empty, in which case the shape is left zeroed.
+bool load_voxel_shape(VoxelShape *shape, const char *path, BoundingBox mesh_bounds)
+{
+    uint64_t file_hash;
+    if (!parse_vox_file(shape, path, &file_hash))
+        return false;
+
+    Vector3 extent = Vector3Subtract(mesh_bounds.max, mesh_bounds.min);
+    if (extent.x <= 0.0f || extent.y <= 0.0f || extent.z <= 0.0f)
+    {
+        unload_voxel_shape(shape);
+        return false;
+    }
+
+    shape->mesh_min = mesh_bounds.min;
+    shape->cell_size = (Vector3){extent.x / shape->size_x, extent.y / shape->size_y, extent.z / shape->size_z};
+    return true;
+}
+
+void unload_voxel_shape(VoxelShape *shape)
+{
+    free(shape->cells);
+    *shape = (VoxelShape){0};
+}
+
+/* ========== GREEDY MESHING ========== */
+
+#define VOXEL_MESH_QUADS 16384 // 16-bit indices reach 65536 vertices
+
+// Quads found so far, as four corners, a palette index and the occlusion
+// of the corners each. Occlusion takes 2 bits per corner, in the order of
+// the corners, from 0 (boxed in) to 3 (open).
+typedef struct
+{
+    Vector3 *corners;
+    uint8_t *colors;
+    uint8_t *occlusion;
+    uint32_t count;
+    uint32_t capacity;
+
+} QuadList;
+
+static void free_quads(QuadList *quads)
+{
+    free(quads->corners);
+    free(quads->colors);
+    free(quads->occlusion);
+    *quads = (QuadList){0};
+}
+
+static bool reserve_quads(QuadList *quads, uint32_t capacity)
+{
+    if (capacity <= quads->capacity)
+        return true;
+
+    Vector3 *new_corners = (Vector3 *)realloc(quads->corners, sizeof(Vector3) * 4 * capacity);
+    if (!new_corners)
+        return false;
+    quads->corners = new_corners;
+
+    uint8_t *new_colors = (uint8_t *)realloc(quads->colors, capacity);
+    if (!new_colors)
+        return false;
+    quads->colors = new_colors;
+
+    uint8_t *new_occlusion = (uint8_t *)realloc(quads->occlusion, capacity);
+    if (!new_occlusion)
+        return false;
+    quads->occlusion = new_occlusion;
+    quads->capacity = capacity;
+    return true;
+}
+
+static bool is_solid(const VoxelShape *shape, int32_t x, int32_t y, int32_t z)
+{
+    return x >= 0 && y >= 0 && z >= 0 && x < shape->size_x && y < shape->size_y && z < shape->size_z &&
+           shape->cells[voxel_shape_index(shape, x, y, z)] != 0;
+}
+
+static bool add_voxel_quad(QuadList *quads, const Vector3 corners[4], uint8_t color, uint8_t occlusion)
+{
+    if (quads->count == quads->capacity && !reserve_quads(quads, quads->capacity ? quads->capacity * 2 : 1024))
+        return false;
+
+    memcpy(&quads->corners[quads->count * 4], corners, sizeof(Vector3) * 4);
+    quads->colors[quads->count] = color;
+    quads->occlusion[quads->count++] = occlusion;
+    return true;
+}
+
+// Classic voxel corner occlusion: each corner of a face is darkened by the
+// two cells along its edges and the one across its corner, in the empty
+// layer the face looks into. Corners go (-u, -v), (+u, -v), (+u, +v),
+// (-u, +v) around the empty cell.
+static uint8_t get_face_occlusion(const VoxelShape *shape, const int32_t empty[3], int u, int v)
+{
+    static const int32_t corner_u[4] = {-1, 1, 1, -1};
+    static const int32_t corner_v[4] = {-1, -1, 1, 1};
+
+    uint8_t occlusion = 0;
+    for (int corner = 0; corner < 4; corner++)
+    {
+        int32_t side_u[3] = {empty[0], empty[1], empty[2]};
+        int32_t side_v[3] = {empty[0], empty[1], empty[2]};
+        side_u[u] += corner_u[corner];
+        side_v[v] += corner_v[corner];
+        int32_t across[3] = {side_u[0], side_u[1], side_u[2]};
+        across[v] += corner_v[corner];
+
+        int a = is_solid(shape, side_u[0], side_u[1], side_u[2]);
+        int b = is_solid(shape, side_v[0], side_v[1], side_v[2]);
+        int c = is_solid(shape, across[0], across[1], across[2]);
+        int open = (a && b) ? 0 : 3 - (a + b + c);
+        occlusion |= (uint8_t)(open << (corner * 2));
+    }
+    return occlusion;
+}
+
+// Greedy meshing after Lysenko. Every plane between two layers of cells
+// along each axis gets a mask of the faces it holds, signed by the way they
+// face; a face exists only where a solid cell meets an empty one, so faces
+// between neighbors never make it in. Each mask is then covered with the
+// fewest rectangles of one color, facing and corner occlusion, so a merged
+// quad shades exactly like the faces it stands for.
+static bool mesh_voxel_shape(const VoxelShape *shape, QuadList *quads)
+{
+    const int32_t size[3] = {shape->size_x, shape->size_y, shape->size_z};
+    const float cell[3] = {shape->cell_size.x, shape->cell_size.y, shape->cell_size.z};
+    const float origin[3] = {shape->mesh_min.x, shape->mesh_min.y, shape->mesh_min.z};
+    int32_t largest = size[0] * size[1];
+    largest = (size[1] * size[2] > largest) ? size[1] * size[2] : largest;
+    largest = (size[2] * size[0] > largest) ? size[2] * size[0] : largest;
+
+    // Palette index in the low byte, occlusion in the next.
+    int32_t *mask = (int32_t *)malloc(sizeof(int32_t) * (size_t)largest);
+    if (!mask)
+        return false;
+
+    bool is_ok = true;
+    for (int d = 0; d < 3 && is_ok; d++)
+    {
+        const int u = (d + 1) % 3, v = (d + 2) % 3;
+        int32_t p[3] = {0}, step[3] = {0};
+        step[d] = 1;
+
+        for (p[d] = -1; p[d] < size[d] && is_ok; p[d]++)
+        {
+            // Faces on the plane between layer p[d] and layer p[d] + 1.
+            int32_t n = 0;
+            for (p[v] = 0; p[v] < size[v]; p[v]++)
+            {
+                for (p[u] = 0; p[u] < size[u]; p[u]++, n++)
+                {
+                    int32_t next[3] = {p[0] + step[0], p[1] + step[1], p[2] + step[2]};
+                    bool a = is_solid(shape, p[0], p[1], p[2]);
+                    bool b = is_solid(shape, next[0], next[1], next[2]);
+                    if (a == b)
+                        mask[n] = 0;
+                    else if (a)
+                        mask[n] = shape->cells[voxel_shape_index(shape, p[0], p[1], p[2])] |
+                                  (get_face_occlusion(shape, next, u, v) << 8);
+                    else
+                        mask[n] = -(shape->cells[voxel_shape_index(shape, next[0], next[1], next[2])] |
+                                    (get_face_occlusion(shape, p, u, v) << 8));
+                }
+            }
+
+            n = 0;
+            for (int32_t j = 0; j < size[v]; j++)
+            {
+                for (int32_t i = 0; i < size[u];)
+                {
+                    int32_t face = mask[n];
+                    if (face == 0)
+                    {
+                        i++;
+                        n++;
+                        continue;
+                    }
+
+                    int32_t width = 1;
+                    while (i + width < size[u] && mask[n + width] == face)
+                        width++;
+
+                    int32_t height = 1;
+                    for (; j + height < size[v]; height++)
+                    {
+                        bool is_match = true;
+                        for (int32_t k = 0; k < width && is_match; k++)
+                            is_match = mask[n + k + height * size[u]] == face;
+                        if (!is_match)
+                            break;
+                    }
+
+                    float corner[3];
+                    corner[d] = origin[d] + (p[d] + 1) * cell[d];
+                    corner[u] = origin[u] + i * cell[u];
+                    corner[v] = origin[v] + j * cell[v];
+                    float du[3] = {0}, dv[3] = {0};
+                    du[u] = width * cell[u];
+                    dv[v] = height * cell[v];
+
+                    // u x v points along +d, so this order is counter-clockwise
+                    // seen from +d; faces looking down -d go the other way.
+                    int32_t key = (face < 0) ? -face : face;
+                    uint8_t occlusion = (uint8_t)(key >> 8);
+                    Vector3 a = {corner[0], corner[1], corner[2]};
+                    Vector3 b = {corner[0] + du[0], corner[1] + du[1], corner[2] + du[2]};
+                    Vector3 c = {corner[0] + du[0] + dv[0], corner[1] + du[1] + dv[1], corner[2] + du[2] + dv[2]};
+                    Vector3 e = {corner[0] + dv[0], corner[1] + dv[1], corner[2] + dv[2]};
+                    Vector3 corners[4] = {a, b, c, e};
+                    if (face < 0)
+                    {
+                        corners[1] = e;
+                        corners[3] = b;
+                        occlusion = (uint8_t)((occlusion & 0x33) | ((occlusion & 0x0C) << 4) | ((occlusion & 0xC0) >> 4));
+                    }
+
+                    if (!add_voxel_quad(quads, corners, (uint8_t)(key & 0xFF), occlusion))
+                    {
+                        is_ok = false;
+                        break;
+                    }
+
+                    for (int32_t l = 0; l < height; l++)
+                        for (int32_t k = 0; k < width; k++)
+                            mask[n + k + l * size[u]] = 0;
+
+                    i += width;
+                    n += width;
+                }
+                if (!is_ok)
+                    break;
+            }
+        }
+    }
+
+    free(mask);
+    return is_ok;
+}
+
+// Positions, normals, a texture coordinate into the palette texture and
+// the corner occlusion as a gray vertex color per vertex. Each quad is split along
+// the diagonal with the more open ends, so a single dark corner shades
+// one triangle instead of streaking across both.
+static Mesh build_voxel_mesh(const QuadList *quads, uint32_t first, uint32_t count)
+{
+    static const unsigned char brightness[4] = {128, 178, 217, 255};
+
+    Mesh mesh = {0};
+    mesh.vertexCount = (int)count * 4;
+    mesh.triangleCount = (int)count * 2;
+    mesh.vertices = (float *)MemAlloc(sizeof(float) * 3 * mesh.vertexCount);
+    mesh.texcoords = (float *)MemAlloc(sizeof(float) * 2 * mesh.vertexCount);
+    mesh.normals = (float *)MemAlloc(sizeof(float) * 3 * mesh.vertexCount);
+    mesh.colors = (unsigned char *)MemAlloc(sizeof(unsigned char) * 4 * mesh.vertexCount);
+    mesh.indices = (unsigned short *)MemAlloc(sizeof(unsigned short) * 3 * mesh.triangleCount);
+
+    memcpy(mesh.vertices, &quads->corners[first * 4], sizeof(float) * 3 * mesh.vertexCount);
+    for (uint32_t q = 0; q < count; q++)
+    {
+        float palette_u = (quads->colors[first + q] + 0.5f) / 256.0f;
+        const Vector3 *corners = &quads->corners[(first + q) * 4];
+        Vector3 normal = Vector3Normalize(Vector3CrossProduct(Vector3Subtract(corners[1], corners[0]), Vector3Subtract(corners[3], corners[0])));
+        int open[4];
+        for (int corner = 0; corner < 4; corner++)
+        {
+            memcpy(&mesh.normals[(q * 4 + corner) * 3], &normal, sizeof(normal));
+            open[corner] = (quads->occlusion[first + q] >> (corner * 2)) & 3;
+            unsigned char *color = mesh.colors + (q * 4 + corner) * 4;
+            color[0] = color[1] = color[2] = brightness[open[corner]];
+            color[3] = 255;
+            mesh.texcoords[(q * 4 + corner) * 2] = palette_u;
+            mesh.texcoords[(q * 4 + corner) * 2 + 1] = 0.5f;
+        }
+
+        int start = (open[0] + open[2] < open[1] + open[3]) ? 1 : 0;
+        unsigned short *index = mesh.indices + q * 6;
+        unsigned short base = (unsigned short)(q * 4);
+        index[0] = base + start;
+        index[1] = base + (start + 1) % 4;
+        index[2] = base + (start + 2) % 4;
+        index[3] = base + start;
+        index[4] = base + (start + 2) % 4;
+        index[5] = base + (start + 3) % 4;
+    }
+
+    UploadMesh(&mesh, false);
+    return mesh;
+}
+
+// Turns meshed quads into model, in as many meshes as they need, with the
+// palette as a 256x1 texture. Returns false, leaving the model zeroed, if
+// there are no quads.
+static bool build_voxel_model(Model *model, const Color palette[256], const QuadList *quads)
+{
+    *model = (Model){0};
+    if (quads->count == 0)
+        return false;
+
+    model->transform = MatrixIdentity();
+    model->meshCount = (int)((quads->count + VOXEL_MESH_QUADS - 1) / VOXEL_MESH_QUADS);
+    model->meshes = (Mesh *)MemAlloc(sizeof(Mesh) * model->meshCount);
+    model->meshMaterial = (int *)MemAlloc(sizeof(int) * model->meshCount);
+    for (int m = 0; m < model->meshCount; m++)
+    {
+        uint32_t first = (uint32_t)m * VOXEL_MESH_QUADS;
+        uint32_t count = (quads->count - first > VOXEL_MESH_QUADS) ? VOXEL_MESH_QUADS : quads->count - first;
+        model->meshes[m] = build_voxel_mesh(quads, first, count);
+    }
+
+    Image image = GenImageColor(256, 1, BLANK);
+    for (int i = 0; i < 256; i++)
+        ImageDrawPixel(&image, i, 0, palette[i]);
+    Texture2D texture = LoadTextureFromImage(image);
+    UnloadImage(image);
+    SetTextureFilter(texture, TEXTURE_FILTER_POINT);
+
+    model->materialCount = 1;
+    model->materials = (Material *)MemAlloc(sizeof(Material));
+    model->materials[0] = LoadMaterialDefault();
+    SetMaterialTexture(&model->materials[0], MATERIAL_MAP_DIFFUSE, texture);
+    return true;
+}
+
+/* ========== LEVELS OF DETAIL ========== */
+
+// Halves the shape along every axis. A coarse cell is solid where at least
+// half of the eight cells under it are, so walls one cell thick survive,
+// and takes the color most of its solid cells have. The coarse grid covers
+// the same corner and cell sizes double; an odd size leaves the last row
+// of coarse cells half over nothing, which counts as empty.
+static bool downsample_voxel_shape(VoxelShape *coarse, const VoxelShape *fine)
+{
+    *coarse = *fine;
+    coarse->size_x = (fine->size_x + 1) / 2;
+    coarse->size_y = (fine->size_y + 1) / 2;
+    coarse->size_z = (fine->size_z + 1) / 2;
+    coarse->cell_size = Vector3Scale(fine->cell_size, 2.0f);
+    coarse->cells = (uint8_t *)calloc((size_t)coarse->size_x * coarse->size_y * coarse->size_z, 1);
+    if (!coarse->cells)
+        return false;
+
+    for (int32_t y = 0; y < coarse->size_y; y++)
+    {
+        for (int32_t z = 0; z < coarse->size_z; z++)
+        {
+            for (int32_t x = 0; x < coarse->size_x; x++)
+            {
+                uint8_t colors[8];
+                int solid_count = 0;
+                for (int corner = 0; corner < 8; corner++)
+                {
+                    int32_t fine_x = x * 2 + (corner & 1), fine_y = y * 2 + ((corner >> 1) & 1), fine_z = z * 2 + (corner >> 2);
+                    if (is_solid(fine, fine_x, fine_y, fine_z))
+                        colors[solid_count++] = fine->cells[voxel_shape_index(fine, fine_x, fine_y, fine_z)];
+                }
+                if (solid_count < 4)
+                    continue;
+
+                // Ties go to the color met first.
+                uint8_t color = colors[0];
+                int best = 0;
+                for (int i = 0; i < solid_count; i++)
+                {
+                    int votes = 0;
+                    for (int j = 0; j < solid_count; j++)
+                        votes += colors[j] == colors[i];
+                    if (votes > best)
+                    {
+                        best = votes;
+                        color = colors[i];
+                    }
+                }
+                coarse->cells[voxel_shape_index(coarse, x, y, z)] = color;
+            }
+        }
+    }
+    return true;
+}
+
+// Meshes the shape and then coarser versions of it, each from half the
+// voxels of the one before, into levels. Stops early once the shape gets
+// down to a couple of cells or a level comes out empty. Returns how many
+// levels were meshed.
+static int32_t mesh_voxel_levels(const VoxelShape *shape, QuadList *levels, int32_t max_levels)
+{
+    VoxelShape fine = *shape;
+    int32_t count = 0;
+    while (count < max_levels)
+    {
+        if (!mesh_voxel_shape(&fine, &levels[count]) || levels[count].count == 0)
+        {
+            free_quads(&levels[count]);
+            break;
+        }
+        count++;
+
+        VoxelShape coarse;
+        bool is_small = fine.size_x <= 2 || fine.size_y <= 2 || fine.size_z <= 2;
+        bool is_downsampled = !is_small && count < max_levels && downsample_voxel_shape(&coarse, &fine);
+        if (fine.cells != shape->cells)
+            free(fine.cells);
+        fine.cells = NULL;
+        if (!is_downsampled)
+            break;
+        fine = coarse;
+    }
+
+    if (fine.cells != shape->cells)
+        free(fine.cells);
+    return count;
+}
+
+/* ========== MESH CACHE ========== */
+
+// Meshing and occlusion are done once per file and kept next to it as
+// <file>.mesh: the quads of every level, behind the hash of the .vox file
+// they came from. A cache that doesn't match is rebuilt and written over;
+// one that can't be written only costs the meshing next time.
+#define VOXEL_CACHE_MAGIC "VXMC"
+#define VOXEL_CACHE_VERSION 1u
+
+static bool read_mesh_cache(const char *path, uint64_t file_hash, QuadList *levels, int32_t max_levels, int32_t *level_count)
+{
+    *level_count = 0;
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    char magic[4];
+    uint32_t version = 0, count = 0;
+    uint64_t hash = 0;
+    bool is_ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, VOXEL_CACHE_MAGIC, 4) == 0 &&
+                 fread(&version, sizeof(version), 1, file) == 1 && version == VOXEL_CACHE_VERSION &&
+                 fread(&hash, sizeof(hash), 1, file) == 1 && hash == file_hash &&
+                 fread(&count, sizeof(count), 1, file) == 1 && count > 0 && count <= (uint32_t)max_levels;
+
+    for (uint32_t level = 0; level < count && is_ok; level++)
+    {
+        QuadList *quads = &levels[level];
+        uint32_t quad_count = 0;
+        is_ok = fread(&quad_count, sizeof(quad_count), 1, file) == 1 && quad_count > 0 && reserve_quads(quads, quad_count) &&
+                fread(quads->corners, sizeof(Vector3) * 4, quad_count, file) == quad_count &&
+                fread(quads->colors, 1, quad_count, file) == quad_count &&
+                fread(quads->occlusion, 1, quad_count, file) == quad_count;
+        quads->count = is_ok ? quad_count : 0;
+    }
+    fclose(file);
+
+    if (!is_ok)
+    {
+        for (int32_t level = 0; level < max_levels; level++)
+            free_quads(&levels[level]);
+        return false;
+    }
+    *level_count = (int32_t)count;
+    return true;
+}
+
+static void write_mesh_cache(const char *path, uint64_t file_hash, const QuadList *levels, int32_t level_count)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return;
+
+    uint32_t version = VOXEL_CACHE_VERSION, count = (uint32_t)level_count;
+    bool is_ok = fwrite(VOXEL_CACHE_MAGIC, 1, 4, file) == 4 && fwrite(&version, sizeof(version), 1, file) == 1 &&
+                 fwrite(&file_hash, sizeof(file_hash), 1, file) == 1 && fwrite(&count, sizeof(count), 1, file) == 1;
+    for (int32_t level = 0; level < level_count && is_ok; level++)
+    {
+        const QuadList *quads = &levels[level];
+        is_ok = fwrite(&quads->count, sizeof(quads->count), 1, file) == 1 &&
+                fwrite(quads->corners, sizeof(Vector3) * 4, quads->count, file) == quads->count &&
+                fwrite(quads->colors, 1, quads->count, file) == quads->count &&
+                fwrite(quads->occlusion, 1, quads->count, file) == quads->count;
+    }
+    fclose(file);
+
+    // A torn cache would only be rejected next time; better not to leave one.
+    if (!is_ok)
+        remove(path);
+}
+
+/* ========== MODELS ========== */
+
+// Loads a MagicaVoxel file as a model of greedy-meshed quads colored from
+// a 256x1 palette texture and shaded by baked corner occlusion, its voxels
+// into shape for picking, and up to MAX_VOXEL_LODS coarser models into
+// lods. The meshes have one unit per full-detail cell, centered on x and z
+// with their base at y = 0. Returns false, leaving everything zeroed, if
+// the file can't be read or has no palette of its own; raylib's loader
+// knows MagicaVoxel's default one.
+bool load_voxel_model(Model *model, Model lods[MAX_VOXEL_LODS], int32_t *lod_count, VoxelShape *shape, const char *path)
+{
+    *model = (Model){0};
+    *lod_count = 0;
+
+    uint64_t file_hash;
+    if (!parse_vox_file(shape, path, &file_hash))
+        return false;
+    if (!shape->has_palette)
+    {
+        unload_voxel_shape(shape);
+        return false;
+    }
+
+    shape->mesh_min = (Vector3){-shape->size_x / 2.0f, 0.0f, -shape->size_z / 2.0f};
+    shape->cell_size = (Vector3){1.0f, 1.0f, 1.0f};
+
+    char cache_path[512];
+    snprintf(cache_path, sizeof(cache_path), "%s.mesh", path);
+    QuadList levels[MAX_VOXEL_LODS + 1] = {0};
+    int32_t level_count = 0;
+    if (!read_mesh_cache(cache_path, file_hash, levels, MAX_VOXEL_LODS + 1, &level_count))
+    {
+        level_count = mesh_voxel_levels(shape, levels, MAX_VOXEL_LODS + 1);
+        if (level_count > 0)
+            write_mesh_cache(cache_path, file_hash, levels, level_count);
+    }
+
+    bool is_loaded = level_count > 0 && build_voxel_model(model, shape->palette, &levels[0]);
+    for (int32_t level = 1; level < level_count && is_loaded; level++)
+    {
+        if (!build_voxel_model(&lods[*lod_count], shape->palette, &levels[level]))
+            break;
+        (*lod_count)++;
+    }
+
+    for (int32_t level = 0; level < level_count; level++)
+        free_quads(&levels[level]);
+    if (!is_loaded)
+        unload_voxel_shape(shape);
+    return is_loaded;
+}
+
+/* ========== RAY CASTS ========== */
+
+// Walks the cells along a mesh-space ray (Amanatides & Woo) and returns the
+// ray parameter where it enters the first solid one. The direction doesn't
+// have to be normalized; t is in the caller's units either way.
+bool voxel_shape_raycast(const VoxelShape *shape, Vector3 origin, Vector3 direction, float max_t, float *hit_t)
+{
+    const int32_t size[3] = {shape->size_x, shape->size_y, shape->size_z};
+    const float o[3] = {(origin.x - shape->mesh_min.x) / shape->cell_size.x, (origin.y - shape->mesh_min.y) / shape->cell_size.y,
+                        (origin.z - shape->mesh_min.z) / shape->cell_size.z};
+    const float d[3] = {direction.x / shape->cell_size.x, direction.y / shape->cell_size.y, direction.z / shape->cell_size.z};
+
+    // Clip the ray to the grid's box first.
+    float t = 0.0f, t_exit = max_t;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (fabsf(d[axis]) < 1e-12f)
+        {
+            if (o[axis] < 0.0f || o[axis] > size[axis])
+                return false;
+            continue;
+        }
+
+        float t_a = -o[axis] / d[axis];
+        float t_b = (size[axis] - o[axis]) / d[axis];
+        t = fmaxf(t, fminf(t_a, t_b));
+        t_exit = fminf(t_exit, fmaxf(t_a, t_b));
+    }
+    if (t > t_exit)
+        return false;
+
+    int32_t cell[3], step[3];
+    float next[3], delta[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        cell[axis] = (int32_t)floorf(o[axis] + d[axis] * t);
+        cell[axis] = (cell[axis] < 0) ? 0 : (cell[axis] >= size[axis]) ? size[axis] - 1 : cell[axis];
+        step[axis] = (d[axis] > 0.0f) ? 1 : (d[axis] < 0.0f) ? -1 : 0;
+        delta[axis] = step[axis] ? fabsf(1.0f / d[axis]) : INFINITY;
+        next[axis] = step[axis] ? ((cell[axis] + (step[axis] > 0)) - o[axis]) / d[axis] : INFINITY;
+    }
+
+    for (;;)
+    {
+        if (shape->cells[voxel_shape_index(shape, cell[0], cell[1], cell[2])])
+        {
+            *hit_t = t;
+            return true;
+        }
+
+        int axis = (next[0] < next[1]) ? ((next[0] < next[2]) ? 0 : 2) : ((next[1] < next[2]) ? 1 : 2);
+        t = next[axis];
+        cell[axis] += step[axis];
+        if (t > t_exit || cell[axis] < 0 || cell[axis] >= size[axis])
+            return false;
+        next[axis] += delta[axis];
+    }
+}